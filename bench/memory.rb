@@ -0,0 +1,68 @@
+# frozen_string_literal: true
+
+# Memory benchmark for EtcUtils.intern_strings
+#
+# Generates a synthetic passwd/group database under a temporary root,
+# enumerates it in a fresh child process with interning off and on, and
+# reports the resident set size and String object counts retained by the
+# parsed entries.
+#
+# Usage:
+#   ruby bench/memory.rb [USERS]    # default 200_000 users
+#
+$LOAD_PATH.unshift File.expand_path("../lib", __dir__)
+
+require "etcutils"
+require "objspace"
+require "tmpdir"
+
+require_relative "support/generator"
+
+USERS = Integer(ARGV.fetch(0, 200_000), 10)
+
+def rss_kb
+  File.read("/proc/self/status")[/^VmRSS:\s+(\d+)/, 1].to_i
+rescue Errno::ENOENT
+  0
+end
+
+def measure(root, intern)
+  reader, writer = IO.pipe
+  pid = fork do
+    reader.close
+    EtcUtils.intern_strings = intern
+    backend = EtcUtils::Backend::Linux.new(root: root)
+    GC.start
+    strings_before = ObjectSpace.count_objects[:T_STRING]
+    rss_before = rss_kb
+
+    users = backend.each_user.to_a
+    groups = backend.each_group.to_a
+    GC.start
+
+    string_bytes = 0
+    ObjectSpace.each_object(String) { |s| string_bytes += ObjectSpace.memsize_of(s) }
+    writer.write(Marshal.dump(
+      rss_kb: rss_kb - rss_before,
+      strings: ObjectSpace.count_objects[:T_STRING] - strings_before,
+      string_bytes: string_bytes,
+      entries: users.size + groups.size
+    ))
+    writer.close
+    exit!(0)
+  end
+  writer.close
+  result = Marshal.load(reader.read)
+  Process.wait(pid)
+  result
+end
+
+Dir.mktmpdir("etcutils-bench") do |root|
+  EtcUtilsBench::Generator.write(root, users: USERS)
+  puts format("%-10s %10s %12s %14s %10s", "interning", "entries", "RSS (KiB)", "T_STRING", "String MiB")
+  [false, true].each do |intern|
+    r = measure(root, intern)
+    puts format("%-10s %10d %12d %14d %10.1f",
+                intern ? "on" : "off", r[:entries], r[:rss_kb], r[:strings], r[:string_bytes] / 1_048_576.0)
+  end
+end
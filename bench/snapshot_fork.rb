@@ -0,0 +1,92 @@
+# frozen_string_literal: true
+
+# Per-worker memory of a preloaded database in a preforking server
+#
+# Generates a synthetic database, loads passwd and group in a master
+# process either as Ruby objects (Arrays of attribute Hashes) or as
+# EtcUtils.snapshot arenas, then forks WORKERS children. Each worker runs
+# a few full GCs and a batch of lookups, like a request loop would, and
+# reports how much its Private_Dirty memory grew: that is what copy-on-write
+# had to copy out of the master. A baseline with nothing preloaded shows
+# the cost of the interpreter itself. Snapshot lookups build their result
+# Hashes in the worker, so the snapshot row also includes the heap pages
+# holding that garbage.
+#
+# Usage:
+#   ruby bench/snapshot_fork.rb [USERS] [WORKERS]    # default 200_000 users, 32 workers
+#
+$LOAD_PATH.unshift File.expand_path("../lib", __dir__)
+
+require "etcutils"
+require "tmpdir"
+
+require_relative "support/generator"
+
+abort "bench/snapshot_fork.rb requires Linux and the C extension" unless EtcUtils::Snapshot.available?
+
+USERS = Integer(ARGV.fetch(0, 200_000), 10)
+WORKERS = Integer(ARGV.fetch(1, 32), 10)
+
+def private_dirty_kb
+  File.read("/proc/self/smaps_rollup").scan(/^Private_Dirty:\s+(\d+)/).flatten.sum(&:to_i)
+end
+
+def preload(backend, mode)
+  case mode
+  when :baseline then {}
+  when :objects
+    users = backend.each_user.to_a
+    { users: users.to_h { |u| [u[:name], u] }, groups: backend.each_group.to_a }
+  when :snapshot
+    { users: backend.snapshot(:passwd), groups: backend.snapshot(:group) }
+  end
+end
+
+def measure(root, mode)
+  reader, writer = IO.pipe
+  pid = fork do
+    reader.close
+    data = preload(EtcUtils::Backend::Linux.new(root: root), mode)
+    GC.start
+    master_kb = private_dirty_kb
+
+    workers = Array.new(WORKERS) do
+      r, w = IO.pipe
+      child = fork do
+        r.close
+        before = private_dirty_kb
+        3.times { GC.start }
+        10_000.times { |i| data[:users]&.[]("user#{(i * 7919) % USERS}") }
+        w.write((private_dirty_kb - before).to_s)
+        w.close
+        exit!(0)
+      end
+      w.close
+      [child, r]
+    end
+    growth = workers.map do |child, r|
+      kb = r.read.to_i
+      Process.wait(child)
+      kb
+    end
+
+    writer.write(Marshal.dump(master_kb: master_kb, growth: growth))
+    writer.close
+    exit!(0)
+  end
+  writer.close
+  result = Marshal.load(reader.read)
+  Process.wait(pid)
+  result
+end
+
+Dir.mktmpdir("etcutils-bench") do |root|
+  EtcUtilsBench::Generator.write(root, users: USERS)
+  puts "#{USERS} users, #{WORKERS} workers"
+  puts format("%-10s %14s %18s %18s", "preload", "master (KiB)", "worker avg (KiB)", "all workers (MiB)")
+  %i[baseline objects snapshot].each do |mode|
+    r = measure(root, mode)
+    puts format("%-10s %14d %18d %18.1f",
+                mode, r[:master_kb], r[:growth].sum / r[:growth].size, r[:growth].sum / 1024.0)
+  end
+end
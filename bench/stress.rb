@@ -0,0 +1,219 @@
+# frozen_string_literal: true
+
+# Lock contention and writer throughput stress test
+#
+# Forks several processes, each running several threads, that repeatedly
+# read-modify-write a temp-rooted database:
+#
+#   lock mode   with_lock { read_versioned; add one entry; write }
+#   cas mode    read_versioned; add one entry; write(expected_version:),
+#               retrying on ConcurrentModificationError
+#   none mode   the same cycle with no lock and no version check; loses
+#               updates by design and checks that the verifier notices
+#
+# Even iterations add a user to passwd, odd ones add a member to the
+# "stress" group. Lock waits are collected through EtcUtils::Instrumentation.
+# Afterwards the final files are checked: every added user and member must
+# appear exactly once (no lost updates) and both files must still parse and
+# validate (no corruption). The report is printed as JSON; the exit status
+# is 1 if any check failed.
+#
+# Usage:
+#   ruby bench/stress.rb [--processes 4] [--threads 4] [--iterations 50]
+#                        [--mode lock|cas|none] [--users 100] [--output FILE]
+#
+$LOAD_PATH.unshift File.expand_path("../lib", __dir__)
+
+require "etcutils"
+require "json"
+require "optparse"
+require "tmpdir"
+
+require_relative "support/generator"
+
+module EtcUtilsBench
+  module Stress
+    GROUP = "stress"
+
+    class << self
+      def run(argv)
+        options = { processes: 4, threads: 4, iterations: 50, mode: "lock", users: 100, output: nil }
+        OptionParser.new do |opts|
+          opts.on("--processes N", Integer) { |v| options[:processes] = v }
+          opts.on("--threads N", Integer) { |v| options[:threads] = v }
+          opts.on("--iterations N", Integer) { |v| options[:iterations] = v }
+          opts.on("--mode MODE", %w[lock cas none]) { |v| options[:mode] = v }
+          opts.on("--users N", Integer) { |v| options[:users] = v }
+          opts.on("--output FILE") { |v| options[:output] = v }
+        end.parse!(argv)
+
+        report = Dir.mktmpdir("etcutils-stress") { |root| stress(root, options) }
+        json = JSON.pretty_generate(report)
+        options[:output] ? File.write(options[:output], "#{json}\n") : puts(json)
+        report["ok"]
+      end
+
+      private
+
+      def stress(root, options)
+        Generator.write(root, users: options[:users])
+        File.open(File.join(root, "etc/group"), "a") { |f| f.write("#{GROUP}:x:#{Generator::FIRST_ID - 1}:\n") }
+        File.open(File.join(root, "etc/gshadow"), "a") { |f| f.write("#{GROUP}:!::\n") }
+
+        started = now
+        children = Array.new(options[:processes]) do |process|
+          reader, writer = IO.pipe
+          pid = fork do
+            reader.close
+            writer.write(JSON.generate(child(root, process, options)))
+            writer.close
+            exit!(0)
+          end
+          writer.close
+          [pid, reader]
+        end
+        stats = children.map do |pid, reader|
+          output = reader.read
+          reader.close
+          Process.wait(pid)
+          JSON.parse(output)
+        end
+        elapsed = now - started
+
+        summarize(root, options, stats, elapsed)
+      end
+
+      # Runs in a forked process: one backend shared by all threads
+      def child(root, process, options)
+        backend = EtcUtils::Backend::Linux.new(root: root)
+        waits = []
+        wait_lock = Mutex.new
+        EtcUtils::Instrumentation.subscribe(:lock_wait) do |event|
+          wait_lock.synchronize { waits << event.duration }
+        end
+
+        results = Array.new(options[:threads]) do |thread|
+          Thread.new do
+            stats = { "writes" => 0, "retries" => 0, "errors" => [] }
+            options[:iterations].times do |i|
+              cycle(backend, options[:mode], name(process, thread, i), i.even? ? :passwd : :group, stats)
+            rescue StandardError => e
+              stats["errors"] << "#{e.class}: #{e.message}"
+            end
+            stats
+          end
+        end.map(&:value)
+
+        {
+          "writes" => results.sum { |s| s["writes"] },
+          "retries" => results.sum { |s| s["retries"] },
+          "errors" => results.flat_map { |s| s["errors"] },
+          "lock_waits" => waits
+        }
+      end
+
+      def cycle(backend, mode, name, database, stats)
+        case mode
+        when "lock"
+          backend.with_lock { modify(backend, name, database) }
+        when "cas"
+          begin
+            modify(backend, name, database)
+          rescue EtcUtils::ConcurrentModificationError
+            stats["retries"] += 1
+            retry
+          end
+        else
+          modify(backend, name, database, check: false)
+        end
+        stats["writes"] += 1
+      end
+
+      def modify(backend, name, database, check: true)
+        entries, version = backend.read_versioned(database)
+        version = nil unless check
+        if database == :passwd
+          id = Generator::FIRST_ID * 10 + entries.size
+          entries << { name: name, passwd: "x", uid: id, gid: id, gecos: "", dir: "/home/#{name}", shell: "/bin/sh" }
+          backend.write_passwd(entries, backup: false, expected_version: version)
+        else
+          group = entries.find { |g| g[:name] == GROUP }
+          group[:members] += [name]
+          backend.write_group(entries, backup: false, expected_version: version)
+        end
+      end
+
+      def name(process, thread, iteration)
+        "s#{process}t#{thread}i#{iteration}"
+      end
+
+      def summarize(root, options, stats, elapsed)
+        backend = EtcUtils::Backend::Linux.new(root: root)
+        users, = backend.read_versioned(:passwd)
+        groups, = backend.read_versioned(:group)
+        problems = verify(options, users, groups)
+        problems.concat(EtcUtils::Validator.passwd(users, root: root).errors)
+        problems.concat(EtcUtils::Validator.group(groups).errors)
+        leftovers = Dir.children(File.join(root, "etc")) - %w[passwd group shadow gshadow .pwd.lock]
+        problems << "Leftover files: #{leftovers.join(", ")}" unless leftovers.empty?
+
+        waits = stats.flat_map { |s| s["lock_waits"] }.sort
+        writes = stats.sum { |s| s["writes"] }
+        errors = stats.flat_map { |s| s["errors"] }
+        {
+          "mode" => options[:mode],
+          "processes" => options[:processes],
+          "threads" => options[:threads],
+          "iterations" => options[:iterations],
+          "elapsed_s" => elapsed.round(3),
+          "writes" => writes,
+          "writes_per_s" => (writes / elapsed).round(1),
+          "retries" => stats.sum { |s| s["retries"] },
+          "lock_wait_p50_s" => percentile(waits, 0.50),
+          "lock_wait_p99_s" => percentile(waits, 0.99),
+          "lock_wait_max_s" => waits.last&.round(6),
+          "errors" => errors.uniq.first(10),
+          "problems" => problems.first(20),
+          "ok" => errors.empty? && problems.empty?
+        }
+      end
+
+      # Every name written must be present exactly once
+      def verify(options, users, groups)
+        expected_users = []
+        expected_members = []
+        options[:processes].times do |p|
+          options[:threads].times do |t|
+            options[:iterations].times do |i|
+              (i.even? ? expected_users : expected_members) << name(p, t, i)
+            end
+          end
+        end
+
+        problems = []
+        user_counts = users.map { |u| u[:name] }.tally
+        members = groups.find { |g| g[:name] == GROUP }&.fetch(:members) || []
+        member_counts = members.tally
+        lost_users = expected_users.reject { |n| user_counts[n] }
+        lost_members = expected_members.reject { |n| member_counts[n] }
+        problems << "Lost #{lost_users.size} passwd updates (e.g. #{lost_users.first})" unless lost_users.empty?
+        problems << "Lost #{lost_members.size} group updates (e.g. #{lost_members.first})" unless lost_members.empty?
+        dups = user_counts.select { |_, c| c > 1 }.keys + member_counts.select { |_, c| c > 1 }.keys
+        problems << "Duplicated entries: #{dups.first(5).join(", ")}" unless dups.empty?
+        problems
+      end
+
+      def percentile(sorted, fraction)
+        return nil if sorted.empty?
+
+        sorted[[(sorted.size * fraction).ceil - 1, 0].max].round(6)
+      end
+
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+    end
+  end
+end
+
+exit(EtcUtilsBench::Stress.run(ARGV) ? 0 : 1) if $PROGRAM_NAME == __FILE__
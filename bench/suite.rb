@@ -0,0 +1,164 @@
+# frozen_string_literal: true
+
+# Benchmark suite for the v1 C API and the v2 Ruby API
+#
+# Generates synthetic databases at each size, then measures every workload
+# in a fresh process per API and prints the results as JSON. The v1 worker
+# runs with the compiled extension; the v2 worker runs against a copy of
+# lib/ without it, so EtcUtils::User and friends are the v2 Structs.
+#
+# v1 enumeration and writes use fgetpwent/putpwent on the synthetic files.
+# v1 name and ID lookups go through NSS and cannot be pointed at a
+# synthetic root, so they are reported as skipped; next_uid is measured
+# against the live NSS database. v2 has no next_uid.
+#
+# Usage:
+#   ruby bench/suite.rb [--sizes 1000,100000,1000000] [--output FILE] [--budget SECONDS]
+#
+require "fileutils"
+require "json"
+require "optparse"
+require "rbconfig"
+require "time"
+require "tmpdir"
+
+require_relative "support/generator"
+require_relative "support/harness"
+
+module EtcUtilsBench
+  LIB = File.expand_path("../lib", __dir__)
+  DEFAULT_SIZES = [1_000, 100_000, 1_000_000].freeze
+  # Entries used by per-entry workloads (parse, to_entry)
+  SAMPLE = 10_000
+  # putpwent(3) rescans the file for duplicates on every call
+  V1_WRITE_SAMPLE = 1_000
+
+  module Suite
+    class << self
+      def run(argv)
+        options = { sizes: DEFAULT_SIZES, output: nil, budget: 1.0 }
+        OptionParser.new do |opts|
+          opts.on("--sizes LIST", Array) { |v| options[:sizes] = v.map { |s| Integer(s.delete("_"), 10) } }
+          opts.on("--output FILE") { |v| options[:output] = v }
+          opts.on("--budget SECONDS", Float) { |v| options[:budget] = v }
+        end.parse!(argv)
+
+        report = {
+          "generated_at" => Time.now.utc.iso8601,
+          "ruby" => RUBY_DESCRIPTION,
+          "git_revision" => git_revision,
+          "results" => collect(options[:sizes], options[:budget])
+        }
+        json = JSON.pretty_generate(report)
+        options[:output] ? File.write(options[:output], "#{json}\n") : puts(json)
+      end
+
+      private
+
+      def collect(sizes, budget)
+        results = []
+        Dir.mktmpdir("etcutils-bench") do |tmp|
+          pure_lib = File.join(tmp, "lib")
+          FileUtils.cp_r(LIB, pure_lib)
+          Dir.glob(File.join(pure_lib, "**", "*.{so,bundle,dll}")).each { |f| File.delete(f) }
+          extension = !Dir.glob(File.join(LIB, "etcutils", "etcutils.{so,bundle}")).empty?
+
+          sizes.each do |size|
+            root = File.join(tmp, "root-#{size}")
+            Dir.mkdir(root)
+            Generator.write(root, users: size)
+            results.concat(worker("v1", LIB, root, size, budget)) if extension
+            results.concat(worker("v2", pure_lib, root, size, budget))
+          end
+        end
+        results
+      end
+
+      def worker(api, lib, root, size, budget)
+        warn "bench: #{api} #{size} users"
+        output = IO.popen([RbConfig.ruby, "-I", lib, __FILE__, "--worker", api, root, size.to_s, budget.to_s], &:read)
+        raise "#{api} worker failed for #{size} users" unless $?.success?
+
+        JSON.parse(output)
+      end
+
+      def git_revision
+        rev = IO.popen(%w[git rev-parse HEAD], chdir: __dir__, err: File::NULL, &:read).strip
+        rev.empty? ? nil : rev
+      rescue SystemCallError
+        nil
+      end
+    end
+  end
+
+  # Workloads run inside a worker process
+  module Workloads
+    class << self
+      def run(api, root, size, budget)
+        require "etcutils"
+        harness = Harness.new(api: api, size: size, budget: budget)
+        api == "v1" ? v1(harness, root, size) : v2(harness, root, size)
+        puts JSON.generate(harness.results)
+      end
+
+      private
+
+      def v1(harness, root, size)
+        passwd = File.join(root, "etc/passwd")
+        lines = File.foreach(passwd).first(SAMPLE).map(&:chomp)
+        entries = lines.map { |line| EtcUtils.sgetpwent(line) }
+
+        harness.measure("each_user", entries: size) do
+          File.open(passwd) { |io| nil while EtcUtils.fgetpwent(io) }
+        end
+        harness.measure("sgetpwent", entries: lines.size) { lines.each { |line| EtcUtils.sgetpwent(line) } }
+        harness.measure("to_entry", entries: entries.size) { entries.each(&:to_entry) }
+        harness.measure("next_uid", database: "nss") { EtcUtils.next_uid(1000) }
+
+        sample = entries.first(V1_WRITE_SAMPLE)
+        out = File.join(root, "v1-passwd.out")
+        harness.measure("write_passwd", entries: sample.size) do
+          File.open(out, "w+") { |io| sample.each { |entry| EtcUtils.putpwent(entry, io) } }
+        end
+
+        reason = "v1 lookups use NSS and cannot read a synthetic root"
+        %w[find_user.name find_user.uid count].each { |name| harness.skip(name, reason) }
+      end
+
+      def v2(harness, root, size)
+        backend = EtcUtils::Backend::Linux.new(root: root)
+        users = EtcUtils::UserCollection.new(backend)
+        last = backend.user_slice(-1, 1).first
+        lines = File.foreach(backend.passwd_path).first(SAMPLE).map(&:chomp)
+        structs = lines.map { |line| EtcUtils::User.parse(line) }
+
+        harness.measure("each_user", entries: size) { users.each { |_user| nil } }
+        harness.measure("find_user.name") { users.get(last[:name]) }
+        harness.measure("find_user.uid") { users.get(last[:uid]) }
+        harness.measure("find_user.missing") { users.get("no-such-user") }
+        harness.measure("count", entries: size) { users.count }
+        harness.measure("sgetpwent", entries: lines.size) { lines.each { |line| EtcUtils::User.parse(line) } }
+        harness.measure("to_entry", entries: structs.size) { structs.each(&:to_entry) }
+        harness.skip("next_uid", "v2 has no next_uid")
+
+        %i[passwd group shadow gshadow].each do |db|
+          all, = backend.read_versioned(db)
+          writer = :"write_#{db}"
+          harness.measure("#{writer}.dry_run", entries: all.size, warmup: false) do
+            backend.public_send(writer, all, backup: false, dry_run: true)
+          end
+          harness.measure(writer.to_s, entries: all.size, warmup: false) do
+            backend.public_send(writer, all, backup: false)
+          end
+        end
+      end
+    end
+  end
+end
+
+if ARGV.first == "--worker"
+  _, api, root, size, budget = ARGV
+  EtcUtilsBench::Workloads.run(api, root, Integer(size, 10), Float(budget))
+else
+  EtcUtilsBench::Suite.run(ARGV)
+end
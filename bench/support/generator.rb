@@ -0,0 +1,105 @@
+# frozen_string_literal: true
+
+module EtcUtilsBench
+  # Generator writes synthetic passwd, group, shadow and gshadow files
+  #
+  # Users are named user0...userN-1 with UIDs from FIRST_ID. Group sizes
+  # follow a power law, so a few groups hold a large share of all users
+  # (like "staff" or "users") while most have a handful of members.
+  # Output is deterministic for a given size and seed.
+  #
+  # @example
+  #   EtcUtilsBench::Generator.write(root, users: 100_000)
+  #   # => root/etc/{passwd,group,shadow,gshadow}
+  #
+  module Generator
+    FIRST_ID = 10_000
+    SHELLS = %w[/bin/bash /bin/sh /usr/sbin/nologin /bin/zsh /bin/false].freeze
+    SHADOW_HASH = "$6$benchsalt$#{"x" * 86}"
+
+    class << self
+      # Write all four databases under root/etc
+      #
+      # @param root [String] directory to create etc/ in
+      # @param users [Integer] number of users
+      # @param seed [Integer] random seed for group membership
+      # @return [Hash{Symbol => Integer}] number of entries per database
+      def write(root, users:, seed: 42)
+        etc = File.join(root, "etc")
+        Dir.mkdir(etc) unless Dir.exist?(etc)
+        groups = group_sizes(users)
+        random = Random.new(seed)
+
+        write_file(File.join(etc, "passwd")) do |out|
+          users.times do |i|
+            out << "user#{i}:x:#{FIRST_ID + i}:#{FIRST_ID + (i % groups.size)}:User #{i}:/home/user#{i}:#{SHELLS[i % SHELLS.size]}\n"
+          end
+        end
+        write_file(File.join(etc, "shadow")) do |out|
+          users.times { |i| out << "user#{i}:#{i.even? ? SHADOW_HASH : "!"}:19000:0:99999:7:::\n" }
+        end
+
+        members = groups.map { |size| member_list(size, users, random) }
+        write_file(File.join(etc, "group")) do |out|
+          members.each_with_index { |list, g| out << "group#{g}:x:#{FIRST_ID + g}:#{list}\n" }
+        end
+        write_file(File.join(etc, "gshadow")) do |out|
+          members.each_with_index { |list, g| out << "group#{g}:!::#{list}\n" }
+        end
+
+        { passwd: users, shadow: users, group: groups.size, gshadow: groups.size }
+      end
+
+      # Member counts of each group: group g has about users / (g + 1)**1.5
+      # members, so the largest group contains every user and the sizes fall
+      # off quickly after the first few groups
+      #
+      # @param users [Integer] number of users
+      # @return [Array<Integer>]
+      def group_sizes(users)
+        count = [users / 50, 10].max
+        Array.new(count) { |g| [users / (g + 1)**1.5, 0].max.to_i }
+      end
+
+      private
+
+      # A contiguous run of users starting at a random offset, which keeps
+      # generation linear even for groups with every user as a member
+      def member_list(size, users, random)
+        return "" if size.zero? || users.zero?
+
+        start = random.rand(users)
+        Array.new(size) { |j| "user#{(start + j) % users}" }.join(",")
+      end
+
+      def write_file(path)
+        File.open(path, "w") do |io|
+          writer = Writer.new(io)
+          yield writer
+          writer.flush
+        end
+      end
+    end
+
+    # Buffers lines and writes them to the file in large chunks
+    class Writer
+      CHUNK = 1 << 20
+
+      def initialize(io)
+        @io = io
+        @buffer = +""
+      end
+
+      def <<(line)
+        @buffer << line
+        flush if @buffer.bytesize >= CHUNK
+        self
+      end
+
+      def flush
+        @io.write(@buffer)
+        @buffer.clear
+      end
+    end
+  end
+end
@@ -0,0 +1,86 @@
+# frozen_string_literal: true
+
+module EtcUtilsBench
+  # Harness times workloads and collects machine-readable results
+  #
+  # Each workload runs once to warm up, then repeatedly until its time
+  # budget or iteration cap is reached (at least once). Results record the
+  # median and fastest run, so a single slow GC pause does not skew them.
+  #
+  # @example
+  #   harness = EtcUtilsBench::Harness.new(api: "v2", size: 1000)
+  #   harness.measure("count") { users.count }
+  #   harness.results  # => [{ "api" => "v2", "size" => 1000, "name" => "count", ... }]
+  #
+  class Harness
+    # @return [Array<Hash>] one result per measured workload
+    attr_reader :results
+
+    # @param api [String] API under test ("v1" or "v2")
+    # @param size [Integer] number of users in the synthetic database
+    # @param budget [Float] seconds spent repeating each workload
+    # @param max_iterations [Integer] iteration cap per workload
+    def initialize(api:, size:, budget: 1.0, max_iterations: 100)
+      @api = api
+      @size = size
+      @budget = budget
+      @max_iterations = max_iterations
+      @results = []
+    end
+
+    # Time a workload
+    #
+    # @param name [String] workload name
+    # @param entries [Integer] entries processed per iteration, for rates
+    # @param warmup [Boolean] run once untimed first; off for slow workloads
+    # @param meta [Hash] extra fields stored with the result
+    # @yield the workload
+    # @return [Hash] the recorded result
+    def measure(name, entries: 1, warmup: true, **meta, &block)
+      block.call if warmup
+      times = []
+      deadline = now + @budget
+      loop do
+        start = now
+        block.call
+        times << now - start
+        break if times.size >= @max_iterations || now >= deadline
+      end
+      record(name, entries, times.sort, meta)
+    end
+
+    # Record a workload that cannot run in this configuration
+    #
+    # @param name [String] workload name
+    # @param reason [String] why it was skipped
+    # @return [Hash] the recorded result
+    def skip(name, reason)
+      result = base(name).merge("skipped" => reason)
+      @results << result
+      result
+    end
+
+    private
+
+    def record(name, entries, times, meta)
+      median = times[times.size / 2]
+      result = base(name).merge(meta.transform_keys(&:to_s)).merge(
+        "iterations" => times.size,
+        "entries" => entries,
+        "median_s" => median.round(9),
+        "min_s" => times.first.round(9),
+        "entries_per_s" => median.positive? ? (entries / median).round(1) : nil
+      )
+      @results << result
+      result
+    end
+
+    def base(name)
+      { "api" => @api, "size" => @size, "name" => name }
+    end
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
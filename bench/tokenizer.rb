@@ -0,0 +1,80 @@
+# frozen_string_literal: true
+
+# Microbenchmark for the delimiter scanning kernels
+#
+# Times EtcUtils::Native.split with every kernel this CPU supports
+# (avx2, sse2, scalar) against String#split on the inputs the kernels are
+# meant for: passwd lines with a long GECOS field, group lines with huge
+# member lists, and a generated passwd file scanned by count_entries.
+# Prints one JSON result per kernel and input.
+#
+# Usage:
+#   ruby bench/tokenizer.rb [BUDGET]    # seconds per workload, default 0.5
+#
+$LOAD_PATH.unshift File.expand_path("../lib", __dir__)
+
+require "etcutils"
+require "json"
+require "tmpdir"
+
+require_relative "support/generator"
+require_relative "support/harness"
+
+abort "bench/tokenizer.rb requires the C extension" unless defined?(EtcUtils::Native)
+
+BUDGET = Float(ARGV.fetch(0, 0.5))
+# Short inputs are repeated so each timed run covers about this many bytes
+RUN_BYTES = 100_000
+
+INPUTS = {
+  "gecos_4k" => ["alice:x:1000:1000:#{"Alice Example,Room 101," * 180}:/home/alice:/bin/bash", ":"],
+  "members_10k" => [Array.new(10_000) { |i| "member#{i}" }.join(","), ","],
+  "members_100k" => [Array.new(100_000) { |i| "m#{i}" }.join(","), ","],
+  "passwd_line" => ["root:x:0:0:root:/root:/bin/bash", ":"]
+}.freeze
+
+native = EtcUtils::Native
+original = native.tokenizer_kernel
+results = []
+
+Dir.mktmpdir("etcutils-tokenizer") do |root|
+  EtcUtilsBench::Generator.write(root, users: 100_000)
+  passwd = File.join(root, "etc/passwd")
+
+  (native.tokenizer_kernels.map(&:to_s) + ["string_split"]).each do |kernel|
+    native.tokenizer_kernel = kernel if kernel != "string_split"
+    harness = EtcUtilsBench::Harness.new(api: kernel, size: 0, budget: BUDGET, max_iterations: 1000)
+
+    INPUTS.each do |name, (input, delim)|
+      fields = input.count(delim) + 1
+      repeat = [RUN_BYTES / input.bytesize, 1].max
+      if kernel == "string_split"
+        harness.measure(name, entries: fields * repeat, bytes: input.bytesize) do
+          repeat.times { input.split(delim) }
+        end
+      else
+        harness.measure(name, entries: fields * repeat, bytes: input.bytesize) do
+          repeat.times { native.split(input, delim) }
+        end
+      end
+    end
+
+    if kernel == "string_split"
+      harness.skip("count_entries", "String#split has no file scan")
+    else
+      harness.measure("count_entries", entries: 100_000, bytes: File.size(passwd)) do
+        native.count_entries(passwd)
+      end
+    end
+
+    results.concat(harness.results)
+  end
+ensure
+  native.tokenizer_kernel = original
+end
+
+puts JSON.pretty_generate(
+  "ruby" => RUBY_DESCRIPTION,
+  "default_kernel" => original.to_s,
+  "results" => results
+)
@@ -0,0 +1,746 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "etcutils.h"
+#include "ruby/encoding.h"
+
+/*
+ * EtcUtils::Native::Arena - a database file packed into one read-only
+ * mapping, for snapshots that are loaded before fork and shared by
+ * every worker.
+ *
+ * A cache made of Ruby objects does not stay shared after fork: each
+ * GC marks every live object, and the pages holding them are copied
+ * into each process as soon as they are touched. An Arena keeps its
+ * entries outside the Ruby heap instead. The entry lines, the offset
+ * of each field and two sorted indexes (by name and by numeric id)
+ * are laid out in a single anonymous mapping, which is made read-only
+ * once built. The Ruby object is a small TypedData wrapper with
+ * nothing to mark, so neither GC nor lookups write to those pages and
+ * they stay copy-on-write shared. Hashes are only built for the entries
+ * a caller asks for.
+ *
+ * Mapping layout (offsets are 32-bit, so the file must fit in 4 GiB):
+ *
+ *   text     entry lines, each ending in '\n'
+ *   fields   per record, nfields + 1 offsets into text; field i spans
+ *            fields[i] .. fields[i + 1] - 1
+ *   by_name  record numbers ordered by name, then record number
+ *   by_id    (id, record) pairs ordered by id, then record number
+ */
+
+/* Field kinds, matching the Ruby parsers in Backend::Linux */
+#define EU_A_STR  0		/* String */
+#define EU_A_OPT  1		/* String, nil if empty */
+#define EU_A_INT  2		/* Integer, String#to_i semantics */
+#define EU_A_NUM  3		/* Integer, nil if empty or not a number */
+#define EU_A_LIST 4		/* Array of Strings split on ',' */
+
+#define EU_A_MAXFIELDS 9
+
+struct eu_arena_layout {
+  const char *type;
+  int nfields;
+  int id_field;			/* -1 if the database has no numeric id */
+  const char *fields[EU_A_MAXFIELDS];
+  const char kinds[EU_A_MAXFIELDS];
+  VALUE syms[EU_A_MAXFIELDS];
+};
+
+static struct eu_arena_layout eu_arena_layouts[] = {
+  { "passwd", 7, 2,
+    { "name", "passwd", "uid", "gid", "gecos", "dir", "shell" },
+    { EU_A_STR, EU_A_STR, EU_A_INT, EU_A_INT, EU_A_STR, EU_A_STR, EU_A_STR } },
+  { "group", 4, 2,
+    { "name", "passwd", "gid", "members" },
+    { EU_A_STR, EU_A_STR, EU_A_INT, EU_A_LIST } },
+  { "shadow", 9, -1,
+    { "name", "passwd", "last_change", "min_days", "max_days",
+      "warn_days", "inactive_days", "expire_date", "reserved" },
+    { EU_A_STR, EU_A_STR, EU_A_NUM, EU_A_NUM, EU_A_NUM,
+      EU_A_NUM, EU_A_NUM, EU_A_NUM, EU_A_OPT } },
+  { "gshadow", 4, -1,
+    { "name", "passwd", "admins", "members" },
+    { EU_A_STR, EU_A_STR, EU_A_LIST, EU_A_LIST } },
+  { "subid", 3, -1,
+    { "name", "start", "count" },
+    { EU_A_STR, EU_A_NUM, EU_A_NUM } },
+};
+
+#define EU_A_NLAYOUTS (int)(sizeof(eu_arena_layouts) / sizeof(eu_arena_layouts[0]))
+#define EU_A_LINE_BATCH 256
+
+struct eu_arena {
+  char *base;			/* the mapping; NULL until loaded */
+  size_t size;
+  const char *text;
+  const uint32_t *fields;
+  const uint32_t *by_name;
+  const uint32_t *by_id;
+  uint32_t count;
+  uint32_t nids;
+  const struct eu_arena_layout *layout;
+};
+
+static VALUE cArena;
+
+static void arena_free(void *ptr)
+{
+  struct eu_arena *a = ptr;
+
+  if (a->base)
+    munmap(a->base, a->size);
+  xfree(a);
+}
+
+static size_t arena_memsize(const void *ptr)
+{
+  const struct eu_arena *a = ptr;
+
+  return sizeof(*a) + a->size;
+}
+
+static const rb_data_type_t arena_type = {
+  "EtcUtils::Native::Arena",
+  { NULL, arena_free, arena_memsize, },
+  0, 0,
+#ifdef RUBY_TYPED_FROZEN_SHAREABLE
+  RUBY_TYPED_FREE_IMMEDIATELY | RUBY_TYPED_FROZEN_SHAREABLE
+#else
+  RUBY_TYPED_FREE_IMMEDIATELY
+#endif
+};
+
+static struct eu_arena *get_arena(VALUE self)
+{
+  struct eu_arena *a;
+
+  TypedData_Get_Struct(self, struct eu_arena, &arena_type, a);
+  if (!a->base)
+    rb_raise(rb_eRuntimeError, "arena is not loaded");
+  return a;
+}
+
+/*
+ * Building
+ */
+
+struct eu_arena_build {
+  char *path;
+  struct eu_arena *arena;
+  int err;
+};
+
+struct eu_name_key {
+  const char *name;
+  uint32_t len;
+  uint32_t rec;
+};
+
+struct eu_id_key {
+  uint32_t id;
+  uint32_t rec;
+};
+
+static int cmp_name_key(const void *x, const void *y)
+{
+  const struct eu_name_key *a = x, *b = y;
+  uint32_t n = a->len < b->len ? a->len : b->len;
+  int c = memcmp(a->name, b->name, n);
+
+  if (c)
+    return c;
+  if (a->len != b->len)
+    return a->len < b->len ? -1 : 1;
+  return a->rec < b->rec ? -1 : a->rec > b->rec;
+}
+
+static int cmp_id_key(const void *x, const void *y)
+{
+  const struct eu_id_key *a = x, *b = y;
+
+  if (a->id != b->id)
+    return a->id < b->id ? -1 : 1;
+  return a->rec < b->rec ? -1 : a->rec > b->rec;
+}
+
+/* Read a whole file into a malloc'd buffer */
+static int eu_slurp(const char *path, char **out, size_t *out_len)
+{
+  struct stat st;
+  size_t cap, used = 0;
+  ssize_t n;
+  char *buf, *tmp;
+  int fd, err = 0;
+
+  if ( (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 )
+    return errno;
+  if (fstat(fd, &st) < 0) {
+    err = errno;
+    close(fd);
+    return err;
+  }
+
+  cap = (size_t)st.st_size + 1;
+  if ( (buf = malloc(cap)) == NULL ) {
+    close(fd);
+    return ENOMEM;
+  }
+
+  for (;;) {
+    if (used == cap) {
+      /* The file grew while we read it */
+      if ( (tmp = realloc(buf, cap * 2)) == NULL ) {
+	err = ENOMEM;
+	break;
+      }
+      buf = tmp;
+      cap *= 2;
+    }
+    n = read(fd, buf + used, cap - used);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      err = errno;
+      break;
+    }
+    if (n == 0)
+      break;
+    used += (size_t)n;
+  }
+
+  close(fd);
+  if (err) {
+    free(buf);
+    return err;
+  }
+  *out = buf;
+  *out_len = used;
+  return 0;
+}
+
+/* Number of ':' separators in a line, stopping once enough are seen */
+static int eu_colons(const char *line, size_t len, int want)
+{
+  const char *p = line, *end = line + len, *c;
+  int n = 0;
+
+  while (n < want && (c = memchr(p, ':', (size_t)(end - p))) != NULL) {
+    n++;
+    p = c + 1;
+  }
+  return n;
+}
+
+/* Call fn for each entry line that has every field of the layout */
+typedef void (*eu_arena_line_fn)(const char *line, size_t len, void *arg);
+
+static void eu_arena_lines(const char *buf, size_t len, int nfields,
+			   eu_arena_line_fn fn, void *arg)
+{
+  const char *start = buf, *end = buf + len, *base;
+  long nls[EU_A_LINE_BATCH], count, i;
+
+  do {
+    count = eu_scan_delims(start, (long)(end - start), '\n', nls, EU_A_LINE_BATCH);
+    base = start;
+    for (i = 0; i < count; i++) {
+      const char *nl = base + nls[i];
+      size_t n = (size_t)(nl - start);
+
+      if ( eu_entry_line_p(start, n) && eu_colons(start, n, nfields - 1) == nfields - 1 )
+	fn(start, n, arg);
+      start = nl + 1;
+    }
+  } while (count == EU_A_LINE_BATCH);
+
+  /* Final line without a trailing newline */
+  if (start < end) {
+    size_t n = (size_t)(end - start);
+
+    if ( eu_entry_line_p(start, n) && eu_colons(start, n, nfields - 1) == nfields - 1 )
+      fn(start, n, arg);
+  }
+}
+
+struct eu_measure {
+  size_t records;
+  size_t text;
+};
+
+static void measure_line(const char *line, size_t len, void *arg)
+{
+  struct eu_measure *m = arg;
+
+  m->records++;
+  m->text += len + 1;
+}
+
+struct eu_fill {
+  struct eu_arena *arena;
+  char *text;
+  uint32_t *fields;
+  struct eu_name_key *names;
+  struct eu_id_key *ids;
+  size_t pos;
+  uint32_t rec;
+  uint32_t nids;
+};
+
+static void fill_line(const char *line, size_t len, void *arg)
+{
+  struct eu_fill *f = arg;
+  const struct eu_arena_layout *layout = f->arena->layout;
+  uint32_t *off = f->fields + (size_t)f->rec * (size_t)(layout->nfields + 1);
+  char *dst = f->text + f->pos, *p = dst, *end = dst + len, *c;
+  int i;
+
+  memcpy(dst, line, len);
+  dst[len] = '\n';
+
+  for (i = 0; i < layout->nfields; i++) {
+    off[i] = (uint32_t)(f->pos + (size_t)(p - dst));
+    c = i + 1 < layout->nfields ? memchr(p, ':', (size_t)(end - p)) : NULL;
+    if (c)
+      p = c + 1;
+  }
+  /* Like split(":") in the Ruby parsers, anything past the layout is dropped */
+  c = memchr(p, ':', (size_t)(end - p));
+  off[layout->nfields] = (uint32_t)(f->pos + (size_t)((c ? c : end) - dst) + 1);
+
+  f->names[f->rec].name = dst;
+  f->names[f->rec].len = off[1] - off[0] - 1;
+  f->names[f->rec].rec = f->rec;
+
+  if (layout->id_field >= 0) {
+    const char *id = f->text + off[layout->id_field];
+    uint32_t idlen = off[layout->id_field + 1] - off[layout->id_field] - 1, k;
+    uint64_t v = 0;
+
+    for (k = 0; k < idlen && id[k] >= '0' && id[k] <= '9' && v <= UINT32_MAX; k++)
+      v = v * 10 + (uint64_t)(id[k] - '0');
+    if (idlen && k == idlen && v <= UINT32_MAX) {
+      f->ids[f->nids].id = (uint32_t)v;
+      f->ids[f->nids].rec = f->rec;
+      f->nids++;
+    }
+  }
+
+  f->pos += len + 1;
+  f->rec++;
+}
+
+#define EU_ALIGN8(n) (((n) + 7) & ~(size_t)7)
+
+static int eu_arena_build(const char *path, struct eu_arena *a)
+{
+  const struct eu_arena_layout *layout = a->layout;
+  struct eu_measure m = { 0, 0 };
+  struct eu_fill f;
+  char *buf = NULL, *base;
+  size_t len = 0, nf = (size_t)layout->nfields + 1;
+  size_t text_size, fields_size, names_size, size, i;
+  long page = sysconf(_SC_PAGESIZE);
+  int err;
+
+  if ( (err = eu_slurp(path, &buf, &len)) )
+    return err;
+
+  eu_arena_lines(buf, len, layout->nfields, measure_line, &m);
+  if (m.text >= UINT32_MAX || m.records >= UINT32_MAX / nf) {
+    free(buf);
+    return EFBIG;
+  }
+
+  text_size = EU_ALIGN8(m.text);
+  fields_size = EU_ALIGN8(m.records * nf * sizeof(uint32_t));
+  names_size = EU_ALIGN8(m.records * sizeof(uint32_t));
+  size = text_size + fields_size + names_size;
+  if (layout->id_field >= 0)
+    size += m.records * 2 * sizeof(uint32_t);
+  /* An empty database still gets a page, so base is never NULL */
+  size = (size + (size_t)page - 1) / (size_t)page * (size_t)page;
+  if (size == 0)
+    size = (size_t)page;
+
+  base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    err = errno;
+    free(buf);
+    return err;
+  }
+
+  memset(&f, 0, sizeof f);
+  f.arena = a;
+  f.text = base;
+  f.fields = (uint32_t *)(base + text_size);
+  f.names = malloc((m.records ? m.records : 1) * sizeof(*f.names));
+  f.ids = malloc((m.records ? m.records : 1) * sizeof(*f.ids));
+  if (!f.names || !f.ids) {
+    free(f.names);
+    free(f.ids);
+    free(buf);
+    munmap(base, size);
+    return ENOMEM;
+  }
+
+  eu_arena_lines(buf, len, layout->nfields, fill_line, &f);
+
+  qsort(f.names, m.records, sizeof(*f.names), cmp_name_key);
+  a->by_name = (uint32_t *)(base + text_size + fields_size);
+  for (i = 0; i < m.records; i++)
+    ((uint32_t *)a->by_name)[i] = f.names[i].rec;
+
+  a->by_id = NULL;
+  if (layout->id_field >= 0) {
+    qsort(f.ids, f.nids, sizeof(*f.ids), cmp_id_key);
+    a->by_id = (uint32_t *)(base + text_size + fields_size + names_size);
+    for (i = 0; i < f.nids; i++) {
+      ((uint32_t *)a->by_id)[2 * i] = f.ids[i].id;
+      ((uint32_t *)a->by_id)[2 * i + 1] = f.ids[i].rec;
+    }
+  }
+
+  free(f.names);
+  free(f.ids);
+  free(buf);
+
+  /* From here on nothing writes the pages, so forks keep sharing them */
+  if (mprotect(base, size, PROT_READ) < 0) {
+    err = errno;
+    munmap(base, size);
+    return err;
+  }
+
+  a->base = base;
+  a->size = size;
+  a->text = base;
+  a->fields = f.fields;
+  a->count = (uint32_t)m.records;
+  a->nids = f.nids;
+  return 0;
+}
+
+static void *eu_arena_build_nogvl(void *data)
+{
+  struct eu_arena_build *b = data;
+
+  b->err = eu_arena_build(b->path, b->arena);
+  return NULL;
+}
+
+static const struct eu_arena_layout *eu_find_arena_layout(VALUE type)
+{
+  const char *name;
+  int i;
+
+  if (SYMBOL_P(type))
+    type = rb_sym2str(type);
+  name = StringValueCStr(type);
+
+  for (i = 0; i < EU_A_NLAYOUTS; i++)
+    if ( strcmp(eu_arena_layouts[i].type, name) == 0 )
+      return &eu_arena_layouts[i];
+
+  rb_raise(rb_eArgError, "unknown database type: %s", name);
+  return NULL;
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native::Arena.load(path, type) -> arena
+ *
+ * Pack the entries of a +type+ database file (:passwd, :group, :shadow,
+ * :gshadow or :subid) into a new read-only arena. Blank lines, comments
+ * and lines with too few fields are left out. The file is read and
+ * indexed without the GVL. The returned arena is frozen.
+ */
+static VALUE
+arena_s_load(VALUE klass, VALUE path, VALUE type)
+{
+  struct eu_arena_build build;
+  struct eu_arena *a;
+  const char *cpath;
+  size_t len;
+  VALUE obj;
+
+  FilePathValue(path);
+  obj = TypedData_Make_Struct(klass, struct eu_arena, &arena_type, a);
+  a->layout = eu_find_arena_layout(type);
+
+  cpath = StringValueCStr(path);
+  len = strlen(cpath);
+  build.path = ALLOC_N(char, len + 1);
+  memcpy(build.path, cpath, len + 1);
+  build.arena = a;
+  build.err = 0;
+
+  eu_without_gvl(eu_arena_build_nogvl, &build);
+  xfree(build.path);
+
+  if (build.err) {
+    errno = build.err;
+    rb_sys_fail_str(path);
+  }
+
+  return rb_obj_freeze(obj);
+}
+
+/*
+ * Entries
+ */
+
+static VALUE eu_arena_int(const char *p, uint32_t len, int strict)
+{
+  uint32_t i = 0;
+  long v = 0;
+  int neg = 0;
+
+  if (len && (p[0] == '-' || p[0] == '+')) {
+    neg = p[0] == '-';
+    i = 1;
+  }
+
+  if (i == len || p[i] < '0' || p[i] > '9')
+    return strict ? Qnil : INT2FIX(0);
+
+  /* Long or unusual numbers go through Ruby's own conversion */
+  if (len > 18)
+    return rb_str_to_inum(rb_str_new(p, (long)len), 10, 0);
+
+  for (; i < len && p[i] >= '0' && p[i] <= '9'; i++)
+    v = v * 10 + (p[i] - '0');
+  if (strict && i != len)
+    return Qnil;
+
+  return LONG2NUM(neg ? -v : v);
+}
+
+static VALUE eu_arena_value(int kind, const char *p, uint32_t len)
+{
+  switch (kind) {
+  case EU_A_OPT:
+    return len ? rb_utf8_str_new(p, (long)len) : Qnil;
+  case EU_A_INT:
+    return eu_arena_int(p, len, 0);
+  case EU_A_NUM:
+    return eu_arena_int(p, len, 1);
+  case EU_A_LIST:
+    return len ? eu_split(rb_utf8_str_new(p, (long)len), ',') : rb_ary_new();
+  default:
+    return rb_utf8_str_new(p, (long)len);
+  }
+}
+
+/* Field offsets of a record */
+static const uint32_t *eu_arena_offsets(const struct eu_arena *a, uint32_t rec)
+{
+  return a->fields + (size_t)rec * (size_t)(a->layout->nfields + 1);
+}
+
+static VALUE eu_arena_entry(const struct eu_arena *a, uint32_t rec)
+{
+  const struct eu_arena_layout *layout = a->layout;
+  const uint32_t *off = eu_arena_offsets(a, rec);
+  VALUE hash = rb_hash_new();
+  int i;
+
+  for (i = 0; i < layout->nfields; i++)
+    rb_hash_aset(hash, layout->syms[i],
+		 eu_arena_value(layout->kinds[i], a->text + off[i], off[i + 1] - off[i] - 1));
+  return hash;
+}
+
+/*
+ * call-seq:
+ *    arena.size -> Integer
+ *
+ * Number of entries.
+ */
+static VALUE
+arena_size(VALUE self)
+{
+  return ULONG2NUM(get_arena(self)->count);
+}
+
+/*
+ * call-seq:
+ *    arena.bytesize -> Integer
+ *
+ * Size of the mapping holding the entries and their indexes.
+ */
+static VALUE
+arena_bytesize(VALUE self)
+{
+  return SIZET2NUM(get_arena(self)->size);
+}
+
+/*
+ * call-seq:
+ *    arena.address -> Integer
+ *
+ * Start address of the mapping, for finding it in /proc/self/smaps.
+ */
+static VALUE
+arena_address(VALUE self)
+{
+  return ULL2NUM((unsigned long long)(uintptr_t)get_arena(self)->base);
+}
+
+/*
+ * call-seq:
+ *    arena.type -> Symbol
+ */
+static VALUE
+arena_type_name(VALUE self)
+{
+  return ID2SYM(rb_intern(get_arena(self)->layout->type));
+}
+
+/*
+ * call-seq:
+ *    arena.entry(index) -> Hash or nil
+ *
+ * Attributes of the entry at +index+ in file order, or nil if out of
+ * range. Negative indexes count from the end.
+ */
+static VALUE
+arena_entry(VALUE self, VALUE index)
+{
+  struct eu_arena *a = get_arena(self);
+  long i = NUM2LONG(index);
+
+  if (i < 0)
+    i += (long)a->count;
+  if (i < 0 || i >= (long)a->count)
+    return Qnil;
+  return eu_arena_entry(a, (uint32_t)i);
+}
+
+/*
+ * call-seq:
+ *    arena.each { |entry| ... } -> arena
+ *    arena.each -> Enumerator
+ *
+ * Yield the attributes of every entry in file order.
+ */
+static VALUE
+arena_size_fn(VALUE self, VALUE args, VALUE eobj)
+{
+  return arena_size(self);
+}
+
+static VALUE
+arena_each(VALUE self)
+{
+  struct eu_arena *a;
+  uint32_t i;
+
+  RETURN_SIZED_ENUMERATOR(self, 0, 0, arena_size_fn);
+  a = get_arena(self);
+  for (i = 0; i < a->count; i++)
+    rb_yield(eu_arena_entry(a, i));
+  return self;
+}
+
+/*
+ * call-seq:
+ *    arena.find_name(name) -> Hash or nil
+ *
+ * First entry (in file order) named +name+, found by binary search.
+ */
+static VALUE
+arena_find_name(VALUE self, VALUE name)
+{
+  struct eu_arena *a = get_arena(self);
+  const uint32_t *off;
+  const char *key;
+  uint32_t lo = 0, hi, mid, klen, flen;
+  int c;
+
+  StringValue(name);
+  key = RSTRING_PTR(name);
+  klen = (uint32_t)RSTRING_LEN(name);
+  hi = a->count;
+
+  /* Lower bound, so duplicates resolve to the first record */
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    off = eu_arena_offsets(a, a->by_name[mid]);
+    flen = off[1] - off[0] - 1;
+    c = memcmp(a->text + off[0], key, flen < klen ? flen : klen);
+    if (c < 0 || (c == 0 && flen < klen))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == a->count)
+    return Qnil;
+  off = eu_arena_offsets(a, a->by_name[lo]);
+  if ( off[1] - off[0] - 1 != klen || memcmp(a->text + off[0], key, klen) )
+    return Qnil;
+
+  RB_GC_GUARD(name);
+  return eu_arena_entry(a, a->by_name[lo]);
+}
+
+/*
+ * call-seq:
+ *    arena.find_id(id) -> Hash or nil
+ *
+ * First entry (in file order) with UID or GID +id+. Raises ArgumentError
+ * for databases without a numeric id.
+ */
+static VALUE
+arena_find_id(VALUE self, VALUE id)
+{
+  struct eu_arena *a = get_arena(self);
+  uint32_t lo = 0, hi = a->nids, mid;
+  unsigned long key;
+
+  if (!a->by_id)
+    rb_raise(rb_eArgError, "%s entries have no numeric id", a->layout->type);
+
+  /* IDs are stored as uint32_t; anything outside that range is absent */
+  id = rb_to_int(id);
+  if ( RTEST(rb_funcall(id, '<', 1, INT2FIX(0))) ||
+       rb_absint_size(id, NULL) > sizeof(uint32_t) )
+    return Qnil;
+  key = NUM2ULONG(id);
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (a->by_id[2 * (size_t)mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if (lo == a->nids || a->by_id[2 * (size_t)lo] != key)
+    return Qnil;
+  return eu_arena_entry(a, a->by_id[2 * (size_t)lo + 1]);
+}
+
+void Init_etcutils_arena(void)
+{
+  int i, f;
+
+  for (i = 0; i < EU_A_NLAYOUTS; i++)
+    for (f = 0; f < eu_arena_layouts[i].nfields; f++)
+      eu_arena_layouts[i].syms[f] = ID2SYM(rb_intern(eu_arena_layouts[i].fields[f]));
+
+  cArena = rb_define_class_under(mNative, "Arena", rb_cObject);
+  rb_undef_alloc_func(cArena);
+  rb_define_singleton_method(cArena, "load", arena_s_load, 2);
+  rb_define_method(cArena, "size", arena_size, 0);
+  rb_define_method(cArena, "bytesize", arena_bytesize, 0);
+  rb_define_method(cArena, "address", arena_address, 0);
+  rb_define_method(cArena, "type", arena_type_name, 0);
+  rb_define_method(cArena, "entry", arena_entry, 1);
+  rb_define_method(cArena, "each", arena_each, 0);
+  rb_define_method(cArena, "find_name", arena_find_name, 1);
+  rb_define_method(cArena, "find_id", arena_find_id, 1);
+}
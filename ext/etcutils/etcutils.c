@@ -28,6 +28,8 @@
 #include <unistd.h>
 #include <time.h>
 #include "etcutils.h"
+#include "ruby/encoding.h"
+#include "probes.h"
 
 VALUE mEtcUtils;
 ID id_name, id_passwd, id_uid, id_gid;
@@ -137,6 +139,23 @@ eu_errno(VALUE str)
   */
 }
 
+/*
+ * Run a blocking C call without holding the GVL so other threads (and,
+ * where rb_nogvl supports offloading, other fibers) keep running.
+ * func must not touch Ruby objects.
+ */
+void *
+eu_without_gvl(void *(*func)(void *), void *data)
+{
+#if defined(HAVE_RB_NOGVL) && defined(RB_NOGVL_OFFLOAD_SAFE)
+  return rb_nogvl(func, data, RUBY_UBF_IO, NULL, RB_NOGVL_OFFLOAD_SAFE);
+#elif defined(HAVE_RB_THREAD_CALL_WITHOUT_GVL)
+  return rb_thread_call_without_gvl(func, data, RUBY_UBF_IO, NULL);
+#else
+  return func(data);
+#endif
+}
+
 void ensure_eu_type(VALUE self, VALUE klass)
 {
   if (!rb_obj_is_kind_of(self, klass))
@@ -225,12 +244,37 @@ VALUE setup_safe_str(const char *str)
   return rb_str_new2(str); // this already handles characters >= 0
 }
 
+/* Set through EtcUtils.intern_strings= */
+int eu_intern_strings = 0;
+
+/*
+ * Like setup_safe_str, but returns a frozen, deduplicated String while
+ * interning is enabled. Used for low-cardinality fields (shells, member
+ * names, password placeholders) so large enumerations share one copy.
+ */
+VALUE setup_interned_str(const char *str)
+{
+#ifdef HAVE_RB_ENC_INTERNED_STR
+  if (eu_intern_strings)
+    return rb_enc_interned_str(str, (long)strlen(str), rb_ascii8bit_encoding());
+#endif
+  return setup_safe_str(str);
+}
+
+/* Password fields are only interned when too short to be a crypt(3) hash */
+VALUE setup_passwd_str(const char *str)
+{
+  if (strlen(str) < 13)
+    return setup_interned_str(str);
+  return setup_safe_str(str);
+}
+
 VALUE setup_safe_array(char **arr)
 {
   VALUE mem = rb_ary_new();
 
   while (*arr)
-    rb_ary_push(mem, setup_safe_str(*arr++));
+    rb_ary_push(mem, setup_interned_str(*arr++));
   return mem;
 }
 /* End of helper functions */
@@ -466,7 +510,7 @@ VALUE eu_sgetpwent(VALUE self, VALUE str)
   VALUE ary;
   VALUE name;
 
-  ary = rb_str_split(str, ":");
+  ary = eu_split(str, ':');
   name = rb_ary_entry(ary, 0);
 
   if (RSTRING_BLANK_P(name))
@@ -526,7 +570,7 @@ static VALUE eu_grp_cur(VALUE str, VALUE ary)
   if ( RSTRING_BLANK_P(str) )
     str = rb_str_new2("");
 
-  ary = rb_str_split(str, ",");
+  ary = eu_split(str, ',');
   if ( ! rb_eql( setup_safe_array(grp->gr_mem), ary) )
     grp->gr_mem = setup_char_members( ary );
 
@@ -605,10 +649,11 @@ static VALUE eu_grp_new(VALUE self, VALUE ary)
   tmp = (ary_len > 3) ? rb_ary_entry(ary, 3) : Qnil;
   if (RSTRING_BLANK_P(tmp))
     tmp = rb_str_new2("");
-  grp->gr_mem = setup_char_members( rb_str_split(tmp, ",") );
+  tmp = eu_split(tmp, ',');
+  grp->gr_mem = setup_char_members( tmp );
 
   nam = setup_group(grp);
-  free_char_members(grp->gr_mem, (int)RARRAY_LEN(rb_str_split(tmp,",")));
+  free_char_members(grp->gr_mem, (int)RARRAY_LEN(tmp));
 
   if (grp)
     free(grp);
@@ -623,7 +668,7 @@ VALUE eu_sgetgrent(VALUE self, VALUE str)
   eu_setpwent(self);
   eu_setgrent(self);
 
-  ary = rb_str_split(str, ":");
+  ary = eu_split(str, ':');
   str = rb_ary_entry(ary,0);
 
   if (RSTRING_BLANK_P(str))
@@ -728,13 +773,20 @@ eu_fgetsgent(VALUE self, VALUE io)
 VALUE eu_getpwd(VALUE self, VALUE v)
 {
   struct passwd *strt;
+  long long start;
   eu_setpwent(self);
 
-  if ( RB_FIXNUM_P(v) )
+  start = EU_PROBE_CLOCK();
+  if ( RB_FIXNUM_P(v) ) {
     strt = getpwuid(NUM2UIDT(v));
-  else {
+    EU_PROBE5(lookup, "passwd", NULL, FIX2LONG(v), strt != NULL, EU_PROBE_CLOCK() - start);
+  } else {
+    const char *name;
+
     SafeStringValue(v);
-    strt = getpwnam(StringValuePtr(v));
+    name = StringValuePtr(v);
+    strt = getpwnam(name);
+    EU_PROBE5(lookup, "passwd", name, -1L, strt != NULL, EU_PROBE_CLOCK() - start);
   }
 
   if (!strt)
@@ -796,13 +848,20 @@ VALUE eu_getsgrp(VALUE self, VALUE v)
 VALUE eu_getgrp(VALUE self, VALUE v)
 {
   struct group *strt;
+  long long start;
   eu_setgrent(self);
 
-  if (RB_FIXNUM_P(v))
+  start = EU_PROBE_CLOCK();
+  if (RB_FIXNUM_P(v)) {
     strt = getgrgid(NUM2UIDT(v));
-  else {
+    EU_PROBE5(lookup, "group", NULL, FIX2LONG(v), strt != NULL, EU_PROBE_CLOCK() - start);
+  } else {
+    const char *name;
+
     SafeStringValue(v);
-    strt = getgrnam(StringValuePtr(v));
+    name = StringValuePtr(v);
+    strt = getgrnam(name);
+    EU_PROBE5(lookup, "group", name, -1L, strt != NULL, EU_PROBE_CLOCK() - start);
   }
 
   if (!strt)
@@ -839,18 +898,60 @@ eu_putsgent(VALUE mod, VALUE entry, VALUE io)
 #endif
 
 #ifdef HAVE_LCKPWDF
+struct eu_lckpwdf_call {
+  int result;
+  int err;
+};
+
+/* lckpwdf(3) waits up to 15 seconds for the lock; never hold the GVL */
+static void *
+lckpwdf_nogvl(void *data)
+{
+  struct eu_lckpwdf_call *call = data;
+
+  errno = 0;
+  call->result = lckpwdf();
+  call->err = errno;
+  return NULL;
+}
+
+static int
+eu_blocking_lckpwdf(void)
+{
+  struct eu_lckpwdf_call call = { 0, 0 };
+  long long start = EU_PROBE_CLOCK();
+
+  eu_without_gvl(lckpwdf_nogvl, &call);
+  EU_PROBE3(lock_acquire, call.result, call.err, EU_PROBE_CLOCK() - start);
+  errno = call.err;
+  return call.result;
+}
+#endif
+
+#ifdef HAVE_ULCKPWDF
+static int
+eu_release_lckpwdf(void)
+{
+  int result = ulckpwdf();
+
+  EU_PROBE1(lock_release, result);
+  return result;
+}
+#endif
+
+#ifdef HAVE_LCKPWDF
+
 static VALUE
 eu_locked_p(VALUE self)
 {
   int i;
-  errno = 0;
-  i = lckpwdf();
+  i = eu_blocking_lckpwdf();
   if (errno)
     rb_raise(rb_eSystemCallError, "Error locking passwd files: %s", strerror(errno));
 
   if (i)
     return Qtrue;
-  else if (!ulckpwdf())
+  else if (!eu_release_lckpwdf())
     return Qfalse;
   else
     rb_raise(rb_eIOError,"Unable to determine the locked state of password files");
@@ -863,7 +964,7 @@ eu_lckpwdf(VALUE self)
 {
   VALUE r;
   if ( !(r = eu_locked_p(self)) ) {
-    if ( !(lckpwdf()) )
+    if ( !(eu_blocking_lckpwdf()) )
       r = Qtrue;
   }
   return r;
@@ -876,7 +977,7 @@ eu_ulckpwdf(VALUE self)
 {
   VALUE r;
   if ( (r = eu_locked_p(self)) )
-    if ( !(ulckpwdf()) )
+    if ( !(eu_release_lckpwdf()) )
       r = Qtrue;
   return r;
 }
@@ -886,7 +987,7 @@ static int in_lock = 0;
 static VALUE
 lock_ensure(void)
 {
-  ulckpwdf();
+  eu_release_lckpwdf();
   in_lock = (int)Qfalse;
   return Qnil;
 }
@@ -916,19 +1017,26 @@ eu_unlock(VALUE self)
 #ifdef SHADOW
 static int spwd_block = 0;
 
+static long spwd_count = 0;
+
 static VALUE shadow_iterate(VALUE arg)
 {
   struct spwd *shadow;
 
+  EU_PROBE1(iterate_start, "shadow");
+  spwd_count = 0;
   setspent();
-  while ( (shadow = getspent()) )
+  while ( (shadow = getspent()) ) {
+    spwd_count++;
     rb_yield(setup_shadow(shadow));
+  }
 
   return Qnil;
 }
 
 static VALUE shadow_ensure(VALUE arg)
 {
+  EU_PROBE2(iterate_end, "shadow", spwd_count);
   endspent();
   spwd_block = (int)Qfalse;
   return Qnil;
@@ -957,18 +1065,25 @@ VALUE eu_getspent(VALUE self)
 #ifdef PASSWD
 static int pwd_block = 0;
 
+static long pwd_count = 0;
+
 static VALUE pwd_iterate(VALUE arg)
 {
   struct passwd *pwd;
 
+  EU_PROBE1(iterate_start, "passwd");
+  pwd_count = 0;
   setpwent();
-  while ( (pwd = getpwent()) )
+  while ( (pwd = getpwent()) ) {
+    pwd_count++;
     rb_yield(setup_passwd(pwd));
+  }
   return Qnil;
 }
 
 static VALUE pwd_ensure(VALUE arg)
 {
+  EU_PROBE2(iterate_end, "passwd", pwd_count);
   endpwent();
   pwd_block = (int)Qfalse;
   return Qnil;
@@ -997,12 +1112,17 @@ VALUE eu_getpwent(VALUE self)
 #ifdef GROUP
 static int grp_block = 0;
 
+static long grp_count = 0;
+
 static VALUE grp_iterate(VALUE arg)
 {
   struct group *grp;
 
+  EU_PROBE1(iterate_start, "group");
+  grp_count = 0;
   setgrent();
   while ( (grp = getgrent()) ) {
+    grp_count++;
     rb_yield(setup_group(grp));
   }
   return Qnil;
@@ -1010,6 +1130,7 @@ static VALUE grp_iterate(VALUE arg)
 
 static VALUE grp_ensure(VALUE arg)
 {
+  EU_PROBE2(iterate_end, "group", grp_count);
   endgrent();
   grp_block = (int)Qfalse;
   return Qnil;
@@ -1038,18 +1159,25 @@ VALUE eu_getgrent(VALUE self)
 #ifdef GSHADOW
 static int sgrp_block = 0;
 
+static long sgrp_count = 0;
+
 static VALUE sgrp_iterate(VALUE arg)
 {
   struct sgrp *sgroup;
 
+  EU_PROBE1(iterate_start, "gshadow");
+  sgrp_count = 0;
   setsgent();
-  while ( (sgroup = getsgent()) )
+  while ( (sgroup = getsgent()) ) {
+    sgrp_count++;
     rb_yield(setup_gshadow(sgroup));
+  }
   return Qnil;
 }
 
 static VALUE sgrp_ensure(VALUE arg)
 {
+  EU_PROBE2(iterate_end, "gshadow", sgrp_count);
 #ifdef HAVE_ENDSGENT
   endsgent();
   sgrp_block = (int)Qfalse;
@@ -1086,6 +1214,7 @@ VALUE eu_to_entry(VALUE self, VALUE(*user_to)(VALUE, VALUE))
   char filename[] = "/tmp/etc_utilsXXXXXX";
   int fd = mkstemp(filename);
 
+  EU_PROBE2(tempfile_create, filename, fd);
   if ( fd == -1 )
     rb_raise(rb_eIOError,
 	     "Error creating temp file: %s", strerror(errno));
@@ -1382,4 +1511,7 @@ void Init_etcutils()
 
   Init_etcutils_user();
   Init_etcutils_group();
+  Init_etcutils_native();
+  Init_etcutils_tokenize();
+  Init_etcutils_arena();
 }
@@ -14,6 +14,10 @@
 #define RTIME_VAL(x) (x.tv_sec)
 #endif
 
+#ifdef HAVE_RUBY_THREAD_H
+#include "ruby/thread.h"
+#endif
+
 #ifdef HAVE_SHADOW_H
 #include <shadow.h>
 #ifndef SHADOW
@@ -109,6 +113,7 @@ extern int eaccess(const char*, int);
 
 extern ID id_name, id_passwd, id_uid, id_gid;
 extern VALUE mEtcUtils;
+extern VALUE mNative;
 
 extern VALUE rb_cPasswd;
 extern VALUE rb_cShadow;
@@ -122,6 +127,7 @@ extern VALUE iv_get_time(VALUE self, const char *name);
 extern VALUE iv_set_time(VALUE self, VALUE v, const char *name);
 extern VALUE rb_current_time();
 extern void eu_errno(VALUE str);
+extern void *eu_without_gvl(void *(*func)(void *), void *data);
 extern void ensure_file(VALUE io);
 extern void ensure_writes(VALUE io, int t);
 #define Check_Writes(v,t) ensure_writes((VALUE)(io),(int)(t));
@@ -131,7 +137,15 @@ extern void ensure_eu_type(VALUE self, VALUE klass);
 extern char** setup_char_members(VALUE ary);
 extern void free_char_members(char ** mem, int c);
 
+extern int eu_intern_strings;
+
+/* Delimiter scanning (tokenize.c) */
+extern long eu_scan_delims(const char *s, long len, char delim, long *pos, long cap);
+extern VALUE eu_split(VALUE str, char delim);
+extern int eu_entry_line_p(const char *line, size_t len);
 extern VALUE setup_safe_str(const char *str);
+extern VALUE setup_interned_str(const char *str);
+extern VALUE setup_passwd_str(const char *str);
 extern VALUE setup_safe_array(char **arr);
 
 #ifdef HAVE_SHADOW_H
@@ -187,3 +201,6 @@ extern VALUE rb_ary_uniq_bang(VALUE ary);
 extern void Init_etcutils_main();
 extern void Init_etcutils_user();
 extern void Init_etcutils_group();
+extern void Init_etcutils_native(void);
+extern void Init_etcutils_tokenize(void);
+extern void Init_etcutils_arena(void);
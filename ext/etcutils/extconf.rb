@@ -10,9 +10,20 @@ have_header('ruby/io.h')
 have_struct_member("struct rb_io_t", "pathv", "ruby/io.h")
 have_func('rb_io_stdio_file')
 have_func('eaccess')
+have_func('rb_enc_interned_str', 'ruby/encoding.h')
+
+# Blocking calls (lckpwdf, file scans) release the GVL; rb_nogvl lets a
+# Fiber scheduler offload them where RB_NOGVL_OFFLOAD_SAFE is available
+if have_header('ruby/thread.h')
+  have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
+  have_func('rb_nogvl', 'ruby/thread.h')
+end
 
 have_header('etcutils.h')
 
+# USDT probes for bpftrace/perf/stap; compiled out without <sys/sdt.h>
+have_header('sys/sdt.h') if enable_config('probes', true)
+
 if (have_header('pwd.h') && have_header('grp.h'))
   short_v = ['pw','gr']
 
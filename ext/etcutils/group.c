@@ -150,7 +150,7 @@ VALUE setup_group(struct group *grp)
   obj = rb_obj_alloc(rb_cGroup);
 
   rb_ivar_set(obj, id_name, setup_safe_str(grp->gr_name));
-  rb_ivar_set(obj, id_passwd, setup_safe_str(grp->gr_passwd));
+  rb_ivar_set(obj, id_passwd, setup_passwd_str(grp->gr_passwd));
   rb_ivar_set(obj, id_gid, GIDT2NUM(grp->gr_gid));
   rb_iv_set(obj, "@members", setup_safe_array(grp->gr_mem));
 
@@ -167,7 +167,7 @@ VALUE setup_gshadow(struct sgrp *sgroup)
   obj = rb_obj_alloc(rb_cGshadow);
 
   rb_ivar_set(obj, id_name, setup_safe_str(SGRP_NAME(sgroup)));
-  rb_ivar_set(obj, id_passwd, setup_safe_str(sgroup->sg_passwd));
+  rb_ivar_set(obj, id_passwd, setup_passwd_str(sgroup->sg_passwd));
   rb_iv_set(obj, "@admins", setup_safe_array(sgroup->sg_adm));
   rb_iv_set(obj, "@members", setup_safe_array(sgroup->sg_mem));
   return obj;
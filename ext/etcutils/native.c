@@ -0,0 +1,525 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include "etcutils.h"
+#include "ruby/encoding.h"
+
+/*
+ * EtcUtils::Native - byte-level helpers used by the v2 Linux backend.
+ *
+ * These work directly on the colon-separated database files so that
+ * counting and existence checks never build Ruby objects for entries
+ * that are skipped. Lines are read through a fixed-size buffer and
+ * split with the vectorized delimiter scan from tokenize.c, so memory
+ * stays bounded regardless of the file size.
+ * Scans run without the GVL; only their results become Ruby objects.
+ *
+ * The serializer goes the other way: it formats a whole array of
+ * entries into a single growable String without building per-line
+ * or per-field intermediate objects.
+ */
+
+VALUE mNative;
+
+#define EU_SCAN_BUFSIZE 65536
+#define EU_LINE_BATCH 64
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+typedef int (*eu_line_fn)(const char *line, size_t len, void *arg);
+
+/*
+ * Call fn for every line of path (without the trailing newline).
+ * Iteration stops early when fn returns non-zero.
+ * Returns 0 on success or an errno value on failure.
+ */
+static int eu_each_line(const char *path, eu_line_fn fn, void *arg)
+{
+  char *buf, *tmp;
+  size_t cap = EU_SCAN_BUFSIZE, used = 0;
+  ssize_t n;
+  int fd, err = 0;
+
+  if ( (fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 )
+    return errno;
+
+  if ( (buf = malloc(cap)) == NULL ) {
+    close(fd);
+    return ENOMEM;
+  }
+
+  for (;;) {
+    char *start, *nl, *end, *base;
+    long nls[EU_LINE_BATCH], count, i;
+
+    if (used == cap) {
+      /* A single line filled the buffer; grow it */
+      if ( (tmp = realloc(buf, cap * 2)) == NULL ) {
+	err = ENOMEM;
+	break;
+      }
+      buf = tmp;
+      cap *= 2;
+    }
+
+    n = read(fd, buf + used, cap - used);
+    if (n < 0) {
+      if (errno == EINTR)
+	continue;
+      err = errno;
+      break;
+    }
+
+    if (n == 0) {
+      /* Final line without a trailing newline */
+      if (used > 0)
+	fn(buf, used, arg);
+      break;
+    }
+
+    used += (size_t)n;
+    start = buf;
+    end = buf + used;
+
+    /* Collect newline offsets a batch at a time (see tokenize.c) */
+    do {
+      count = eu_scan_delims(start, (long)(end - start), '\n', nls, EU_LINE_BATCH);
+      base = start;
+      for (i = 0; i < count; i++) {
+	nl = base + nls[i];
+	if ( fn(start, (size_t)(nl - start), arg) ) {
+	  used = 0;
+	  goto done;
+	}
+	start = nl + 1;
+      }
+    } while (count == EU_LINE_BATCH);
+
+    used = (size_t)(end - start);
+    if (used && start != buf)
+      memmove(buf, start, used);
+  }
+
+ done:
+  free(buf);
+  close(fd);
+  return err;
+}
+
+static void eu_scan_fail(int err, VALUE path)
+{
+  errno = err;
+  rb_sys_fail_str(path);
+}
+
+/* Blank lines and '#' comments are not entries */
+int eu_entry_line_p(const char *line, size_t len)
+{
+  size_t i;
+
+  if (len && line[0] == '#')
+    return 0;
+
+  for (i = 0; i < len; i++)
+    if ( !(line[i] == ' ' || line[i] == '\t' || line[i] == '\r' ||
+	   line[i] == '\v' || line[i] == '\f' || line[i] == '\0') )
+      return 1;
+  return 0;
+}
+
+struct eu_count {
+  long count;
+  long min_fields;
+};
+
+/* Lines with fewer than min_fields fields are skipped by the parsers too */
+static int count_line(const char *line, size_t len, void *arg)
+{
+  struct eu_count *c = arg;
+  const char *p = line, *end = line + len;
+  long fields = 1;
+
+  if ( !eu_entry_line_p(line, len) )
+    return 0;
+
+  while ( fields < c->min_fields && (p = memchr(p, ':', (size_t)(end - p))) != NULL ) {
+    fields++;
+    p++;
+  }
+  if ( fields >= c->min_fields )
+    c->count++;
+  return 0;
+}
+
+struct eu_scan {
+  char *path;
+  eu_line_fn fn;
+  void *arg;
+  int err;
+};
+
+static void *eu_scan_nogvl(void *data)
+{
+  struct eu_scan *scan = data;
+
+  scan->err = eu_each_line(scan->path, scan->fn, scan->arg);
+  return NULL;
+}
+
+/*
+ * eu_each_line() over a Ruby path with the GVL released. The path is
+ * copied first since the String may move or change while we scan.
+ */
+static int eu_scan_path(VALUE path, eu_line_fn fn, void *arg)
+{
+  struct eu_scan scan;
+  const char *cpath = StringValueCStr(path);
+  size_t len = strlen(cpath);
+
+  scan.path = ALLOC_N(char, len + 1);
+  memcpy(scan.path, cpath, len + 1);
+  scan.fn = fn;
+  scan.arg = arg;
+  scan.err = 0;
+
+  eu_without_gvl(eu_scan_nogvl, &scan);
+  xfree(scan.path);
+  return scan.err;
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.count_entries(path, min_fields = 0) -> Integer
+ *
+ * Count the entries in a database file, skipping blank and comment lines
+ * and lines with fewer than +min_fields+ colon-separated fields.
+ */
+static VALUE
+native_count_entries(int argc, VALUE *argv, VALUE self)
+{
+  VALUE path, min_fields;
+  struct eu_count c;
+  int err;
+
+  rb_scan_args(argc, argv, "11", &path, &min_fields);
+  FilePathValue(path);
+  c.count = 0;
+  c.min_fields = NIL_P(min_fields) ? 0 : NUM2LONG(min_fields);
+  if ( (err = eu_scan_path(path, count_line, &c)) )
+    eu_scan_fail(err, path);
+
+  return LONG2NUM(c.count);
+}
+
+struct eu_field_match {
+  int field;
+  char *key;
+  size_t key_len;
+  int numeric;
+  unsigned long id;
+  char *found;
+  size_t found_len;
+  int nomem;
+};
+
+/* Locate field number idx in line; returns its length or -1 if absent */
+static long eu_field(const char *line, size_t len, int idx, const char **out)
+{
+  const char *p = line, *end = line + len, *c;
+
+  while (idx-- > 0) {
+    if ( (c = memchr(p, ':', (size_t)(end - p))) == NULL )
+      return -1;
+    p = c + 1;
+  }
+
+  c = memchr(p, ':', (size_t)(end - p));
+  *out = p;
+  return (long)((c ? c : end) - p);
+}
+
+static int match_line(const char *line, size_t len, void *arg)
+{
+  struct eu_field_match *m = arg;
+  const char *f;
+  long flen, i;
+  unsigned long v = 0;
+
+  if ( !eu_entry_line_p(line, len) )
+    return 0;
+
+  if ( (flen = eu_field(line, len, m->field, &f)) < 0 )
+    return 0;
+
+  if (m->numeric) {
+    /* Compare numerically so "010" and "10" name the same id */
+    if (flen == 0)
+      return 0;
+    for (i = 0; i < flen; i++) {
+      if (f[i] < '0' || f[i] > '9')
+	return 0;
+      /* An id too large for unsigned long cannot equal the key */
+      if ( v > (ULONG_MAX - (unsigned long)(f[i] - '0')) / 10 )
+	return 0;
+      v = v * 10 + (unsigned long)(f[i] - '0');
+    }
+    if (v != m->id)
+      return 0;
+  } else if ( (size_t)flen != m->key_len || memcmp(f, m->key, m->key_len) ) {
+    return 0;
+  }
+
+  /* No Ruby allocations without the GVL; copy the line out instead */
+  if ( (m->found = malloc(len ? len : 1)) == NULL ) {
+    m->nomem = 1;
+    return 1;
+  }
+  memcpy(m->found, line, len);
+  m->found_len = len;
+  return 1;
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.find_line(path, field, key) -> String or nil
+ *
+ * Return the first entry line whose field number +field+ equals +key+.
+ * String keys are compared byte-for-byte; Integer keys are compared
+ * numerically. Only the matching line is turned into a Ruby String.
+ */
+static VALUE
+native_find_line(VALUE self, VALUE path, VALUE field, VALUE key)
+{
+  struct eu_field_match m;
+  VALUE found = Qnil;
+  int err;
+
+  FilePathValue(path);
+  memset(&m, 0, sizeof m);
+  m.field = NUM2INT(field);
+
+  if (m.field < 0)
+    rb_raise(rb_eArgError, "field must not be negative");
+
+  if ( RB_INTEGER_TYPE_P(key) ) {
+    /* Negative or out-of-range keys match nothing, as in the Ruby scan */
+    if ( RTEST(rb_funcall(key, '<', 1, INT2FIX(0))) ||
+	 rb_absint_size(key, NULL) > sizeof(unsigned long) )
+      return Qnil;
+    m.numeric = 1;
+    m.id = NUM2ULONG(key);
+  } else {
+    StringValue(key);
+    m.key_len = (size_t)RSTRING_LEN(key);
+    m.key = ALLOC_N(char, m.key_len + 1);
+    memcpy(m.key, RSTRING_PTR(key), m.key_len);
+  }
+
+  err = eu_scan_path(path, match_line, &m);
+  if (m.key)
+    xfree(m.key);
+  if (m.found) {
+    found = rb_str_new(m.found, (long)m.found_len);
+    free(m.found);
+  }
+
+  if (err)
+    eu_scan_fail(err, path);
+  if (m.nomem)
+    rb_memerror();
+
+  return found;
+}
+
+/*
+ * Serializer field layouts. Lists (members, admins) are joined with
+ * ','; every other field is written with to_s, and nil becomes empty.
+ */
+#define EU_SCALAR 0
+#define EU_LIST   1
+
+struct eu_layout {
+  const char *type;
+  int nfields;
+  const char *fields[9];
+  const char kinds[9];
+  VALUE syms[9];
+};
+
+static struct eu_layout eu_layouts[] = {
+  { "passwd", 7,
+    { "name", "passwd", "uid", "gid", "gecos", "dir", "shell" },
+    { EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_SCALAR } },
+  { "group", 4,
+    { "name", "passwd", "gid", "members" },
+    { EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_LIST } },
+  { "shadow", 9,
+    { "name", "passwd", "last_change", "min_days", "max_days",
+      "warn_days", "inactive_days", "expire_date", "reserved" },
+    { EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_SCALAR,
+      EU_SCALAR, EU_SCALAR, EU_SCALAR, EU_SCALAR } },
+  { "gshadow", 4,
+    { "name", "passwd", "admins", "members" },
+    { EU_SCALAR, EU_SCALAR, EU_LIST, EU_LIST } },
+  { "subid", 3,
+    { "name", "start", "count" },
+    { EU_SCALAR, EU_SCALAR, EU_SCALAR } },
+};
+
+#define EU_NLAYOUTS (int)(sizeof(eu_layouts) / sizeof(eu_layouts[0]))
+
+static void eu_cat_value(VALUE buf, VALUE v)
+{
+  char num[24], *p;
+  long n;
+  int neg;
+
+  if (NIL_P(v))
+    return;
+
+  if (RB_TYPE_P(v, T_STRING)) {
+    rb_str_buf_append(buf, v);
+    return;
+  }
+
+  if (FIXNUM_P(v)) {
+    /* Format small integers in place instead of allocating via to_s */
+    n = FIX2LONG(v);
+    neg = n < 0;
+    p = num + sizeof num;
+    do {
+      *--p = (char)('0' + (neg ? -(n % 10) : n % 10));
+      n /= 10;
+    } while (n);
+    if (neg)
+      *--p = '-';
+    rb_str_cat(buf, p, (long)(num + sizeof num - p));
+    return;
+  }
+
+  rb_str_buf_append(buf, rb_obj_as_string(v));
+}
+
+static void eu_cat_list(VALUE buf, VALUE v)
+{
+  VALUE ary;
+  long i;
+
+  if (NIL_P(v))
+    return;
+
+  if ( NIL_P(ary = rb_check_array_type(v)) ) {
+    eu_cat_value(buf, v);
+    return;
+  }
+
+  for (i = 0; i < RARRAY_LEN(ary); i++) {
+    if (i)
+      rb_str_cat(buf, ",", 1);
+    eu_cat_value(buf, RARRAY_AREF(ary, i));
+  }
+}
+
+static struct eu_layout *eu_find_layout(VALUE type)
+{
+  const char *name;
+  int i;
+
+  if (SYMBOL_P(type))
+    type = rb_sym2str(type);
+  name = StringValueCStr(type);
+
+  for (i = 0; i < EU_NLAYOUTS; i++)
+    if ( strcmp(eu_layouts[i].type, name) == 0 )
+      return &eu_layouts[i];
+
+  rb_raise(rb_eArgError, "unknown database type: %s", name);
+  return NULL;
+}
+
+/* Fetch a field from a Hash or Struct entry */
+static VALUE eu_entry_field(VALUE entry, VALUE sym)
+{
+  if ( RB_TYPE_P(entry, T_STRUCT) )
+    return rb_struct_aref(entry, sym);
+  return rb_hash_aref(entry, sym);
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.serialize(type, entries) -> String
+ *
+ * Format +entries+ as the lines of a +type+ database file (:passwd,
+ * :group, :shadow, :gshadow or :subid), each terminated by a newline. Entries
+ * may be Hashes or Structs; Structs are read member by member rather
+ * than converted with to_h.
+ */
+static VALUE
+native_serialize(VALUE self, VALUE type, VALUE entries)
+{
+  struct eu_layout *layout = eu_find_layout(type);
+  VALUE buf, entry, hash;
+  long i;
+  int f;
+
+  entries = rb_convert_type(entries, T_ARRAY, "Array", "to_ary");
+  buf = rb_str_buf_new(RARRAY_LEN(entries) * 64 + 1);
+  rb_enc_associate(buf, rb_utf8_encoding());
+
+  for (i = 0; i < RARRAY_LEN(entries); i++) {
+    entry = RARRAY_AREF(entries, i);
+    hash = entry;
+    if ( !RB_TYPE_P(entry, T_HASH) && !RB_TYPE_P(entry, T_STRUCT) )
+      hash = rb_convert_type(entry, T_HASH, "Hash", "to_h");
+
+    for (f = 0; f < layout->nfields; f++) {
+      VALUE v = eu_entry_field(hash, layout->syms[f]);
+
+      if (f)
+	rb_str_cat(buf, ":", 1);
+      if (layout->kinds[f] == EU_LIST)
+	eu_cat_list(buf, v);
+      else
+	eu_cat_value(buf, v);
+    }
+    rb_str_cat(buf, "\n", 1);
+  }
+
+  /* Match the Ruby writer: an empty file is a single newline */
+  if (RARRAY_LEN(entries) == 0)
+    rb_str_cat(buf, "\n", 1);
+
+  RB_GC_GUARD(entries);
+  return buf;
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.intern_strings = bool
+ *
+ * Called by EtcUtils.intern_strings= to switch the C entry builders
+ * between fresh and interned Strings for low-cardinality fields.
+ */
+static VALUE
+native_set_intern_strings(VALUE self, VALUE flag)
+{
+  eu_intern_strings = RTEST(flag);
+  return flag;
+}
+
+void Init_etcutils_native(void)
+{
+  int i, f;
+
+  mNative = rb_define_module_under(mEtcUtils, "Native");
+
+  for (i = 0; i < EU_NLAYOUTS; i++)
+    for (f = 0; f < eu_layouts[i].nfields; f++)
+      eu_layouts[i].syms[f] = ID2SYM(rb_intern(eu_layouts[i].fields[f]));
+
+  rb_define_module_function(mNative, "count_entries", native_count_entries, -1);
+  rb_define_module_function(mNative, "find_line", native_find_line, 3);
+  rb_define_module_function(mNative, "serialize", native_serialize, 2);
+  rb_define_module_function(mNative, "intern_strings=", native_set_intern_strings, 1);
+}
@@ -221,7 +221,7 @@ VALUE setup_shadow(struct spwd *spasswd)
   obj = rb_obj_alloc(rb_cShadow);
 
   rb_ivar_set(obj, id_name, setup_safe_str(spasswd->sp_namp));
-  rb_ivar_set(obj, id_passwd, setup_safe_str(spasswd->sp_pwdp));
+  rb_ivar_set(obj, id_passwd, setup_passwd_str(spasswd->sp_pwdp));
 
   rb_iv_set(obj, "@last_pw_change", INT2FIX(spasswd->sp_lstchg));
   rb_iv_set(obj, "@min_pw_age", INT2FIX(spasswd->sp_min));
@@ -266,13 +266,13 @@ VALUE setup_passwd(struct passwd *pwd)
   obj = rb_obj_alloc(rb_cPasswd);
 
   rb_ivar_set(obj, id_name, setup_safe_str(pwd->pw_name));
-  rb_ivar_set(obj, id_passwd, setup_safe_str(pwd->pw_passwd));
+  rb_ivar_set(obj, id_passwd, setup_passwd_str(pwd->pw_passwd));
   rb_ivar_set(obj, id_uid, UIDT2NUM(pwd->pw_uid));
   rb_ivar_set(obj, id_gid, GIDT2NUM(pwd->pw_gid));
 
   rb_iv_set(obj, "@gecos", setup_safe_str(pwd->pw_gecos));
   rb_iv_set(obj, "@directory", setup_safe_str(pwd->pw_dir));
-  rb_iv_set(obj, "@shell", setup_safe_str(pwd->pw_shell));
+  rb_iv_set(obj, "@shell", setup_interned_str(pwd->pw_shell));
   #ifdef HAVE_ST_PW_CHANGE
   if (!pwd->pw_change)
     pwd->pw_change = (time_t)0;
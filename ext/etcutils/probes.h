@@ -0,0 +1,65 @@
+/*
+ * USDT (SystemTap/DTrace-style) static probes for the etcutils provider.
+ *
+ * When extconf.rb finds <sys/sdt.h> (and --disable-probes was not given),
+ * each EU_PROBE* expands to a single nop plus an ELF note that bpftrace,
+ * perf and stap can attach to:
+ *
+ *   bpftrace -e 'usdt:./etcutils.so:etcutils:lookup { printf("%s %d %d\n", str(arg0), arg3, arg4); }'
+ *
+ * Otherwise every probe compiles to nothing, and EU_PROBE_CLOCK returns 0
+ * without reading the clock.
+ *
+ * Probes:
+ *   iterate_start(db)                      getpwent/getgrent/... block begins
+ *   iterate_end(db, entries)               iteration finished or was broken
+ *   lookup(db, name, id, found, ns)        find_pwd/find_grp NSS lookup;
+ *                                          name is NULL for ID lookups, id
+ *                                          is -1 for name lookups
+ *   lock_acquire(result, err, ns)          lckpwdf(3) returned after ns
+ *   lock_release(result)                   ulckpwdf(3) returned
+ *   tempfile_create(path, fd)              to_entry created its temp file
+ */
+#ifndef ETCUTILS_PROBES_H
+#define ETCUTILS_PROBES_H
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#include <time.h>
+
+#define EU_PROBES_ENABLED 1
+#define EU_PROBE1(name, a)                DTRACE_PROBE1(etcutils, name, a)
+#define EU_PROBE2(name, a, b)             DTRACE_PROBE2(etcutils, name, a, b)
+#define EU_PROBE3(name, a, b, c)          DTRACE_PROBE3(etcutils, name, a, b, c)
+#define EU_PROBE5(name, a, b, c, d, e)    DTRACE_PROBE5(etcutils, name, a, b, c, d, e)
+
+static inline long long
+eu_probe_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+#define EU_PROBE_CLOCK() eu_probe_clock()
+
+#else
+
+/* Arguments are referenced but never evaluated, so callers get no unused
+ * variable warnings and no code is generated */
+#define EU_PROBES_ENABLED 0
+#define EU_PROBE_UNUSED(x)                (void)sizeof(x)
+#define EU_PROBE1(name, a) \
+  do { EU_PROBE_UNUSED(a); } while (0)
+#define EU_PROBE2(name, a, b) \
+  do { EU_PROBE_UNUSED(a); EU_PROBE_UNUSED(b); } while (0)
+#define EU_PROBE3(name, a, b, c) \
+  do { EU_PROBE_UNUSED(a); EU_PROBE_UNUSED(b); EU_PROBE_UNUSED(c); } while (0)
+#define EU_PROBE5(name, a, b, c, d, e) \
+  do { EU_PROBE_UNUSED(a); EU_PROBE_UNUSED(b); EU_PROBE_UNUSED(c); \
+       EU_PROBE_UNUSED(d); EU_PROBE_UNUSED(e); } while (0)
+#define EU_PROBE_CLOCK()                  0LL
+
+#endif
+
+#endif /* ETCUTILS_PROBES_H */
@@ -0,0 +1,272 @@
+#include "etcutils.h"
+#include "ruby/encoding.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#ifdef __SSE2__
+#define EU_HAVE_SSE2 1
+#endif
+#define EU_HAVE_AVX2 1
+#endif
+
+/*
+ * Delimiter scanning for the entry tokenizer.
+ *
+ * sgetpwent/sgetgrent and the Native file scans split lines on ':', ','
+ * and '\n'. Rather than searching for one delimiter at a time, a kernel
+ * compares a whole block against the delimiter, turns the result into a
+ * bitmask and reports every set bit, so each byte is looked at once no
+ * matter how many fields a line has. Long GECOS fields and groups with
+ * thousands of members are where this pays off.
+ *
+ * The kernel is picked once at load time from what the CPU supports:
+ * AVX2 (32 bytes per step), SSE2 (16 bytes, always present on x86_64)
+ * or a portable byte loop. The tokenizer_kernel= setter exists so tests
+ * and bench/tokenizer.rb can compare them.
+ */
+
+typedef long (*eu_delim_fn)(const char *s, long len, char delim, long *pos, long cap);
+
+struct eu_kernel {
+  const char *name;
+  eu_delim_fn fn;
+  int (*supported)(void);
+};
+
+/* Record the set bits of a block mask at offset base; returns the new count */
+#define EU_EMIT_MASK(mask, base, pos, n, cap) do {	\
+  while (mask) {					\
+    if ((n) == (cap))					\
+      return (n);					\
+    (pos)[(n)++] = (base) + __builtin_ctz(mask);	\
+    (mask) &= (mask) - 1;				\
+  }							\
+} while (0)
+
+static long
+scan_scalar(const char *s, long len, char delim, long *pos, long cap)
+{
+  long i, n = 0;
+
+  for (i = 0; i < len && n < cap; i++)
+    if (s[i] == delim)
+      pos[n++] = i;
+  return n;
+}
+
+static int supported_always(void) { return 1; }
+
+#ifdef EU_HAVE_SSE2
+static long
+scan_sse2(const char *s, long len, char delim, long *pos, long cap)
+{
+  __m128i d = _mm_set1_epi8(delim);
+  long i = 0, n = 0;
+  unsigned int mask;
+
+  for (; i + 16 <= len; i += 16) {
+    mask = (unsigned int)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), d));
+    EU_EMIT_MASK(mask, i, pos, n, cap);
+  }
+
+  for (; i < len && n < cap; i++)
+    if (s[i] == delim)
+      pos[n++] = i;
+  return n;
+}
+#endif
+
+#ifdef EU_HAVE_AVX2
+__attribute__((target("avx2"))) static long
+scan_avx2(const char *s, long len, char delim, long *pos, long cap)
+{
+  __m256i d = _mm256_set1_epi8(delim);
+  long i = 0, n = 0;
+  unsigned int mask;
+
+  for (; i + 32 <= len; i += 32) {
+    mask = (unsigned int)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(s + i)), d));
+    EU_EMIT_MASK(mask, i, pos, n, cap);
+  }
+
+  for (; i < len && n < cap; i++)
+    if (s[i] == delim)
+      pos[n++] = i;
+  return n;
+}
+
+static int supported_avx2(void)
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+
+/* Fastest first; the first supported entry becomes the default */
+static const struct eu_kernel eu_kernels[] = {
+#ifdef EU_HAVE_AVX2
+  { "avx2", scan_avx2, supported_avx2 },
+#endif
+#ifdef EU_HAVE_SSE2
+  { "sse2", scan_sse2, supported_always },
+#endif
+  { "scalar", scan_scalar, supported_always },
+};
+
+#define EU_NKERNELS (int)(sizeof(eu_kernels) / sizeof(eu_kernels[0]))
+
+static const struct eu_kernel *eu_kernel = &eu_kernels[EU_NKERNELS - 1];
+
+/*
+ * Store the offsets of up to cap occurrences of delim in s[0, len) into
+ * pos, in order. Returns how many were stored; when that equals cap the
+ * caller resumes scanning after pos[cap - 1]. Safe without the GVL.
+ */
+long eu_scan_delims(const char *s, long len, char delim, long *pos, long cap)
+{
+  return eu_kernel->fn(s, len, delim, pos, cap);
+}
+
+#define EU_SPLIT_BATCH 64
+
+/*
+ * Split str on a single-byte delimiter with String#split semantics:
+ * trailing empty fields are dropped and an empty string yields [].
+ * Offsets are kept rather than pointers, and the buffer is fetched again
+ * for every batch, so allocating the pieces can't leave a stale pointer.
+ */
+VALUE eu_split(VALUE str, char delim)
+{
+  long pos[EU_SPLIT_BATCH];
+  long len, base = 0, start = 0, n, i;
+  char sep[2];
+  VALUE ary;
+
+  StringValue(str);
+  if ( !rb_enc_asciicompat(rb_enc_get(str)) ) {
+    /* A byte match could land inside a wide character */
+    sep[0] = delim;
+    sep[1] = '\0';
+    return rb_str_split(str, sep);
+  }
+
+  len = RSTRING_LEN(str);
+  ary = rb_ary_new();
+
+  while (base < len) {
+    n = eu_scan_delims(RSTRING_PTR(str) + base, len - base, delim, pos, EU_SPLIT_BATCH);
+    for (i = 0; i < n; i++) {
+      rb_ary_push(ary, rb_str_subseq(str, start, base + pos[i] - start));
+      start = base + pos[i] + 1;
+    }
+    if (n < EU_SPLIT_BATCH)
+      break;
+    base = start;
+  }
+  rb_ary_push(ary, rb_str_subseq(str, start, len - start));
+
+  while (RARRAY_LEN(ary) > 0 && RSTRING_LEN(RARRAY_AREF(ary, RARRAY_LEN(ary) - 1)) == 0)
+    rb_ary_pop(ary);
+
+  RB_GC_GUARD(str);
+  return ary;
+}
+
+static char eu_delim_arg(VALUE delim)
+{
+  StringValue(delim);
+  if (RSTRING_LEN(delim) != 1)
+    rb_raise(rb_eArgError, "delimiter must be a single byte");
+  return RSTRING_PTR(delim)[0];
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.split(str, delim) -> Array
+ *
+ * Split +str+ on the single-byte +delim+ with the current tokenizer
+ * kernel. Returns the same fields as String#split(delim).
+ */
+static VALUE
+native_split(VALUE self, VALUE str, VALUE delim)
+{
+  return eu_split(str, eu_delim_arg(delim));
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.tokenizer_kernels -> Array
+ *
+ * Names of the delimiter scanning kernels this CPU can run, fastest first.
+ */
+static VALUE
+native_tokenizer_kernels(VALUE self)
+{
+  VALUE ary = rb_ary_new();
+  int i;
+
+  for (i = 0; i < EU_NKERNELS; i++)
+    if ( eu_kernels[i].supported() )
+      rb_ary_push(ary, ID2SYM(rb_intern(eu_kernels[i].name)));
+  return ary;
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.tokenizer_kernel -> Symbol
+ *
+ * The delimiter scanning kernel in use.
+ */
+static VALUE
+native_tokenizer_kernel(VALUE self)
+{
+  return ID2SYM(rb_intern(eu_kernel->name));
+}
+
+/*
+ * call-seq:
+ *    EtcUtils::Native.tokenizer_kernel = name
+ *
+ * Switch the delimiter scanning kernel. Raises ArgumentError if +name+ is
+ * unknown or not supported by this CPU.
+ */
+static VALUE
+native_set_tokenizer_kernel(VALUE self, VALUE name)
+{
+  const char *cname;
+  int i;
+
+  if (SYMBOL_P(name))
+    name = rb_sym2str(name);
+  cname = StringValueCStr(name);
+
+  for (i = 0; i < EU_NKERNELS; i++) {
+    if ( strcmp(eu_kernels[i].name, cname) )
+      continue;
+    if ( !eu_kernels[i].supported() )
+      rb_raise(rb_eArgError, "tokenizer kernel not supported on this CPU: %s", cname);
+    eu_kernel = &eu_kernels[i];
+    return name;
+  }
+
+  rb_raise(rb_eArgError, "unknown tokenizer kernel: %s", cname);
+  return Qnil;
+}
+
+void Init_etcutils_tokenize(void)
+{
+  int i;
+
+  for (i = 0; i < EU_NKERNELS; i++)
+    if ( eu_kernels[i].supported() ) {
+      eu_kernel = &eu_kernels[i];
+      break;
+    }
+
+  rb_define_module_function(mNative, "split", native_split, 2);
+  rb_define_module_function(mNative, "tokenizer_kernels", native_tokenizer_kernels, 0);
+  rb_define_module_function(mNative, "tokenizer_kernel", native_tokenizer_kernel, 0);
+  rb_define_module_function(mNative, "tokenizer_kernel=", native_set_tokenizer_kernel, 1);
+}
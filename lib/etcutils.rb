@@ -87,50 +87,205 @@ module EtcUtils
       Backend::Registry.current.locked?
     end
 
+    # Current version token of a database file
+    #
+    # @param database [Symbol] :passwd, :group, :shadow or :gshadow
+    # @return [FileVersion, nil] version, or nil if the file does not exist
+    # @raise [UnsupportedError] if not supported on platform
+    def file_version(database)
+      Backend::Registry.current.file_version(database)
+    end
+
+    # Read a whole database together with its version token
+    #
+    # Changes can be prepared from the entries without holding the lock and
+    # committed by passing the version to the matching write method, which
+    # fails fast with ConcurrentModificationError if another writer got there
+    # first. The lock is then only held for the backup and rename.
+    #
+    # @param database [Symbol] :passwd, :group, :shadow or :gshadow
+    # @return [Array(Array<User, Group, Shadow, GShadow>, FileVersion)]
+    # @raise [UnsupportedError] if not supported on platform
+    #
+    # @example
+    #   users, version = EtcUtils.read_versioned(:passwd)
+    #   users << EtcUtils::User.new(name: "alice", uid: 1001, ...)
+    #   EtcUtils.write_passwd(users, expected_version: version)
+    def read_versioned(database)
+      entries, version = Backend::Registry.current.read_versioned(database)
+      klass = { passwd: User, group: Group, shadow: Shadow, gshadow: GShadow }.fetch(database)
+      [entries.map { |attrs| klass.new(**attrs) }, version]
+    end
+
     # Write passwd entries atomically
     #
     # @param entries [Array<User>] user entries to write
-    # @param backup [Boolean] create backup file first (default: true)
+    # @param backup [Boolean, Symbol] create backup file first (default: true);
+    #   :copy forces a full copy instead of a hardlink
     # @param dry_run [Boolean] validate only, don't write (default: false)
+    # @param validate [Boolean] raise ValidationError instead of writing
+    #   entries that fail validation (default: false)
+    # @param expected_version [FileVersion, nil] raise ConcurrentModificationError
+    #   unless the file is still at this version (see read_versioned)
     # @return [DryRunResult, nil] result if dry_run, nil otherwise
     # @raise [UnsupportedError] if writes not supported on platform
     # @raise [PermissionError] if insufficient permissions
     # @raise [LockError] if lock acquisition fails
-    def write_passwd(entries, backup: true, dry_run: false)
-      Backend::Registry.current.write_passwd(entries, backup: backup, dry_run: dry_run)
+    def write_passwd(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+      Backend::Registry.current.write_passwd(
+        entries, backup: backup, dry_run: dry_run, validate: validate, expected_version: expected_version
+      )
     end
 
     # Write group entries atomically
     #
     # @param entries [Array<Group>] group entries to write
-    # @param backup [Boolean] create backup file first (default: true)
+    # @param backup [Boolean, Symbol] create backup file first (default: true);
+    #   :copy forces a full copy instead of a hardlink
     # @param dry_run [Boolean] validate only, don't write (default: false)
+    # @param validate [Boolean] raise ValidationError instead of writing
+    #   entries that fail validation (default: false)
+    # @param expected_version [FileVersion, nil] raise ConcurrentModificationError
+    #   unless the file is still at this version (see read_versioned)
     # @return [DryRunResult, nil] result if dry_run, nil otherwise
     # @raise [UnsupportedError] if writes not supported on platform
-    def write_group(entries, backup: true, dry_run: false)
-      Backend::Registry.current.write_group(entries, backup: backup, dry_run: dry_run)
+    def write_group(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+      Backend::Registry.current.write_group(
+        entries, backup: backup, dry_run: dry_run, validate: validate, expected_version: expected_version
+      )
     end
 
     # Write shadow entries atomically (Linux only)
     #
     # @param entries [Array<Shadow>] shadow entries to write
-    # @param backup [Boolean] create backup file first (default: true)
+    # @param backup [Boolean, Symbol] create backup file first (default: true);
+    #   :copy forces a full copy instead of a hardlink
     # @param dry_run [Boolean] validate only, don't write (default: false)
+    # @param validate [Boolean] raise ValidationError instead of writing
+    #   entries that fail validation (default: false)
+    # @param expected_version [FileVersion, nil] raise ConcurrentModificationError
+    #   unless the file is still at this version (see read_versioned)
     # @return [DryRunResult, nil] result if dry_run, nil otherwise
     # @raise [UnsupportedError] if writes not supported on platform
-    def write_shadow(entries, backup: true, dry_run: false)
-      Backend::Registry.current.write_shadow(entries, backup: backup, dry_run: dry_run)
+    def write_shadow(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+      Backend::Registry.current.write_shadow(
+        entries, backup: backup, dry_run: dry_run, validate: validate, expected_version: expected_version
+      )
     end
 
     # Write gshadow entries atomically (Linux only)
     #
     # @param entries [Array<GShadow>] gshadow entries to write
-    # @param backup [Boolean] create backup file first (default: true)
+    # @param backup [Boolean, Symbol] create backup file first (default: true);
+    #   :copy forces a full copy instead of a hardlink
     # @param dry_run [Boolean] validate only, don't write (default: false)
+    # @param validate [Boolean] raise ValidationError instead of writing
+    #   entries that fail validation (default: false)
+    # @param expected_version [FileVersion, nil] raise ConcurrentModificationError
+    #   unless the file is still at this version (see read_versioned)
     # @return [DryRunResult, nil] result if dry_run, nil otherwise
     # @raise [UnsupportedError] if writes not supported on platform
-    def write_gshadow(entries, backup: true, dry_run: false)
-      Backend::Registry.current.write_gshadow(entries, backup: backup, dry_run: dry_run)
+    def write_gshadow(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+      Backend::Registry.current.write_gshadow(
+        entries, backup: backup, dry_run: dry_run, validate: validate, expected_version: expected_version
+      )
+    end
+
+    # Create many accounts in one locked pass (Linux only)
+    #
+    # Allocates UIDs and GIDs in bulk and adds the passwd, shadow, group and
+    # gshadow entries of every account, including a user private group and
+    # supplementary memberships. Each database is rewritten once.
+    #
+    # @param specs [Array<Hash>] one spec per account; see Provisioner for keys
+    # @param backup [Boolean, Symbol] create backup files first (default: true)
+    # @param dry_run [Boolean] plan and validate only, don't write (default: false)
+    # @return [Array<Hash>, DryRunResult] the new passwd entries, or the
+    #   combined result if dry_run
+    # @raise [UnsupportedError] if writes not supported on platform
+    # @raise [ValidationError] if a spec or the resulting files are invalid
+    #
+    # @example
+    #   EtcUtils.provision([
+    #     { name: "alice", groups: ["docker"] },
+    #     { name: "svc-backup", system: true, shell: "/usr/sbin/nologin" }
+    #   ])
+    def provision(specs, backup: true, dry_run: false)
+      Backend::Registry.current.provision(specs, backup: backup, dry_run: dry_run)
+    end
+
+    # Stream the field-level differences between two database snapshots
+    #
+    # Works on any pair of files or IOs, not just the live databases, and
+    # never holds either side fully in memory; see SnapshotDiff.
+    #
+    # @param old_io [IO, String] previous snapshot, or its path
+    # @param new_io [IO, String] current snapshot, or its path
+    # @param type [Symbol] :passwd, :group, :shadow, :gshadow, :subuid or :subgid
+    # @param options [Hash] max_pending: and partitions: tuning, see SnapshotDiff.each
+    # @yield [Hash] one change per added, removed or modified entry
+    # @return [Enumerator] if no block given
+    #
+    # @example
+    #   EtcUtils.diff("fleet/web1/passwd", "fleet/web2/passwd", type: :passwd) do |change|
+    #     puts "#{change[:type]} #{change[:name]} #{change[:fields]}"
+    #   end
+    def diff(old_io, new_io, type:, **options, &block)
+      SnapshotDiff.each(old_io, new_io, type: type, **options, &block)
+    end
+
+    # Load a read-only snapshot of a database that preforking servers can
+    # share with every worker (Linux only, requires the C extension)
+    #
+    # The entries are packed into one off-heap, read-only mapping, so
+    # loading the snapshot before fork costs each worker no extra memory.
+    #
+    # @param database [Symbol] :passwd, :group, :shadow, :gshadow, :subuid or :subgid
+    # @return [Snapshot]
+    # @raise [UnsupportedError] if not supported on platform
+    #
+    # @example
+    #   USERS = EtcUtils.snapshot(:passwd)   # in the master
+    #   USERS["alice"][:uid]                 # in a worker
+    def snapshot(database)
+      Backend::Registry.current.snapshot(database)
+    end
+
+    # Apply the same change to many root directories on a thread pool
+    #
+    # @param roots [Enumerable<String>] root directories (e.g. container rootfs)
+    # @param concurrency [Integer] number of worker threads (default: 8)
+    # @param lock [Boolean] hold each root's lock while its block runs
+    # @param timeout [Numeric] seconds to wait for each root's lock (default: 15)
+    # @yield [Backend::Linux, String] backend bound to the root, and the root
+    # @return [Array<Batch::Result>] one result per root, in input order
+    # @raise [UnsupportedError] if not supported on platform
+    # @see Batch.run
+    def batch(roots, concurrency: Batch::DEFAULT_CONCURRENCY, lock: true, timeout: 15, &block)
+      Batch.run(roots, concurrency: concurrency, lock: lock, timeout: timeout, &block)
+    end
+
+    # Whether parsed entries share frozen, deduplicated Strings for
+    # low-cardinality fields
+    #
+    # @return [Boolean] true if interning is enabled (default: false)
+    def intern_strings?
+      @intern_strings == true
+    end
+
+    # Enable or disable interning of low-cardinality fields
+    #
+    # When enabled, shells, group member and admin names, and password
+    # placeholders such as "x" or "!" are returned as frozen, deduplicated
+    # Strings, so a large enumeration holds one copy of each distinct value.
+    # Code that mutates those fields in place must leave this off.
+    #
+    # @param value [Boolean] enable interning
+    # @return [Boolean] the new setting
+    def intern_strings=(value)
+      @intern_strings = value ? true : false
+      Native.intern_strings = @intern_strings if defined?(Native) && Native.respond_to?(:intern_strings=)
+      @intern_strings
     end
 
     # Reset all cached state (primarily for testing)
@@ -197,9 +352,35 @@ else
   require_relative "etcutils/gshadow"
 end
 
-# Load dry run result
+# Load dry run result and lazily generated write content
+require_relative "etcutils/lazy_content"
 require_relative "etcutils/dry_run_result"
 
+# Load instrumentation events and counters
+require_relative "etcutils/instrumentation"
+
+# Load Fiber scheduler support for blocking file work
+require_relative "etcutils/blocking"
+
+# Load file versioning and line-offset index
+require_relative "etcutils/file_version"
+require_relative "etcutils/line_index"
+require_relative "etcutils/id_name_table"
+require_relative "etcutils/interval_tree"
+
+# Load entry validation
+require_relative "etcutils/validator"
+
+# Load account provisioning planner
+require_relative "etcutils/provisioner"
+
+# Load streaming snapshot diff and fork-shared snapshots
+require_relative "etcutils/snapshot_diff"
+require_relative "etcutils/snapshot"
+
+# Load streaming join helper
+require_relative "etcutils/merge_join"
+
 # Load backend infrastructure
 require_relative "etcutils/backend/base"
 require_relative "etcutils/backend/registry"
@@ -208,6 +389,9 @@ require_relative "etcutils/backend/registry"
 require_relative "etcutils/users"
 require_relative "etcutils/groups"
 
+# Load multi-root batch runner
+require_relative "etcutils/batch"
+
 # Load platform-specific backends based on current OS
 case EtcUtils::Platform.os
 when :linux
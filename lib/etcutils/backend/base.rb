@@ -13,9 +13,20 @@ module EtcUtils
     #   - platform_name: return :linux, :darwin, or :windows
     #   - capabilities: return capability hash
     #
+    # Methods with generic defaults (override for faster paths):
+    #   - count_users, count_groups: number of entries
+    #   - user_exists?, group_exists?: existence checks
+    #   - user_slice, group_slice: a window of entries
+    #   - reverse_each_user, reverse_each_group: iterate last to first
+    #
     # Optional methods (raise UnsupportedError by default):
     #   - each_shadow, each_gshadow, find_shadow, find_gshadow
+    #   - each_user_with_shadow, each_group_with_gshadow
     #   - write_passwd, write_group, write_shadow, write_gshadow
+    #   - each_subuid, each_subgid, write_subuid, write_subgid
+    #   - next_subuid, next_subgid, allocate_subuids, allocate_subgids
+    #   - provision
+    #   - snapshot
     #   - with_lock
     #
     class Base
@@ -51,6 +62,95 @@ module EtcUtils
         raise NotImplementedError, "#{self.class}#find_group must be implemented"
       end
 
+      # Count users in the system database
+      #
+      # @return [Integer] number of users
+      def count_users
+        each_user.count
+      end
+
+      # Count groups in the system database
+      #
+      # @return [Integer] number of groups
+      def count_groups
+        each_group.count
+      end
+
+      # Check whether a user exists
+      #
+      # @param identifier [String, Integer] username or UID
+      # @return [Boolean] true if the user exists
+      def user_exists?(identifier)
+        !find_user(identifier).nil?
+      end
+
+      # Check whether a group exists
+      #
+      # @param identifier [String, Integer] group name or GID
+      # @return [Boolean] true if the group exists
+      def group_exists?(identifier)
+        !find_group(identifier).nil?
+      end
+
+      # Return a window of users
+      #
+      # @param offset [Integer] index of the first user
+      # @param limit [Integer] maximum number of users
+      # @return [Array<Hash>] user attributes hashes
+      def user_slice(offset, limit)
+        return each_user.to_a[offset, limit] || [] if offset.negative?
+
+        each_user.lazy.drop(offset).first(limit)
+      end
+
+      # Return a window of groups
+      #
+      # @param offset [Integer] index of the first group
+      # @param limit [Integer] maximum number of groups
+      # @return [Array<Hash>] group attributes hashes
+      def group_slice(offset, limit)
+        return each_group.to_a[offset, limit] || [] if offset.negative?
+
+        each_group.lazy.drop(offset).first(limit)
+      end
+
+      # ID-to-name table covering every user
+      #
+      # The default builds a new table from each_user on every call;
+      # backends that can tell when their data changes cache it.
+      #
+      # @return [IdNameTable] UID-to-name table
+      def user_id_table
+        IdNameTable.build(each_user.map { |attrs| [attrs[:uid], attrs[:name]] })
+      end
+
+      # ID-to-name table covering every group
+      #
+      # @return [IdNameTable] GID-to-name table
+      def group_id_table
+        IdNameTable.build(each_group.map { |attrs| [attrs[:gid], attrs[:name]] })
+      end
+
+      # Iterate users from last to first
+      #
+      # @yield [Hash] user attributes hash
+      # @return [Enumerator] if no block given
+      def reverse_each_user(&block)
+        return to_enum(:reverse_each_user) unless block_given?
+
+        each_user.to_a.reverse_each(&block)
+      end
+
+      # Iterate groups from last to first
+      #
+      # @yield [Hash] group attributes hash
+      # @return [Enumerator] if no block given
+      def reverse_each_group(&block)
+        return to_enum(:reverse_each_group) unless block_given?
+
+        each_group.to_a.reverse_each(&block)
+      end
+
       # Iterate all shadow entries (Linux only by default)
       #
       # @yield [Hash] shadow attributes hash
@@ -89,52 +189,203 @@ module EtcUtils
         raise UnsupportedError.new(operation: "gshadow access", platform: platform_name)
       end
 
+      # Iterate users paired with their shadow entries
+      #
+      # @yield [Hash, nil, Hash, nil] user and shadow attributes; orphans on
+      #   either side are yielded with nil for the missing half
+      # @return [Enumerator] if no block given
+      # @raise [UnsupportedError] if not supported on platform
+      def each_user_with_shadow
+        raise UnsupportedError.new(operation: "shadow access", platform: platform_name)
+      end
+
+      # Iterate groups paired with their gshadow entries
+      #
+      # @yield [Hash, nil, Hash, nil] group and gshadow attributes; orphans on
+      #   either side are yielded with nil for the missing half
+      # @return [Enumerator] if no block given
+      # @raise [UnsupportedError] if not supported on platform
+      def each_group_with_gshadow
+        raise UnsupportedError.new(operation: "gshadow access", platform: platform_name)
+      end
+
+      # Current version token of a database file
+      #
+      # @param database [Symbol] :passwd, :group, :shadow or :gshadow
+      # @return [FileVersion, nil] version, or nil if the file does not exist
+      # @raise [UnsupportedError] if not supported on platform
+      def file_version(database)
+        raise UnsupportedError.new(operation: "versioned reads", platform: platform_name)
+      end
+
+      # Read every entry of a database with the version it was read from
+      #
+      # @param database [Symbol] :passwd, :group, :shadow or :gshadow
+      # @return [Array(Array<Hash>, FileVersion)] entries and version
+      # @raise [UnsupportedError] if not supported on platform
+      def read_versioned(database)
+        raise UnsupportedError.new(operation: "versioned reads", platform: platform_name)
+      end
+
       # Write passwd entries atomically
       #
       # @param entries [Array<Hash>] user entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] raise ValidationError for invalid entries
+      # @param expected_version [FileVersion, nil] version the entries were read from
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
       # @raise [UnsupportedError] if writes not supported
       # @raise [PermissionError] if insufficient permissions
       # @raise [LockError] if lock acquisition fails
-      def write_passwd(entries, backup: true, dry_run: false)
+      def write_passwd(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
         raise UnsupportedError.new(operation: "passwd writes", platform: platform_name)
       end
 
       # Write group entries atomically
       #
       # @param entries [Array<Hash>] group entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] raise ValidationError for invalid entries
+      # @param expected_version [FileVersion, nil] version the entries were read from
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
       # @raise [UnsupportedError] if writes not supported
-      def write_group(entries, backup: true, dry_run: false)
+      def write_group(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
         raise UnsupportedError.new(operation: "group writes", platform: platform_name)
       end
 
       # Write shadow entries atomically
       #
       # @param entries [Array<Hash>] shadow entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] raise ValidationError for invalid entries
+      # @param expected_version [FileVersion, nil] version the entries were read from
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
       # @raise [UnsupportedError] if writes not supported
-      def write_shadow(entries, backup: true, dry_run: false)
+      def write_shadow(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
         raise UnsupportedError.new(operation: "shadow writes", platform: platform_name)
       end
 
       # Write gshadow entries atomically
       #
       # @param entries [Array<Hash>] gshadow entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] raise ValidationError for invalid entries
+      # @param expected_version [FileVersion, nil] version the entries were read from
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
       # @raise [UnsupportedError] if writes not supported
-      def write_gshadow(entries, backup: true, dry_run: false)
+      def write_gshadow(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
         raise UnsupportedError.new(operation: "gshadow writes", platform: platform_name)
       end
 
+      # Iterate subordinate UID ranges
+      #
+      # @yield [Hash] :name, :start and :count
+      # @return [Enumerator] if no block given
+      # @raise [UnsupportedError] if not supported on platform
+      def each_subuid
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # Iterate subordinate GID ranges
+      #
+      # @yield [Hash] :name, :start and :count
+      # @return [Enumerator] if no block given
+      # @raise [UnsupportedError] if not supported on platform
+      def each_subgid
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # Write subuid entries atomically
+      #
+      # @param entries [Array<Hash>] entries with :name, :start and :count
+      # @param backup [Boolean, Symbol] create backup file first
+      # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] raise ValidationError for invalid entries
+      # @param expected_version [FileVersion, nil] version the entries were read from
+      # @return [DryRunResult, nil] result if dry_run, nil otherwise
+      # @raise [UnsupportedError] if writes not supported
+      def write_subuid(entries, backup: true, dry_run: false, expected_version: nil)
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # Write subgid entries atomically
+      #
+      # @param entries [Array<Hash>] entries with :name, :start and :count
+      # @param backup [Boolean, Symbol] create backup file first
+      # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] raise ValidationError for invalid entries
+      # @param expected_version [FileVersion, nil] version the entries were read from
+      # @return [DryRunResult, nil] result if dry_run, nil otherwise
+      # @raise [UnsupportedError] if writes not supported
+      def write_subgid(entries, backup: true, dry_run: false, expected_version: nil)
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # First free subordinate UID range
+      #
+      # @param count [Integer] number of IDs needed
+      # @param min [Integer] lowest ID that may be assigned
+      # @param max [Integer] highest ID that may be assigned
+      # @return [Integer] first ID of the range
+      # @raise [UnsupportedError] if not supported on platform
+      def next_subuid(count:, min:, max:)
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # First free subordinate GID range
+      #
+      # @param count [Integer] number of IDs needed
+      # @param min [Integer] lowest ID that may be assigned
+      # @param max [Integer] highest ID that may be assigned
+      # @return [Integer] first ID of the range
+      # @raise [UnsupportedError] if not supported on platform
+      def next_subgid(count:, min:, max:)
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # Assign the first free subordinate UID range to each owner
+      #
+      # @param owners [String, Array<String>] owner names or UIDs
+      # @return [Array<Hash>] the new entries
+      # @raise [UnsupportedError] if not supported on platform
+      def allocate_subuids(owners, count:, min:, max:, backup: true)
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # Assign the first free subordinate GID range to each owner
+      #
+      # @param owners [String, Array<String>] owner names or UIDs
+      # @return [Array<Hash>] the new entries
+      # @raise [UnsupportedError] if not supported on platform
+      def allocate_subgids(owners, count:, min:, max:, backup: true)
+        raise UnsupportedError.new(operation: "subordinate ID ranges", platform: platform_name)
+      end
+
+      # Create many accounts in one pass
+      #
+      # @param specs [Array<Hash>] one spec per account
+      # @param backup [Boolean, Symbol] create backup files first
+      # @param dry_run [Boolean] plan and validate only, don't write
+      # @return [Array<Hash>, DryRunResult] the new passwd entries, or the
+      #   combined result if dry_run
+      # @raise [UnsupportedError] if writes not supported
+      def provision(specs, backup: true, dry_run: false)
+        raise UnsupportedError.new(operation: "provisioning", platform: platform_name)
+      end
+
+      # Load a read-only, fork-shared snapshot of a database
+      #
+      # @param database [Symbol] database to load
+      # @return [Snapshot]
+      # @raise [UnsupportedError] if not supported on platform
+      def snapshot(database)
+        raise UnsupportedError.new(operation: "snapshots", platform: platform_name)
+      end
+
       # Execute block with system-wide password file lock
       #
       # @param timeout [Integer] seconds to wait for lock
@@ -17,11 +17,29 @@ module EtcUtils
     #   - No shadow/gshadow support (macOS uses different authentication)
     #   - No file locking (not applicable on macOS)
     #
+    # Each directory is read with a single `dscl . -readall` call whose
+    # multi-record output is parsed as it streams in. The parsed records are
+    # cached for CACHE_TTL seconds; lookups by name or ID are served from
+    # indexes built over the cache instead of spawning dscl again.
+    #
     class Darwin < Base
       DSCL_PATH = "/usr/bin/dscl"
       LOCAL_NODE = "."
+      CACHE_TTL = 30
+
+      # A key ends at the first colon followed by a space or end of line
+      DSCL_KEY = /\A(\S+?):(?: (.*))?\z/.freeze
+      private_constant :DSCL_KEY
+
+      # @return [String] path of the dscl executable
+      attr_reader :dscl_path
 
-      def initialize
+      # @param dscl_path [String] dscl executable to run
+      # @param cache_ttl [Numeric] seconds a directory read stays cached
+      def initialize(dscl_path: DSCL_PATH, cache_ttl: CACHE_TTL)
+        @dscl_path = dscl_path
+        @cache_ttl = cache_ttl
+        @cache_lock = Mutex.new
         @user_cache = nil
         @group_cache = nil
       end
@@ -30,26 +48,20 @@ module EtcUtils
       #
       # @yield [Hash] user attributes hash
       # @return [Enumerator] if no block given
-      def each_user
+      def each_user(&block)
         return to_enum(:each_user) unless block_given?
 
-        list_users.each do |username|
-          attrs = read_user(username)
-          yield attrs if attrs
-        end
+        user_cache[:entries].each(&block)
       end
 
       # Iterate all groups from Directory Services
       #
       # @yield [Hash] group attributes hash
       # @return [Enumerator] if no block given
-      def each_group
+      def each_group(&block)
         return to_enum(:each_group) unless block_given?
 
-        list_groups.each do |groupname|
-          attrs = read_group(groupname)
-          yield attrs if attrs
-        end
+        group_cache[:entries].each(&block)
       end
 
       # Find user by name or UID
@@ -57,22 +69,38 @@ module EtcUtils
       # @param identifier [String, Integer] username or UID
       # @return [Hash, nil] user attributes or nil if not found
       def find_user(identifier)
+        cache = user_cache
         if identifier.is_a?(Integer)
-          find_user_by_uid(identifier)
+          cache[:by_id][identifier]
         else
-          read_user(identifier.to_s)
+          cache[:by_name][identifier.to_s]
         end
       end
 
+      # UID-to-name table from the cached dscl records
+      #
+      # @return [IdNameTable]
+      def user_id_table
+        user_cache[:id_names]
+      end
+
+      # GID-to-name table from the cached dscl records
+      #
+      # @return [IdNameTable]
+      def group_id_table
+        group_cache[:id_names]
+      end
+
       # Find group by name or GID
       #
       # @param identifier [String, Integer] group name or GID
       # @return [Hash, nil] group attributes or nil if not found
       def find_group(identifier)
+        cache = group_cache
         if identifier.is_a?(Integer)
-          find_group_by_gid(identifier)
+          cache[:by_id][identifier]
         else
-          read_group(identifier.to_s)
+          cache[:by_name][identifier.to_s]
         end
       end
 
@@ -103,74 +131,104 @@ module EtcUtils
       #
       # @return [void]
       def clear_cache
-        @user_cache = nil
-        @group_cache = nil
+        @cache_lock.synchronize do
+          @user_cache = nil
+          @group_cache = nil
+        end
       end
 
       private
 
-      # List all usernames from Directory Services
-      def list_users
-        output = dscl_list("/Users")
-        return [] unless output
-
-        output.lines.map(&:strip).reject do |name|
-          name.empty? || name.start_with?("_")
+      # Users read by the last dscl call, refreshed once it expires
+      def user_cache
+        @cache_lock.synchronize do
+          @user_cache = nil if expired?(@user_cache)
+          count_cache_lookup(:users, @user_cache)
+          @user_cache ||= build_cache(read_all("/Users") { |attrs| user_attributes(attrs) }, :uid)
         end
       end
 
-      # List all group names from Directory Services
-      def list_groups
-        output = dscl_list("/Groups")
-        return [] unless output
-
-        output.lines.map(&:strip).reject do |name|
-          name.empty? || name.start_with?("_")
+      # Groups read by the last dscl call, refreshed once it expires
+      def group_cache
+        @cache_lock.synchronize do
+          @group_cache = nil if expired?(@group_cache)
+          count_cache_lookup(:groups, @group_cache)
+          @group_cache ||= build_cache(read_all("/Groups") { |attrs| group_attributes(attrs) }, :gid)
         end
       end
 
-      # Read user attributes by name
-      def read_user(username)
-        output = dscl_read("/Users/#{username}")
-        return nil unless output
+      def count_cache_lookup(cache, current)
+        return unless Instrumentation.enabled?
 
-        parse_user_output(output, username)
-      rescue Errno::ENOENT
-        nil
+        Instrumentation.publish(current ? :cache_hit : :cache_miss, nil, cache: cache)
       end
 
-      # Read group attributes by name
-      def read_group(groupname)
-        output = dscl_read("/Groups/#{groupname}")
-        return nil unless output
+      def expired?(cache)
+        cache && Process.clock_gettime(Process::CLOCK_MONOTONIC) - cache[:loaded_at] > @cache_ttl
+      end
 
-        parse_group_output(output, groupname)
-      rescue Errno::ENOENT
-        nil
+      # Index entries by name and ID; the first record wins, as with getpwnam.
+      # System accounts (names starting with "_") can be looked up but are
+      # left out of the entries each_user and each_group yield, as before.
+      def build_cache(entries, id_key)
+        by_name = {}
+        by_id = {}
+        entries.each do |attrs|
+          by_name[attrs[:name]] ||= attrs
+          by_id[attrs[id_key]] ||= attrs unless attrs[id_key].nil?
+        end
+
+        {
+          entries: entries.reject { |attrs| attrs[:name].start_with?("_") }.freeze,
+          by_name: by_name,
+          by_id: by_id,
+          id_names: IdNameTable.build(by_id.map { |id, attrs| [id, attrs[:name]] }),
+          loaded_at: Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        }
       end
 
-      # Find user by UID (requires iteration)
-      def find_user_by_uid(uid)
-        each_user do |attrs|
-          return attrs if attrs[:uid] == uid
+      # Read every record of a directory with one `dscl . -readall` call
+      def read_all(path)
+        entries = []
+        each_dscl_record("-readall", path) do |attrs|
+          name = attrs["RecordName"]&.first&.split&.first
+          next if name.nil?
+
+          attrs["RecordName"] = [name]
+          entries << yield(attrs)
         end
-        nil
+        entries
       end
 
-      # Find group by GID (requires iteration)
-      def find_group_by_gid(gid)
-        each_group do |attrs|
-          return attrs if attrs[:gid] == gid
+      # Stream records from dscl output; records are separated by a line
+      # holding a single "-"
+      def each_dscl_record(*args)
+        require "open3"
+
+        Instrumentation.instrument(:dscl_spawn, args: args) do
+          Open3.popen2(dscl_path, LOCAL_NODE, *args) do |stdin, stdout, wait|
+            stdin.close
+            record = []
+            stdout.each_line do |line|
+              if line.chomp == "-"
+                yield parse_dscl_output(record) unless record.empty?
+                record = []
+              else
+                record << line
+              end
+            end
+            yield parse_dscl_output(record) unless record.empty?
+            wait.value
+          end
         end
+      rescue Errno::ENOENT
         nil
       end
 
-      # Parse dscl user output into attributes hash
-      def parse_user_output(output, username)
-        attrs = parse_dscl_output(output)
-
+      # Convert a parsed dscl user record into attributes hash
+      def user_attributes(attrs)
         {
-          name: username,
+          name: attrs["RecordName"].first,
           passwd: "x", # macOS doesn't expose passwords
           uid: attrs["UniqueID"]&.first&.to_i,
           gid: attrs["PrimaryGroupID"]&.first&.to_i,
@@ -184,16 +242,14 @@ module EtcUtils
         }
       end
 
-      # Parse dscl group output into attributes hash
-      def parse_group_output(output, groupname)
-        attrs = parse_dscl_output(output)
-
+      # Convert a parsed dscl group record into attributes hash
+      def group_attributes(attrs)
         # GroupMembership is space-separated on a single line
         members_str = attrs["GroupMembership"]&.first || ""
         members = members_str.split
 
         {
-          name: groupname,
+          name: attrs["RecordName"].first,
           passwd: "*",
           gid: attrs["PrimaryGroupID"]&.first&.to_i,
           members: members
@@ -208,18 +264,21 @@ module EtcUtils
       #    value1 (continuation lines with leading space)
       #    value2
       #
+      # Native attribute keys contain colons themselves
+      # ("dsAttrTypeNative:accountPolicyData:"), so a key ends at the first
+      # colon that is followed by a space or the end of the line.
       def parse_dscl_output(output)
         result = {}
         current_key = nil
 
-        output.each_line do |line|
+        output.each do |line|
           line = line.chomp
           if line.start_with?(" ")
             # Continuation line - value is indented
             result[current_key] << line.strip if current_key && !line.strip.empty?
-          elsif line.include?(":")
-            key, value = line.split(":", 2)
-            current_key = key.strip
+          elsif (match = DSCL_KEY.match(line))
+            key, value = match.captures
+            current_key = key
             result[current_key] = []
             # Handle space-separated values on the same line
             if value && !value.strip.empty?
@@ -241,24 +300,6 @@ module EtcUtils
         # Split by space and take first token for fields that may have multiple values
         value.split.first
       end
-
-      # Execute dscl list command
-      def dscl_list(path)
-        output, status = run_dscl("-list", path)
-        status.success? ? output : nil
-      end
-
-      # Execute dscl read command
-      def dscl_read(path)
-        output, status = run_dscl("-read", path)
-        status.success? ? output : nil
-      end
-
-      # Run dscl command with arguments
-      def run_dscl(*args)
-        require "open3"
-        Open3.capture2(DSCL_PATH, LOCAL_NODE, *args)
-      end
     end
 
     # Register the Darwin backend
@@ -1,5 +1,8 @@
 # frozen_string_literal: true
 
+require "monitor"
+require "set"
+
 module EtcUtils
   module Backend
     # Linux backend implementation
@@ -10,21 +13,91 @@ module EtcUtils
     #   - /etc/shadow for shadow password data (requires root)
     #   - /etc/group for group definitions
     #   - /etc/gshadow for group shadow data (requires root)
+    #   - /etc/subuid and /etc/subgid for subordinate ID ranges
     #
     # Write operations use atomic file replacement with backup support
     # and file locking via lckpwdf(3).
     #
+    # A single instance is shared by every thread. Reads take no locks and
+    # never block each other. Writers first take an in-process writer lock,
+    # then the cross-process file lock; both are owned by the calling thread
+    # and are reentrant, so nested with_lock blocks keep the lock held until
+    # the outermost block returns.
+    #
+    # A backend can also be bound to a root directory, like
+    # `useradd --prefix`, to manage the databases of a chroot or container
+    # rootfs. Every path, including the lock file, is then resolved under
+    # that root, and each instance has its own locks.
+    #
+    # @example Edit a container image's users
+    #   backend = EtcUtils::Backend::Linux.new(root: "/srv/images/web")
+    #   EtcUtils::UserCollection.new(backend).get("www-data")
+    #
     class Linux < Base
       PASSWD_FILE = "/etc/passwd"
       SHADOW_FILE = "/etc/shadow"
       GROUP_FILE = "/etc/group"
       GSHADOW_FILE = "/etc/gshadow"
+      SUBUID_FILE = "/etc/subuid"
+      SUBGID_FILE = "/etc/subgid"
       LOCK_FILE = "/etc/.pwd.lock"
       LOCK_TIMEOUT = 15
-
-      def initialize
-        @locked = false
+      LOCK_POLL_INTERVAL = 0.1
+      WRITE_CHUNK_ENTRIES = 1024
+      MISS_CACHE_LIMIT = 4096
+      # login.defs defaults for SUB_UID_MIN/MAX/COUNT (and SUB_GID_*)
+      SUBID_MIN = 100_000
+      SUBID_MAX = 600_100_000
+      SUBID_COUNT = 65_536
+      # Files written by provision, in dependency order, with their modes
+      PROVISION_FILES = { passwd: 0o644, group: 0o644, shadow: 0o640, gshadow: 0o640 }.freeze
+
+      # @return [String, nil] root directory, or nil for the running system
+      attr_reader :root
+
+      # @return [String] path of the passwd database
+      attr_reader :passwd_path
+
+      # @return [String] path of the shadow database
+      attr_reader :shadow_path
+
+      # @return [String] path of the group database
+      attr_reader :group_path
+
+      # @return [String] path of the gshadow database
+      attr_reader :gshadow_path
+
+      # @return [String] path of the subuid database
+      attr_reader :subuid_path
+
+      # @return [String] path of the subgid database
+      attr_reader :subgid_path
+
+      # @return [String] path of the lock file
+      attr_reader :lock_path
+
+      # @param root [String, nil] directory the database paths are resolved
+      #   under; nil uses the running system's /etc
+      def initialize(root: nil)
+        @root = root && File.expand_path(root)
+        @root = nil if @root == "/"
+        @passwd_path = rooted(PASSWD_FILE)
+        @shadow_path = rooted(SHADOW_FILE)
+        @group_path = rooted(GROUP_FILE)
+        @gshadow_path = rooted(GSHADOW_FILE)
+        @subuid_path = rooted(SUBUID_FILE)
+        @subgid_path = rooted(SUBGID_FILE)
+        @lock_path = rooted(LOCK_FILE)
+        @writer = Monitor.new
+        @writer_handoff = Mutex.new
+        @writer_released = ConditionVariable.new
+        @lock_depth = 0
         @lock_file = nil
+        @cache_lock = Mutex.new
+        @line_indexes = {}
+        @id_tables = {}
+        @misses = {}
+        @subid_trees = {}
       end
 
       # Iterate all users from /etc/passwd
@@ -34,12 +107,7 @@ module EtcUtils
       def each_user
         return to_enum(:each_user) unless block_given?
 
-        File.foreach(PASSWD_FILE) do |line|
-          next if line.strip.empty? || line.start_with?("#")
-
-          attrs = parse_passwd_line(line)
-          yield attrs if attrs
-        end
+        each_entry(passwd_path, method(:parse_passwd_line)) { |attrs| yield attrs }
       end
 
       # Iterate all groups from /etc/group
@@ -49,12 +117,7 @@ module EtcUtils
       def each_group
         return to_enum(:each_group) unless block_given?
 
-        File.foreach(GROUP_FILE) do |line|
-          next if line.strip.empty? || line.start_with?("#")
-
-          attrs = parse_group_line(line)
-          yield attrs if attrs
-        end
+        each_entry(group_path, method(:parse_group_line)) { |attrs| yield attrs }
       end
 
       # Find user by name or UID
@@ -62,14 +125,11 @@ module EtcUtils
       # @param identifier [String, Integer] username or UID
       # @return [Hash, nil] user attributes or nil if not found
       def find_user(identifier)
-        each_user do |attrs|
-          if identifier.is_a?(Integer)
-            return attrs if attrs[:uid] == identifier
-          else
-            return attrs if attrs[:name] == identifier.to_s
+        lookup(passwd_path, identifier) do
+          each_user.find do |attrs|
+            identifier.is_a?(Integer) ? attrs[:uid] == identifier : attrs[:name] == identifier.to_s
           end
         end
-        nil
       end
 
       # Find group by name or GID
@@ -77,14 +137,108 @@ module EtcUtils
       # @param identifier [String, Integer] group name or GID
       # @return [Hash, nil] group attributes or nil if not found
       def find_group(identifier)
-        each_group do |attrs|
-          if identifier.is_a?(Integer)
-            return attrs if attrs[:gid] == identifier
-          else
-            return attrs if attrs[:name] == identifier.to_s
+        lookup(group_path, identifier) do
+          each_group.find do |attrs|
+            identifier.is_a?(Integer) ? attrs[:gid] == identifier : attrs[:name] == identifier.to_s
           end
         end
-        nil
+      end
+
+      # Count users in /etc/passwd without parsing entries
+      #
+      # @return [Integer] number of entry lines with all seven fields, the
+      #   ones each_user yields
+      def count_users
+        count_entries(passwd_path, 7)
+      end
+
+      # Count groups in /etc/group without parsing entries
+      #
+      # @return [Integer] number of entry lines with all four fields, the
+      #   ones each_group yields
+      def count_groups
+        count_entries(group_path, 4)
+      end
+
+      # Check whether a user exists by comparing only the name or UID field
+      #
+      # @param identifier [String, Integer] username or UID
+      # @return [Boolean] true if the user exists
+      def user_exists?(identifier)
+        field = identifier.is_a?(Integer) ? 2 : 0
+        !lookup(passwd_path, identifier) { find_line(passwd_path, field, identifier) }.nil?
+      end
+
+      # Check whether a group exists by comparing only the name or GID field
+      #
+      # @param identifier [String, Integer] group name or GID
+      # @return [Boolean] true if the group exists
+      def group_exists?(identifier)
+        field = identifier.is_a?(Integer) ? 2 : 0
+        !lookup(group_path, identifier) { find_line(group_path, field, identifier) }.nil?
+      end
+
+      # Return a window of users using the line-offset index
+      #
+      # The first call builds an index of /etc/passwd; later calls seek
+      # straight to the requested entries and parse only those lines.
+      #
+      # @param offset [Integer] index of the first user (negative counts from the end)
+      # @param limit [Integer] maximum number of users
+      # @return [Array<Hash>] user attributes hashes
+      def user_slice(offset, limit)
+        indexed_lines(passwd_path, offset, limit).filter_map { |line| parse_passwd_line(line) }
+      end
+
+      # Return a window of groups using the line-offset index
+      #
+      # @param offset [Integer] index of the first group (negative counts from the end)
+      # @param limit [Integer] maximum number of groups
+      # @return [Array<Hash>] group attributes hashes
+      def group_slice(offset, limit)
+        indexed_lines(group_path, offset, limit).filter_map { |line| parse_group_line(line) }
+      end
+
+      # Iterate users from last to first using the line-offset index
+      #
+      # @yield [Hash] user attributes hash
+      # @return [Enumerator] if no block given
+      # @raise [ConcurrentModificationError] if the file is replaced mid-iteration
+      def reverse_each_user
+        return to_enum(:reverse_each_user) unless block_given?
+
+        line_index(passwd_path).reverse_each_line do |line|
+          attrs = parse_passwd_line(line)
+          yield attrs if attrs
+        end
+      end
+
+      # Iterate groups from last to first using the line-offset index
+      #
+      # @yield [Hash] group attributes hash
+      # @return [Enumerator] if no block given
+      # @raise [ConcurrentModificationError] if the file is replaced mid-iteration
+      def reverse_each_group
+        return to_enum(:reverse_each_group) unless block_given?
+
+        line_index(group_path).reverse_each_line do |line|
+          attrs = parse_group_line(line)
+          yield attrs if attrs
+        end
+      end
+
+      # UID-to-name table, rebuilt when /etc/passwd changes
+      #
+      # @return [IdNameTable]
+      def user_id_table
+        id_table(passwd_path)
+      end
+
+      # GID-to-name table, rebuilt when /etc/group changes
+      #
+      # @return [IdNameTable]
+      def group_id_table
+        id_table(group_path)
       end
 
       # Iterate all shadow entries from /etc/shadow
@@ -96,13 +250,7 @@ module EtcUtils
         return to_enum(:each_shadow) unless block_given?
 
         check_shadow_permission
-
-        File.foreach(SHADOW_FILE) do |line|
-          next if line.strip.empty? || line.start_with?("#")
-
-          attrs = parse_shadow_line(line)
-          yield attrs if attrs
-        end
+        each_entry(shadow_path, method(:parse_shadow_line)) { |attrs| yield attrs }
       end
 
       # Iterate all gshadow entries from /etc/gshadow
@@ -114,13 +262,7 @@ module EtcUtils
         return to_enum(:each_gshadow) unless block_given?
 
         check_gshadow_permission
-
-        File.foreach(GSHADOW_FILE) do |line|
-          next if line.strip.empty? || line.start_with?("#")
-
-          attrs = parse_gshadow_line(line)
-          yield attrs if attrs
-        end
+        each_entry(gshadow_path, method(:parse_gshadow_line)) { |attrs| yield attrs }
       end
 
       # Find shadow entry by username
@@ -129,10 +271,10 @@ module EtcUtils
       # @return [Hash, nil] shadow attributes or nil
       # @raise [PermissionError] if insufficient permissions
       def find_shadow(name)
-        each_shadow do |attrs|
-          return attrs if attrs[:name] == name.to_s
+        check_shadow_permission
+        lookup(shadow_path, name.to_s) do
+          each_shadow.find { |attrs| attrs[:name] == name.to_s }
         end
-        nil
       end
 
       # Find gshadow entry by group name
@@ -141,130 +283,354 @@ module EtcUtils
       # @return [Hash, nil] gshadow attributes or nil
       # @raise [PermissionError] if insufficient permissions
       def find_gshadow(name)
-        each_gshadow do |attrs|
-          return attrs if attrs[:name] == name.to_s
+        check_gshadow_permission
+        lookup(gshadow_path, name.to_s) do
+          each_gshadow.find { |attrs| attrs[:name] == name.to_s }
         end
-        nil
+      end
+
+      # Iterate users paired with their shadow entries in a single pass
+      #
+      # Reads /etc/passwd and /etc/shadow together using MergeJoin, so an
+      # audit over both halves of every account costs one read of each file.
+      #
+      # @yield [Hash, nil, Hash, nil] user and shadow attributes; a user with
+      #   no shadow entry (or a shadow entry with no user) is yielded with nil
+      #   for the missing half
+      # @return [Enumerator] if no block given
+      # @raise [PermissionError] if insufficient permissions
+      def each_user_with_shadow(&block)
+        return to_enum(:each_user_with_shadow) unless block_given?
+
+        check_shadow_permission
+
+        File.open(passwd_path) do |passwd|
+          File.open(shadow_path) do |shadow|
+            MergeJoin.each(
+              entry_reader(passwd, :parse_passwd_line),
+              entry_reader(shadow, :parse_shadow_line),
+              &block
+            )
+          end
+        end
+      end
+
+      # Iterate groups paired with their gshadow entries in a single pass
+      #
+      # @yield [Hash, nil, Hash, nil] group and gshadow attributes; orphans on
+      #   either side are yielded with nil for the missing half
+      # @return [Enumerator] if no block given
+      # @raise [PermissionError] if insufficient permissions
+      def each_group_with_gshadow(&block)
+        return to_enum(:each_group_with_gshadow) unless block_given?
+
+        check_gshadow_permission
+
+        File.open(group_path) do |group|
+          File.open(gshadow_path) do |gshadow|
+            MergeJoin.each(
+              entry_reader(group, :parse_group_line),
+              entry_reader(gshadow, :parse_gshadow_line),
+              &block
+            )
+          end
+        end
+      end
+
+      # Current version token of a database file
+      #
+      # @param database [Symbol] :passwd, :group, :shadow, :gshadow, :subuid
+      #   or :subgid
+      # @return [FileVersion, nil] version, or nil if the file does not exist
+      def file_version(database)
+        FileVersion.of(database_path(database))
+      end
+
+      # Read every entry of a database together with the version it was
+      # read from. Pass the version as expected_version: to the matching
+      # write_* to detect changes made in between.
+      #
+      # @param database [Symbol] :passwd, :group, :shadow, :gshadow, :subuid
+      #   or :subgid
+      # @return [Array(Array<Hash>, FileVersion)] entries and version
+      # @raise [PermissionError] if the file cannot be read
+      # @raise [ConcurrentModificationError] if the file keeps changing
+      #   while it is read
+      def read_versioned(database)
+        path = database_path(database)
+        check_shadow_permission if database == :shadow
+        check_gshadow_permission if database == :gshadow
+        parser = method(:"parse_#{database}_line")
+
+        2.times do
+          result = Blocking.call { read_consistent(path, parser) }
+          return result if result
+        end
+
+        raise ConcurrentModificationError.new(path: path)
       end
 
       # Write passwd entries atomically
       #
       # @param entries [Array<User, Hash>] user entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first; :copy
+      #   forces a full copy instead of hardlinking the old file
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] refuse to write entries that fail
+      #   validation instead of writing them as given
+      # @param expected_version [FileVersion, nil] fail unless the file is
+      #   still at this version when the lock is taken
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
       # @raise [PermissionError] if insufficient permissions
+      # @raise [ValidationError] if validate and the entries fail validation
+      # @raise [ConcurrentModificationError] if expected_version is stale
       # @raise [LockError] if lock acquisition fails
-      def write_passwd(entries, backup: true, dry_run: false)
-        check_write_permission(PASSWD_FILE)
-
-        content = entries.map { |e| entry_to_passwd_line(e) }.join("\n") + "\n"
-        changes = calculate_changes(PASSWD_FILE, entries, :passwd)
-
-        if dry_run
-          return DryRunResult.new(
-            content: content,
-            path: PASSWD_FILE,
-            changes: changes,
-            metadata: { entry_count: entries.length }
-          )
-        end
+      def write_passwd(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+        check_write_permission(passwd_path)
+        check_version(passwd_path, expected_version) unless dry_run
 
-        with_lock do
-          create_backup(PASSWD_FILE) if backup
-          atomic_write(PASSWD_FILE, content, mode: 0o644)
-        end
+        report = Validator.passwd(entries, root: root) if dry_run || validate
+        return dry_run_result(passwd_path, :passwd, entries, report, expected_version) if dry_run
 
+        raise_invalid(passwd_path, report) if validate
+        commit_write(passwd_path, :passwd, entries, 0o644, backup, expected_version)
         nil
       end
 
       # Write group entries atomically
       #
       # @param entries [Array<Group, Hash>] group entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first; :copy
+      #   forces a full copy instead of hardlinking the old file
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] refuse to write entries that fail
+      #   validation instead of writing them as given
+      # @param expected_version [FileVersion, nil] fail unless the file is
+      #   still at this version when the lock is taken
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
-      def write_group(entries, backup: true, dry_run: false)
-        check_write_permission(GROUP_FILE)
-
-        content = entries.map { |e| entry_to_group_line(e) }.join("\n") + "\n"
-        changes = calculate_changes(GROUP_FILE, entries, :group)
-
-        if dry_run
-          return DryRunResult.new(
-            content: content,
-            path: GROUP_FILE,
-            changes: changes,
-            metadata: { entry_count: entries.length }
-          )
-        end
+      # @raise [ValidationError] if validate and the entries fail validation
+      # @raise [ConcurrentModificationError] if expected_version is stale
+      def write_group(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+        check_write_permission(group_path)
+        check_version(group_path, expected_version) unless dry_run
 
-        with_lock do
-          create_backup(GROUP_FILE) if backup
-          atomic_write(GROUP_FILE, content, mode: 0o644)
-        end
+        report = Validator.group(entries, users: names_in(passwd_path)) if dry_run || validate
+        return dry_run_result(group_path, :group, entries, report, expected_version) if dry_run
 
+        raise_invalid(group_path, report) if validate
+        commit_write(group_path, :group, entries, 0o644, backup, expected_version)
         nil
       end
 
       # Write shadow entries atomically
       #
       # @param entries [Array<Shadow, Hash>] shadow entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first; :copy
+      #   forces a full copy instead of hardlinking the old file
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] refuse to write entries that fail
+      #   validation instead of writing them as given
+      # @param expected_version [FileVersion, nil] fail unless the file is
+      #   still at this version when the lock is taken
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
-      def write_shadow(entries, backup: true, dry_run: false)
-        check_write_permission(SHADOW_FILE)
-
-        content = entries.map { |e| entry_to_shadow_line(e) }.join("\n") + "\n"
-        changes = calculate_changes(SHADOW_FILE, entries, :shadow)
-
-        if dry_run
-          return DryRunResult.new(
-            content: content,
-            path: SHADOW_FILE,
-            changes: changes,
-            metadata: { entry_count: entries.length }
-          )
-        end
+      # @raise [ValidationError] if validate and the entries fail validation
+      # @raise [ConcurrentModificationError] if expected_version is stale
+      def write_shadow(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+        check_write_permission(shadow_path)
+        check_version(shadow_path, expected_version) unless dry_run
 
-        with_lock do
-          create_backup(SHADOW_FILE) if backup
-          atomic_write(SHADOW_FILE, content, mode: 0o640)
-        end
+        report = Validator.shadow(entries, users: names_in(passwd_path)) if dry_run || validate
+        return dry_run_result(shadow_path, :shadow, entries, report, expected_version) if dry_run
 
+        raise_invalid(shadow_path, report) if validate
+        commit_write(shadow_path, :shadow, entries, 0o640, backup, expected_version)
         nil
       end
 
       # Write gshadow entries atomically
       #
       # @param entries [Array<GShadow, Hash>] gshadow entries to write
-      # @param backup [Boolean] create backup file first
+      # @param backup [Boolean, Symbol] create backup file first; :copy
+      #   forces a full copy instead of hardlinking the old file
       # @param dry_run [Boolean] validate only, don't write
+      # @param validate [Boolean] refuse to write entries that fail
+      #   validation instead of writing them as given
+      # @param expected_version [FileVersion, nil] fail unless the file is
+      #   still at this version when the lock is taken
       # @return [DryRunResult, nil] result if dry_run, nil otherwise
-      def write_gshadow(entries, backup: true, dry_run: false)
-        check_write_permission(GSHADOW_FILE)
-
-        content = entries.map { |e| entry_to_gshadow_line(e) }.join("\n") + "\n"
-        changes = calculate_changes(GSHADOW_FILE, entries, :gshadow)
-
-        if dry_run
-          return DryRunResult.new(
-            content: content,
-            path: GSHADOW_FILE,
-            changes: changes,
-            metadata: { entry_count: entries.length }
-          )
-        end
+      # @raise [ValidationError] if validate and the entries fail validation
+      # @raise [ConcurrentModificationError] if expected_version is stale
+      def write_gshadow(entries, backup: true, dry_run: false, validate: false, expected_version: nil)
+        check_write_permission(gshadow_path)
+        check_version(gshadow_path, expected_version) unless dry_run
 
-        with_lock do
-          create_backup(GSHADOW_FILE) if backup
-          atomic_write(GSHADOW_FILE, content, mode: 0o640)
-        end
+        report = Validator.gshadow(entries, users: names_in(passwd_path), groups: names_in(group_path)) if dry_run || validate
+        return dry_run_result(gshadow_path, :gshadow, entries, report, expected_version) if dry_run
 
+        raise_invalid(gshadow_path, report) if validate
+        commit_write(gshadow_path, :gshadow, entries, 0o640, backup, expected_version)
         nil
       end
 
+      # Iterate subordinate UID ranges from /etc/subuid
+      #
+      # A missing file has no ranges. Owners may hold several ranges.
+      #
+      # @yield [Hash] :name (owner name or UID), :start and :count
+      # @return [Enumerator] if no block given
+      def each_subuid(&block)
+        return to_enum(:each_subuid) unless block
+
+        each_subid(subuid_path, &block)
+      end
+
+      # Iterate subordinate GID ranges from /etc/subgid
+      #
+      # @yield [Hash] :name (owner name or UID), :start and :count
+      # @return [Enumerator] if no block given
+      def each_subgid(&block)
+        return to_enum(:each_subgid) unless block
+
+        each_subid(subgid_path, &block)
+      end
+
+      # Write subuid entries atomically
+      #
+      # @param entries [Array<Hash>] entries with :name, :start and :count
+      # @param backup [Boolean, Symbol] create backup file first; :copy
+      #   forces a full copy instead of hardlinking the old file
+      # @param dry_run [Boolean] validate only, don't write
+      # @param expected_version [FileVersion, nil] fail unless the file is
+      #   still at this version when the lock is taken
+      # @return [DryRunResult, nil] result if dry_run, nil otherwise
+      # @raise [ValidationError] if the entries fail validation
+      # @raise [ConcurrentModificationError] if expected_version is stale
+      def write_subuid(entries, backup: true, dry_run: false, expected_version: nil)
+        write_subid(subuid_path, entries, backup: backup, dry_run: dry_run, expected_version: expected_version)
+      end
+
+      # Write subgid entries atomically
+      #
+      # @param entries [Array<Hash>] entries with :name, :start and :count
+      # @param backup [Boolean, Symbol] create backup file first; :copy
+      #   forces a full copy instead of hardlinking the old file
+      # @param dry_run [Boolean] validate only, don't write
+      # @param expected_version [FileVersion, nil] fail unless the file is
+      #   still at this version when the lock is taken
+      # @return [DryRunResult, nil] result if dry_run, nil otherwise
+      # @raise [ValidationError] if the entries fail validation
+      # @raise [ConcurrentModificationError] if expected_version is stale
+      def write_subgid(entries, backup: true, dry_run: false, expected_version: nil)
+        write_subid(subgid_path, entries, backup: backup, dry_run: dry_run, expected_version: expected_version)
+      end
+
+      # First free subordinate UID range, without assigning it
+      #
+      # Answered from an interval tree of the assigned ranges that is kept
+      # until /etc/subuid changes.
+      #
+      # @param count [Integer] number of IDs needed
+      # @param min [Integer] lowest ID that may be assigned
+      # @param max [Integer] highest ID that may be assigned
+      # @return [Integer] first ID of the free range
+      # @raise [RangeExhaustedError] if no range of count IDs is free
+      def next_subuid(count: SUBID_COUNT, min: SUBID_MIN, max: SUBID_MAX)
+        next_subid(subuid_path, count, min, max)
+      end
+
+      # First free subordinate GID range, without assigning it
+      #
+      # @param count [Integer] number of IDs needed
+      # @param min [Integer] lowest ID that may be assigned
+      # @param max [Integer] highest ID that may be assigned
+      # @return [Integer] first ID of the free range
+      # @raise [RangeExhaustedError] if no range of count IDs is free
+      def next_subgid(count: SUBID_COUNT, min: SUBID_MIN, max: SUBID_MAX)
+        next_subid(subgid_path, count, min, max)
+      end
+
+      # Assign subordinate UID ranges, like `usermod --add-subuids` with
+      # the range picked automatically
+      #
+      # Every owner gets the first free range of count IDs. The file is read,
+      # extended and written back under the password file lock, with a
+      # single write for all owners.
+      #
+      # @param owners [String, Array<String>] owner names or UIDs
+      # @param count [Integer] number of IDs per owner
+      # @param min [Integer] lowest ID that may be assigned
+      # @param max [Integer] highest ID that may be assigned
+      # @param backup [Boolean, Symbol] create backup file first
+      # @return [Array<Hash>] the new entries, one per owner
+      # @raise [RangeExhaustedError] if the ranges do not fit
+      # @raise [LockError] if lock acquisition fails
+      def allocate_subuids(owners, count: SUBID_COUNT, min: SUBID_MIN, max: SUBID_MAX, backup: true)
+        allocate_subids(:subuid, owners, count, min, max, backup)
+      end
+
+      # Assign subordinate GID ranges, like `usermod --add-subgids` with
+      # the range picked automatically
+      #
+      # @param owners [String, Array<String>] owner names or UIDs
+      # @param count [Integer] number of IDs per owner
+      # @param min [Integer] lowest ID that may be assigned
+      # @param max [Integer] highest ID that may be assigned
+      # @param backup [Boolean, Symbol] create backup file first
+      # @return [Array<Hash>] the new entries, one per owner
+      # @raise [RangeExhaustedError] if the ranges do not fit
+      # @raise [LockError] if lock acquisition fails
+      def allocate_subgids(owners, count: SUBID_COUNT, min: SUBID_MIN, max: SUBID_MAX, backup: true)
+        allocate_subids(:subgid, owners, count, min, max, backup)
+      end
+
+      # Create many accounts in one pass
+      #
+      # Plans every account with Provisioner (IDs, shadow entries, user
+      # private groups and supplementary memberships) and writes each new
+      # database once, then renames them all into place under a single hold
+      # of the password file lock. Everything is validated before the first
+      # file is replaced. Shadow and gshadow are only written if they exist.
+      #
+      # Planning and writing happen without the lock. If another writer
+      # changes one of the databases before the lock is taken, the IDs may
+      # no longer be free, so the accounts are planned again with the lock
+      # held throughout.
+      #
+      # @param specs [Array<Hash>] one spec per account (see Provisioner)
+      # @param backup [Boolean, Symbol] create backup files first
+      # @param dry_run [Boolean] plan and validate only, don't write
+      # @return [Array<Hash>, DryRunResult] the new passwd entries, or the
+      #   combined result if dry_run; its metadata holds the result of each
+      #   file under :files and the new users under :users
+      # @raise [ValidationError] if a spec or the resulting files are invalid
+      # @raise [RangeExhaustedError] if no free ID is left
+      # @raise [LockError] if lock acquisition fails
+      def provision(specs, backup: true, dry_run: false)
+        return provision_result(*plan_provision(specs)) if dry_run
+
+        check_write_permission(passwd_path)
+        begin
+          commit_provision(specs, backup)
+        rescue ConcurrentModificationError
+          with_lock { commit_provision(specs, backup) }
+        end
+      end
+
+      # Load a database into a read-only Snapshot that stays shared
+      # across fork (requires the C extension)
+      #
+      # @param database [Symbol] :passwd, :group, :shadow, :gshadow, :subuid
+      #   or :subgid
+      # @return [Snapshot]
+      # @raise [PermissionError] if the file cannot be read
+      # @raise [UnsupportedError] without the C extension
+      def snapshot(database)
+        path = database_path(database)
+        check_shadow_permission if database == :shadow
+        check_gshadow_permission if database == :gshadow
+        Snapshot.new(database, path)
+      end
+
       # Execute block with system-wide password file lock
       #
       # @param timeout [Integer] seconds to wait for lock
@@ -280,11 +646,11 @@ module EtcUtils
         end
       end
 
-      # Check if currently holding the lock
+      # Check if the calling thread currently holds the lock
       #
       # @return [Boolean] true if locked
       def locked?
-        @locked
+        @writer.mon_owned?
       end
 
       # Return platform identifier
@@ -312,6 +678,398 @@ module EtcUtils
 
       private
 
+      def rooted(path)
+        root ? File.join(root, path) : path
+      end
+
+      # Check whether the C extension provides a Native helper
+      def native?(method)
+        defined?(EtcUtils::Native) && EtcUtils::Native.respond_to?(method)
+      end
+
+      # Iterate the parsed entries of a file, publishing a :parse event
+      # when instrumentation is enabled
+      def each_entry(path, parser)
+        unless Instrumentation.enabled?
+          return foreach_entry(path, parser) { |attrs| yield attrs }
+        end
+
+        count = 0
+        Instrumentation.instrument(:parse, path: path) do |payload|
+          foreach_entry(path, parser) do |attrs|
+            count += 1
+            yield attrs
+          end
+        ensure
+          payload[:entries] = count
+        end
+      end
+
+      def foreach_entry(path, parser)
+        File.foreach(path) do |line|
+          next if line.strip.empty? || line.start_with?("#")
+
+          attrs = parser.call(line)
+          yield attrs if attrs
+        end
+      end
+
+      # Read and parse a whole file; nil if it changed while being read
+      def read_consistent(path, parser)
+        Instrumentation.instrument(:parse, path: path) do |payload|
+          File.open(path, "r") do |io|
+            version = FileVersion.of(io)
+            entries = []
+            io.each_line do |line|
+              next if line.strip.empty? || line.start_with?("#")
+
+              attrs = parser.call(line)
+              entries << attrs if attrs
+            end
+            payload[:entries] = entries.size
+            # A rename leaves this descriptor on the old inode; only an
+            # in-place edit can change it under us
+            FileVersion.of(io) == version ? [entries, version] : nil
+          end
+        end
+      end
+
+      # Iterate the ranges of a subuid or subgid file
+      def each_subid(path)
+        return to_enum(:each_subid, path) unless block_given?
+        return unless File.exist?(path)
+
+        each_entry(path, method(:parse_subid_line)) { |attrs| yield attrs }
+      end
+
+      def write_subid(path, entries, backup:, dry_run:, expected_version:)
+        check_write_permission(path)
+        check_version(path, expected_version) unless dry_run
+
+        report = Validator.subid(entries)
+        return dry_run_result(path, :subid, entries, report, expected_version) if dry_run
+
+        raise_invalid(path, report)
+        commit_write(path, :subid, entries, 0o644, backup, expected_version)
+        nil
+      end
+
+      def next_subid(path, count, min, max)
+        start = subid_tree(path).first_fit(count, min: min, max: max + 1)
+        raise RangeExhaustedError.new(count: count, min: min, max: max, path: path) unless start
+
+        start
+      end
+
+      # Pick ranges from a tree built from the entries read under the lock,
+      # so the allocation can't race another writer
+      def allocate_subids(database, owners, count, min, max, backup)
+        path = database_path(database)
+        check_write_permission(path)
+
+        with_lock do
+          entries, version = File.exist?(path) ? read_versioned(database) : [[], nil]
+          tree = IntervalTree.build(subid_ranges(entries))
+          added = Array(owners).map do |owner|
+            start = tree.first_fit(count, min: min, max: max + 1)
+            raise RangeExhaustedError.new(count: count, min: min, max: max, path: path) unless start
+
+            tree.insert(start, count)
+            { name: owner.to_s, start: start, count: count }
+          end
+
+          write_subid(path, entries + added, backup: backup, dry_run: false, expected_version: version)
+          added
+        end
+      end
+
+      # Return the interval tree of assigned ranges for a subid file,
+      # rebuilding it if the file has changed since it was built
+      def subid_tree(path)
+        version = FileVersion.of(path)
+        cached = @cache_lock.synchronize { @subid_trees[path] }
+        if cached && cached[:version] == version
+          Instrumentation.publish(:cache_hit, nil, cache: :subid_tree, path: path) if Instrumentation.enabled?
+          return cached[:tree]
+        end
+
+        Instrumentation.publish(:cache_miss, nil, cache: :subid_tree, path: path) if Instrumentation.enabled?
+        # The version is taken before the read, so a stale tree is never
+        # stored under a newer version
+        tree = Blocking.call { IntervalTree.build(subid_ranges(each_subid(path))) }
+        @cache_lock.synchronize { @subid_trees[path] = { version: version, tree: tree } }
+        tree
+      end
+
+      # Start and count pairs of the well-formed entries
+      def subid_ranges(entries)
+        entries.filter_map { |entry| [entry[:start], entry[:count]] if entry[:start] && entry[:count] }
+      end
+
+      # Read the databases and plan the new accounts against them
+      def plan_provision(specs)
+        passwd, passwd_version = read_versioned(:passwd)
+        group, group_version = read_versioned(:group)
+        shadow, shadow_version = read_versioned(:shadow) if File.exist?(shadow_path)
+        gshadow, gshadow_version = read_versioned(:gshadow) if File.exist?(gshadow_path)
+
+        plan = Provisioner.plan(specs, passwd: passwd, group: group, shadow: shadow, gshadow: gshadow)
+        versions = { passwd: passwd_version, group: group_version, shadow: shadow_version, gshadow: gshadow_version }
+        [plan, versions]
+      end
+
+      # Plan and stage every file, then replace them under the lock if none
+      # of the databases changed since they were read
+      def commit_provision(specs, backup)
+        plan, versions = plan_provision(specs)
+        errors = plan.errors + provision_reports(plan).values.flat_map(&:errors)
+        unless errors.empty?
+          raise ValidationError.new("Refusing to provision: #{errors.first(5).join(", ")}", errors: errors)
+        end
+
+        staged = {}
+        PROVISION_FILES.each do |database, mode|
+          next if plan[database].nil?
+
+          staged[database] = stage_file(database_path(database), content_for(database, plan[database]), mode)
+        end
+        with_lock do
+          staged.each_key { |database| check_version(database_path(database), versions[database]) }
+          staged.each do |database, temp|
+            create_backup(database_path(database), backup) if backup
+            File.rename(temp, database_path(database))
+          end
+        end
+        plan.users
+      ensure
+        staged&.each_value { |temp| discard_staged(temp) }
+      end
+
+      # Validate every planned file against the planned users and groups,
+      # not the ones on disk, which don't have the new accounts yet
+      def provision_reports(plan)
+        users = plan.passwd.to_h { |entry| [entry[:name], true] }
+        reports = {
+          passwd: Validator.passwd(plan.passwd, root: root),
+          group: Validator.group(plan.group, users: users)
+        }
+        reports[:shadow] = Validator.shadow(plan.shadow, users: users) if plan.shadow
+        if plan.gshadow
+          groups = plan.group.to_h { |entry| [entry[:name], true] }
+          reports[:gshadow] = Validator.gshadow(plan.gshadow, users: users, groups: groups)
+        end
+        reports
+      end
+
+      # Combine the dry runs of every planned file
+      def provision_result(plan, versions)
+        files = provision_reports(plan).to_h do |database, report|
+          [database, dry_run_result(database_path(database), database, plan[database], report, versions[database])]
+        end
+
+        DryRunResult.new(
+          content: content_for(:passwd, plan.passwd),
+          path: passwd_path,
+          changes: files.flat_map { |database, result| result.changes.map { |c| c.merge(database: database) } },
+          warnings: files.values.flat_map(&:warnings),
+          errors: plan.errors + files.values.flat_map(&:errors),
+          metadata: { entry_count: plan.passwd.length, users: plan.users, files: files }
+        )
+      end
+
+      # Map a database name to its file
+      def database_path(database)
+        case database
+        when :passwd then passwd_path
+        when :group then group_path
+        when :shadow then shadow_path
+        when :gshadow then gshadow_path
+        when :subuid then subuid_path
+        when :subgid then subgid_path
+        else raise ArgumentError, "Unknown database: #{database.inspect}"
+        end
+      end
+
+      # Errors to report when the file has moved on from expected_version
+      def version_conflicts(path, expected_version)
+        return [] if expected_version.nil? || FileVersion.of(path) == expected_version
+
+        ["#{path} has changed since it was read"]
+      end
+
+      # Compare-and-swap guard for writes prepared from an earlier read
+      def check_version(path, expected_version)
+        return if expected_version.nil?
+
+        actual = FileVersion.of(path)
+        return if actual == expected_version
+
+        raise ConcurrentModificationError.new(
+          "#{path} has changed since it was read",
+          path: path,
+          expected: expected_version,
+          actual: actual
+        )
+      end
+
+      # Count entry lines with at least min_fields fields in a database file
+      def count_entries(path, min_fields)
+        Blocking.call { scan_entries(path, min_fields) }
+      end
+
+      def scan_entries(path, min_fields)
+        return EtcUtils::Native.count_entries(path, min_fields) if native?(:count_entries)
+
+        count = 0
+        File.foreach(path) do |line|
+          next if line.strip.empty? || line.start_with?("#")
+
+          count += 1 if line.count(":") >= min_fields - 1
+        end
+        count
+      end
+
+      # Return the first entry line whose field matches key, without
+      # decoding the other fields. Integer keys compare numerically.
+      def find_line(path, field, key)
+        Blocking.call { scan_line(path, field, key) }
+      end
+
+      def scan_line(path, field, key)
+        return EtcUtils::Native.find_line(path, field, key) if native?(:find_line)
+        return nil if key.is_a?(Integer) && key.negative?
+
+        key = key.to_s unless key.is_a?(Integer)
+        # No field can contain ':', so such a key never matches
+        return nil if key.is_a?(String) && key.include?(":")
+
+        File.foreach(path) do |line|
+          next if line.strip.empty? || line.start_with?("#")
+
+          if field.zero? && key.is_a?(String)
+            return line.chomp if line.start_with?(key) && line[key.length] == ":"
+          else
+            value = line.chomp.split(":", field + 2)[field]
+            next if value.nil?
+
+            if key.is_a?(Integer)
+              return line.chomp if value.match?(/\A\d+\z/) && value.to_i == key
+            elsif value == key
+              return line.chomp
+            end
+          end
+        end
+        nil
+      end
+
+      # Return the line-offset index for a file, rebuilding it if the file
+      # has been replaced or modified since it was built
+      def line_index(path)
+        index = @cache_lock.synchronize { @line_indexes[path] }
+        if index&.current?
+          Instrumentation.publish(:cache_hit, nil, cache: :line_index, path: path) if Instrumentation.enabled?
+          return index
+        end
+
+        Instrumentation.publish(:cache_miss, nil, cache: :line_index, path: path) if Instrumentation.enabled?
+        # Built outside the mutex; concurrent rebuilds are harmless
+        index = Blocking.call { LineIndex.build(path) }
+        @cache_lock.synchronize { @line_indexes[path] = index }
+      end
+
+      # Run a lookup, remembering keys that were not found
+      #
+      # Misses are recorded against the FileVersion taken before the scan
+      # and only reused while the file still has that version, so a missing
+      # name is answered with one stat(2) until the file changes. The version
+      # is taken before the file is opened, so a miss can never be recorded
+      # against a version older than the contents it was read from. Only
+      # misses are cached; found entries are always read fresh.
+      def lookup(path, identifier)
+        key = identifier.is_a?(Integer) ? identifier : identifier.to_s
+        version = FileVersion.of(path)
+        if cached_miss?(path, version, key)
+          Instrumentation.publish(:cache_hit, nil, cache: :misses, path: path) if Instrumentation.enabled?
+          return nil
+        end
+
+        Instrumentation.publish(:cache_miss, nil, cache: :misses, path: path) if Instrumentation.enabled?
+        result = yield
+        record_miss(path, version, key) if result.nil? && version
+        result
+      end
+
+      def cached_miss?(path, version, key)
+        @cache_lock.synchronize do
+          misses = @misses[path]
+          !misses.nil? && misses[:version] == version && misses[:keys].include?(key)
+        end
+      end
+
+      def record_miss(path, version, key)
+        @cache_lock.synchronize do
+          misses = @misses[path]
+          if misses.nil? || misses[:version] != version || misses[:keys].size >= MISS_CACHE_LIMIT
+            misses = @misses[path] = { version: version, keys: Set.new }
+          end
+          misses[:keys] << key
+        end
+      end
+
+      # Return the ID-to-name table for a file, rebuilding it if the file
+      # has changed since it was built
+      def id_table(path)
+        table = @cache_lock.synchronize { @id_tables[path] }
+        if table && table.version == FileVersion.of(path)
+          Instrumentation.publish(:cache_hit, nil, cache: :id_table, path: path) if Instrumentation.enabled?
+          return table
+        end
+
+        Instrumentation.publish(:cache_miss, nil, cache: :id_table, path: path) if Instrumentation.enabled?
+        table = Blocking.call { load_id_table(path) }
+        @cache_lock.synchronize { @id_tables[path] = table }
+      end
+
+      # Read only the name and ID fields (the 1st and 3rd in both passwd
+      # and group) of every entry
+      def load_id_table(path)
+        File.open(path) do |io|
+          version = FileVersion.of(io)
+          pairs = []
+          io.each_line do |line|
+            next if line.strip.empty? || line.start_with?("#")
+
+            name, _passwd, id = line.split(":", 4)
+            pairs << [id.to_i, name] if id
+          end
+          IdNameTable.build(pairs, version: version)
+        end
+      end
+
+      # Read a window of raw entry lines, retrying once if the file is
+      # replaced between the index check and the read
+      def indexed_lines(path, offset, limit)
+        index = line_index(path)
+        Blocking.call { index.lines(offset, limit) }
+      rescue ConcurrentModificationError
+        @cache_lock.synchronize { @line_indexes.delete(path) }
+        index = line_index(path)
+        Blocking.call { index.lines(offset, limit) }
+      end
+
+      # Build a MergeJoin source that reads parsed entries from an open file
+      def entry_reader(io, parser)
+        lambda do
+          while (line = io.gets)
+            next if line.strip.empty? || line.start_with?("#")
+
+            attrs = send(parser, line)
+            return attrs if attrs
+          end
+          nil
+        end
+      end
+
       # Parse /etc/passwd line into attributes hash
       def parse_passwd_line(line)
         parts = line.chomp.split(":", -1)
@@ -319,12 +1077,12 @@ module EtcUtils
 
         {
           name: parts[0],
-          passwd: parts[1],
+          passwd: intern_passwd(parts[1]),
           uid: parts[2].to_i,
           gid: parts[3].to_i,
           gecos: parts[4],
           dir: parts[5],
-          shell: parts[6]
+          shell: intern(parts[6])
         }
       end
 
@@ -336,9 +1094,9 @@ module EtcUtils
         members_str = parts[3] || ""
         {
           name: parts[0],
-          passwd: parts[1],
+          passwd: intern_passwd(parts[1]),
           gid: parts[2].to_i,
-          members: members_str.empty? ? [] : members_str.split(",")
+          members: intern_list(members_str)
         }
       end
 
@@ -349,7 +1107,7 @@ module EtcUtils
 
         {
           name: parts[0],
-          passwd: parts[1],
+          passwd: intern_passwd(parts[1]),
           last_change: parse_int(parts[2]),
           min_days: parse_int(parts[3]),
           max_days: parse_int(parts[4]),
@@ -370,12 +1128,42 @@ module EtcUtils
 
         {
           name: parts[0],
-          passwd: parts[1],
-          admins: admins_str.empty? ? [] : admins_str.split(","),
-          members: members_str.empty? ? [] : members_str.split(",")
+          passwd: intern_passwd(parts[1]),
+          admins: intern_list(admins_str),
+          members: intern_list(members_str)
         }
       end
 
+      # Parse /etc/subuid or /etc/subgid line into attributes hash
+      def parse_subid_line(line)
+        parts = line.chomp.split(":", -1)
+        return nil if parts.length < 3
+
+        { name: parts[0], start: parse_int(parts[1]), count: parse_int(parts[2]) }
+      end
+      alias parse_subuid_line parse_subid_line
+      alias parse_subgid_line parse_subid_line
+
+      # Frozen, deduplicated copy of a low-cardinality field when
+      # EtcUtils.intern_strings is enabled
+      def intern(str)
+        EtcUtils.intern_strings? ? -str : str
+      end
+
+      # Password fields are only interned when too short to be a crypt(3)
+      # hash, so placeholders like "x" and "!" are shared but hashes are not
+      def intern_passwd(str)
+        str.length < 13 ? intern(str) : str
+      end
+
+      def intern_list(str)
+        return [] if str.empty?
+
+        names = str.split(",")
+        names.map!(&:-@) if EtcUtils.intern_strings?
+        names
+      end
+
       def parse_int(str)
         return nil if str.nil? || str.empty?
         Integer(str)
@@ -383,23 +1171,52 @@ module EtcUtils
         nil
       end
 
+      # Describe the contents of a database file as a stream of chunks of
+      # WRITE_CHUNK_ENTRIES lines, so no full copy of the file is built
+      def content_for(type, entries)
+        # A DryRunResult outlives the call; keep its content independent of
+        # later changes to the caller's Array
+        entries = entries.dup.freeze
+        LazyContent.new do |out|
+          if entries.empty?
+            out.call("\n")
+          else
+            entries.each_slice(WRITE_CHUNK_ENTRIES) { |slice| out.call(serialize(type, slice)) }
+          end
+        end
+      end
+
+      # Format entries as lines of a database file
+      def serialize(type, entries)
+        return EtcUtils::Native.serialize(type, entries) if native?(:serialize) && entries.is_a?(Array)
+
+        entries.map { |e| send(:"entry_to_#{type}_line", e) }.join("\n") + "\n"
+      end
+
+      # Structs answer [] by member name, so only other objects need to_h
+      def entry_fields(entry)
+        return entry if entry.is_a?(Hash) || entry.is_a?(Struct)
+
+        entry.to_h
+      end
+
       # Convert entry to passwd line
       def entry_to_passwd_line(entry)
-        entry = entry.to_h if entry.respond_to?(:to_h) && !entry.is_a?(Hash)
+        entry = entry_fields(entry)
         "#{entry[:name]}:#{entry[:passwd]}:#{entry[:uid]}:#{entry[:gid]}:" \
           "#{entry[:gecos]}:#{entry[:dir]}:#{entry[:shell]}"
       end
 
       # Convert entry to group line
       def entry_to_group_line(entry)
-        entry = entry.to_h if entry.respond_to?(:to_h) && !entry.is_a?(Hash)
+        entry = entry_fields(entry)
         members = (entry[:members] || []).join(",")
         "#{entry[:name]}:#{entry[:passwd]}:#{entry[:gid]}:#{members}"
       end
 
       # Convert entry to shadow line
       def entry_to_shadow_line(entry)
-        entry = entry.to_h if entry.respond_to?(:to_h) && !entry.is_a?(Hash)
+        entry = entry_fields(entry)
         [
           entry[:name],
           entry[:passwd],
@@ -415,22 +1232,28 @@ module EtcUtils
 
       # Convert entry to gshadow line
       def entry_to_gshadow_line(entry)
-        entry = entry.to_h if entry.respond_to?(:to_h) && !entry.is_a?(Hash)
+        entry = entry_fields(entry)
         admins = (entry[:admins] || []).join(",")
         members = (entry[:members] || []).join(",")
         "#{entry[:name]}:#{entry[:passwd]}:#{admins}:#{members}"
       end
 
+      # Convert entry to subuid/subgid line
+      def entry_to_subid_line(entry)
+        entry = entry_fields(entry)
+        "#{entry[:name]}:#{entry[:start]}:#{entry[:count]}"
+      end
+
       def format_int(val)
         val.nil? ? "" : val.to_s
       end
 
       # Check shadow file read permission
       def check_shadow_permission
-        unless File.readable?(SHADOW_FILE)
+        unless File.readable?(shadow_path)
           raise PermissionError.new(
-            "Cannot read #{SHADOW_FILE}",
-            path: SHADOW_FILE,
+            "Cannot read #{shadow_path}",
+            path: shadow_path,
             operation: :read,
             required_privilege: :root
           )
@@ -439,10 +1262,10 @@ module EtcUtils
 
       # Check gshadow file read permission
       def check_gshadow_permission
-        unless File.readable?(GSHADOW_FILE)
+        unless File.readable?(gshadow_path)
           raise PermissionError.new(
-            "Cannot read #{GSHADOW_FILE}",
-            path: GSHADOW_FILE,
+            "Cannot read #{gshadow_path}",
+            path: gshadow_path,
             operation: :read,
             required_privilege: :root
           )
@@ -462,21 +1285,119 @@ module EtcUtils
         end
       end
 
+      # Collect the names (field 0) of every entry in a database file
+      def names_in(path)
+        names = {}
+        return names unless File.readable?(path)
+
+        File.foreach(path) do |line|
+          next if line.strip.empty? || line.start_with?("#")
+
+          names[line[0, line.index(":") || line.length]] = true
+        end
+        names
+      end
+
+      # Describe a write without performing it
+      def dry_run_result(path, type, entries, report, expected_version)
+        changes = type == :subid ? calculate_subid_changes(path, entries) : calculate_changes(path, entries, type)
+        DryRunResult.new(
+          content: content_for(type, entries),
+          path: path,
+          changes: changes,
+          warnings: report.warnings,
+          errors: report.errors + version_conflicts(path, expected_version),
+          metadata: { entry_count: entries.length }
+        )
+      end
+
+      # Replace a database file once its entries are validated. The new
+      # file is written and synced first; the lock is only held to check
+      # the version, take the backup and rename it into place.
+      def commit_write(path, type, entries, mode, backup, expected_version)
+        temp = stage_file(path, content_for(type, entries), mode)
+        with_lock do
+          check_version(path, expected_version)
+          create_backup(path, backup) if backup
+          File.rename(temp, path)
+        end
+      ensure
+        discard_staged(temp)
+      end
+
+      # Refuse to write entries that failed validation
+      def raise_invalid(path, report)
+        return if report.valid?
+
+        raise ValidationError.new(
+          "Refusing to write #{path}: #{report.errors.first(5).join(", ")}",
+          errors: report.errors
+        )
+      end
+
       # Create backup of file
-      def create_backup(path)
+      #
+      # atomic_write replaces the file by rename, so the current inode is
+      # never modified and can simply become the backup through a hardlink.
+      # The link is made under a temporary name and renamed over any older
+      # backup. Filesystems without hardlink support fall back to a copy.
+      def create_backup(path, strategy = true)
+        return unless File.exist?(path)
+
         backup_path = "#{path}-"
-        FileUtils.cp(path, backup_path, preserve: true) if File.exist?(path)
+        return copy_backup(path, backup_path) if strategy == :copy
+
+        link_path = "#{backup_path}.#{Process.pid}"
+        begin
+          File.unlink(link_path) if File.exist?(link_path)
+          File.link(path, link_path)
+          File.rename(link_path, backup_path)
+          # rename(2) is a no-op when both names already share the inode
+          File.unlink(link_path) if File.exist?(link_path)
+        rescue Errno::EXDEV, Errno::EPERM, Errno::EMLINK, Errno::ENOTSUP, Errno::EOPNOTSUPP
+          File.unlink(link_path) if File.exist?(link_path)
+          copy_backup(path, backup_path)
+        end
+      end
+
+      def copy_backup(path, backup_path)
+        require "fileutils"
+        FileUtils.cp(path, backup_path, preserve: true)
       end
 
       # Atomic write using temp file and rename
       def atomic_write(path, content, mode: 0o644)
+        temp = stage_file(path, content, mode)
+        File.rename(temp, path)
+      ensure
+        discard_staged(temp)
+      end
+
+      # Write the new contents of path to a temp file in the same directory
+      # and return its path. The content is streamed chunk by chunk and
+      # synced to disk, and the file gets its final mode and the owner of the
+      # file it replaces, so only the rename is left. Under a Fiber scheduler
+      # the whole write runs as one blocking operation.
+      def stage_file(path, content, mode)
         require "tempfile"
-        require "fileutils"
 
-        dir = File.dirname(path)
-        temp = Tempfile.new(File.basename(path), dir)
+        Blocking.call do
+          Instrumentation.instrument(:write, path: path) do |payload|
+            write_temp(path, content, mode, payload)
+          end
+        end
+      end
+
+      # A plain File from Tempfile.create, since a Tempfile would unlink
+      # itself once garbage collected, before it is renamed
+      def write_temp(path, content, mode, payload)
+        temp = Tempfile.create(File.basename(path), File.dirname(path))
         begin
-          temp.write(content)
+          payload[:bytes] = content.is_a?(String) ? temp.write(content) : content.write_to(temp)
+          temp.flush
+          fsync_start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+          temp.fsync
+          payload[:fsync] = Process.clock_gettime(Process::CLOCK_MONOTONIC) - fsync_start
           temp.close
           File.chmod(mode, temp.path)
 
@@ -485,46 +1406,123 @@ module EtcUtils
             stat = File.stat(path)
             File.chown(stat.uid, stat.gid, temp.path)
           end
-
-          File.rename(temp.path, path)
+          temp.path
         rescue StandardError
-          temp.unlink if temp
+          temp.close
+          File.unlink(temp.path)
           raise
         end
       end
 
+      # Remove a staged file that was not renamed into place
+      def discard_staged(temp)
+        File.unlink(temp) if temp && File.exist?(temp)
+      end
+
       # Acquire password file lock
+      #
+      # The in-process writer lock is taken first so that threads queue on
+      # it rather than on the file. Only the outermost acquisition in a
+      # thread opens and locks the lock file. Threads waiting for the writer
+      # lock sleep on a condition variable until it is released; the file
+      # lock, held by other processes, is polled. Both waits yield to a
+      # Fiber scheduler instead of blocking the reactor.
       def acquire_lock(timeout)
-        return if @locked
+        if @writer.mon_owned?
+          @writer.enter
+          @lock_depth += 1
+          return
+        end
+
+        Instrumentation.instrument(:lock_wait, path: lock_path, acquired: false) do |payload|
+          wait_for_lock(timeout)
+          payload[:acquired] = true
+        end
+        @lock_acquired_at = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+
+      # Take the writer lock and then the file lock for an outermost
+      # acquisition, undoing the writer lock if the file lock times out
+      def wait_for_lock(timeout)
+        deadline = Process.clock_gettime(Process::CLOCK_MONOTONIC) + timeout
+        enter_writer(deadline, timeout)
+
+        @lock_depth += 1
+        acquired = false
+        begin
+          acquire_file_lock(deadline, timeout)
+          acquired = true
+        ensure
+          unless acquired
+            @lock_depth -= 1
+            exit_writer
+          end
+        end
+      end
 
-        @lock_file = File.open(LOCK_FILE, File::RDWR | File::CREAT, 0o600)
+      # Take the in-process writer lock, waiting until it is released or
+      # the deadline passes. The attempt and the wait happen under
+      # @writer_handoff, which exit_writer also takes to wake the waiters,
+      # so a release between the two cannot be missed.
+      def enter_writer(deadline, timeout)
+        @writer_handoff.synchronize do
+          until @writer.try_enter
+            remaining = deadline - Process.clock_gettime(Process::CLOCK_MONOTONIC)
+            raise lock_timeout(timeout) if remaining <= 0
+
+            @writer_released.wait(@writer_handoff, remaining)
+          end
+        end
+      end
+
+      # Leave the writer lock, waking the waiting threads once it is free
+      def exit_writer
+        @writer.exit
+        return if @writer.mon_owned?
+
+        @writer_handoff.synchronize { @writer_released.broadcast }
+      end
+
+      # Take the cross-process flock on the lock file
+      def acquire_file_lock(deadline, timeout)
+        lock_file = File.open(lock_path, File::RDWR | File::CREAT, 0o600)
 
-        deadline = Time.now + timeout
-        while Time.now < deadline
-          if @lock_file.flock(File::LOCK_EX | File::LOCK_NB)
-            @locked = true
+        loop do
+          if lock_file.flock(File::LOCK_EX | File::LOCK_NB)
+            @lock_file = lock_file
             return
           end
-          sleep 0.1
+          break if Process.clock_gettime(Process::CLOCK_MONOTONIC) >= deadline
+
+          sleep LOCK_POLL_INTERVAL
         end
 
-        @lock_file.close
-        @lock_file = nil
-        raise LockError.new(
+        lock_file.close
+        raise lock_timeout(timeout)
+      end
+
+      def lock_timeout(timeout)
+        LockError.new(
           "Could not acquire password file lock",
           timeout: timeout,
-          path: LOCK_FILE
+          path: lock_path
         )
       end
 
-      # Release password file lock
+      # Release password file lock; a no-op for threads that do not hold it
       def release_lock
-        return unless @locked
-
-        @lock_file&.flock(File::LOCK_UN)
-        @lock_file&.close
-        @lock_file = nil
-        @locked = false
+        return unless @writer.mon_owned?
+
+        @lock_depth -= 1
+        held = nil
+        if @lock_depth.zero?
+          @lock_file&.flock(File::LOCK_UN)
+          @lock_file&.close
+          @lock_file = nil
+          held = Process.clock_gettime(Process::CLOCK_MONOTONIC) - @lock_acquired_at if Instrumentation.enabled?
+        end
+        exit_writer
+        Instrumentation.publish(:lock_hold, held, path: lock_path) if held
       end
 
       # Calculate changes between current file and new entries
@@ -541,32 +1539,57 @@ module EtcUtils
           end
         end
 
-        # Build new entries map
-        new_map = {}
+        # Find added and modified; only the names of new entries are kept,
+        # each formatted line is compared and dropped straight away
+        new_names = {}
         new_entries.each do |entry|
-          entry = entry.to_h if entry.respond_to?(:to_h) && !entry.is_a?(Hash)
+          entry = entry_fields(entry)
           name = entry[:name]
-          new_line = case type
-                     when :passwd then entry_to_passwd_line(entry)
-                     when :group then entry_to_group_line(entry)
-                     when :shadow then entry_to_shadow_line(entry)
-                     when :gshadow then entry_to_gshadow_line(entry)
-                     end
-          new_map[name] = new_line
-        end
+          next if new_names.key?(name)
 
-        # Find added and modified
-        new_map.each do |name, line|
+          new_names[name] = true
+          new_line = send(:"entry_to_#{type}_line", entry)
           if current[name].nil?
             changes << { type: :added, name: name }
-          elsif current[name] != line
+          elsif current[name] != new_line
             changes << { type: :modified, name: name }
           end
         end
 
         # Find removed
         current.each_key do |name|
-          changes << { type: :removed, name: name } unless new_map[name]
+          changes << { type: :removed, name: name } unless new_names[name]
+        end
+
+        changes
+      end
+
+      # Changes to a subid file, compared line by line since an owner may
+      # hold several ranges
+      def calculate_subid_changes(path, new_entries)
+        current = Hash.new(0)
+        if File.exist?(path)
+          File.foreach(path) do |line|
+            next if line.strip.empty? || line.start_with?("#")
+
+            current[line.chomp] += 1
+          end
+        end
+
+        changes = []
+        new_entries.each do |entry|
+          line = entry_to_subid_line(entry)
+          if current[line].positive?
+            current[line] -= 1
+          else
+            entry = entry_fields(entry)
+            changes << { type: :added, name: entry[:name], start: entry[:start], count: entry[:count] }
+          end
+        end
+
+        current.each do |line, left|
+          name, start, count = line.split(":", 3)
+          left.times { changes << { type: :removed, name: name, start: start.to_i, count: count.to_i } }
         end
 
         changes
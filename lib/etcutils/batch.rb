@@ -0,0 +1,80 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # Batch applies the same change to many root directories concurrently
+  #
+  # Each root gets its own Linux backend, and therefore its own in-process
+  # and file locks, so roots never contend with each other. The roots are
+  # processed by a fixed pool of threads; a failure in one root is captured
+  # in its Result and does not stop the others.
+  #
+  # @example Add a user to every image rootfs
+  #   results = EtcUtils.batch(Dir["/srv/images/*"], concurrency: 16) do |backend|
+  #     users, version = backend.read_versioned(:passwd)
+  #     backend.write_passwd(users << new_user, expected_version: version)
+  #   end
+  #   results.reject(&:success?).each { |r| warn "#{r.root}: #{r.error.message}" }
+  #
+  module Batch
+    DEFAULT_CONCURRENCY = 8
+
+    # Outcome of running the batch block against one root
+    Result = Struct.new(:root, :value, :error) do
+      # @return [Boolean] true if the block completed without raising
+      def success?
+        error.nil?
+      end
+    end
+
+    class << self
+      # Run a block against every root on a thread pool
+      #
+      # @param roots [Enumerable<String>] root directories
+      # @param concurrency [Integer] number of worker threads
+      # @param lock [Boolean] hold each root's lock while its block runs
+      # @param timeout [Numeric] seconds to wait for each root's lock
+      # @yield [Backend::Linux, String] backend bound to the root, and the root
+      # @return [Array<Result>] one result per root, in input order
+      # @raise [UnsupportedError] if the platform has no Linux backend
+      def run(roots, concurrency: DEFAULT_CONCURRENCY, lock: true, timeout: 15, &block)
+        raise ArgumentError, "Batch.run requires a block" unless block
+        raise ArgumentError, "concurrency must be positive" unless concurrency.positive?
+        unless defined?(Backend::Linux)
+          raise UnsupportedError.new(operation: "batch root updates", platform: Platform.os)
+        end
+
+        roots = roots.to_a
+        results = Array.new(roots.length)
+        queue = Queue.new
+        roots.each_with_index { |root, i| queue << [root, i] }
+        queue.close
+
+        workers = Array.new([concurrency, roots.length].min) do
+          Thread.new do
+            while (job = queue.pop)
+              root, i = job
+              results[i] = run_one(root, lock, timeout, &block)
+            end
+          end
+        end
+        workers.each(&:join)
+
+        results
+      end
+
+      private
+
+      def run_one(root, lock, timeout)
+        backend = Backend::Linux.new(root: root)
+        value = if lock
+                  backend.with_lock(timeout: timeout) { yield backend, root }
+                else
+                  yield backend, root
+                end
+        Result.new(root, value, nil)
+      rescue StandardError => e
+        Result.new(root, nil, e)
+      end
+    end
+  end
+end
@@ -0,0 +1,55 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # Blocking runs file system work without stalling a Fiber scheduler
+  #
+  # Reads and writes of regular files never report "would block", so a
+  # Fiber scheduler cannot interleave them through io_wait. When the current
+  # fiber is non-blocking and the scheduler implements
+  # blocking_operation_wait, the work is handed to it instead (async runs it
+  # on a worker thread) and the fiber is suspended until it finishes.
+  # Without a scheduler the work simply runs inline.
+  #
+  # Lock waits need no special handling: Kernel#sleep already yields to the
+  # scheduler, and the C extension releases the GVL around lckpwdf(3) and
+  # its file scans.
+  #
+  # @example
+  #   entries = Blocking.call { File.readlines(path) }
+  #
+  module Blocking
+    class << self
+      # Run a block of blocking work
+      #
+      # @yield the blocking work
+      # @return the block's result; exceptions are re-raised in the caller
+      def call(&work)
+        scheduler = current_scheduler
+        return work.call unless scheduler
+
+        result = nil
+        error = nil
+        scheduler.blocking_operation_wait(lambda do
+          result = work.call
+        rescue Exception => e
+          error = e
+        end)
+        raise error if error
+
+        result
+      end
+
+      private
+
+      def current_scheduler
+        return nil unless Fiber.respond_to?(:scheduler)
+
+        scheduler = Fiber.scheduler
+        return nil if scheduler.nil? || Fiber.blocking?
+        return nil unless scheduler.respond_to?(:blocking_operation_wait)
+
+        scheduler
+      end
+    end
+  end
+end
@@ -14,9 +14,6 @@ module EtcUtils
   #   puts result.changes       # See what changed
   #
   class DryRunResult
-    # @return [String] the content that would be written to the file
-    attr_reader :content
-
     # @return [String] the path that would be written to
     attr_reader :path
 
@@ -34,7 +31,7 @@ module EtcUtils
 
     # Create a new DryRunResult
     #
-    # @param content [String] the content that would be written
+    # @param content [String, LazyContent] the content that would be written
     # @param path [String] the target file path
     # @param changes [Array<Hash>] list of changes
     # @param warnings [Array<String>] validation warnings
@@ -49,6 +46,26 @@ module EtcUtils
       @metadata = metadata.freeze
     end
 
+    # The content that would be written to the file
+    #
+    # Content supplied as a LazyContent is materialized on first access.
+    #
+    # @return [String] the full content
+    def content
+      @content = @content.to_s unless @content.is_a?(String)
+      @content
+    end
+
+    # Iterate over the content line by line without materializing it
+    #
+    # @yield [String] each line, newline included
+    # @return [Enumerator] if no block given
+    def each_line(&block)
+      return enum_for(:each_line) unless block
+
+      @content.each_line(&block)
+    end
+
     # Check if the dry run passed validation
     #
     # @return [Boolean] true if there are no errors
@@ -101,8 +118,7 @@ module EtcUtils
     # @param limit [Integer, nil] maximum lines to show (nil for all)
     # @return [String] numbered preview of content
     def preview(limit: nil)
-      lines = content.lines
-      lines = lines.first(limit) if limit
+      lines = limit ? each_line.first(limit) : each_line.to_a
       lines.each_with_index.map { |line, i| "#{i + 1}: #{line}" }.join
     end
 
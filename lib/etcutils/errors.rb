@@ -131,10 +131,12 @@ module EtcUtils
 
   # Raised when a file was modified by another process during write
   class ConcurrentModificationError < Error
-    attr_reader :path
+    attr_reader :path, :expected, :actual
 
-    def initialize(message = nil, path: nil)
+    def initialize(message = nil, path: nil, expected: nil, actual: nil)
       @path = path
+      @expected = expected
+      @actual = actual
       super(message || build_message)
     end
 
@@ -148,4 +150,26 @@ module EtcUtils
       end
     end
   end
+
+  # Raised when no free range of IDs is left to allocate
+  class RangeExhaustedError < Error
+    attr_reader :count, :min, :max, :path
+
+    def initialize(message = nil, count: nil, min: nil, max: nil, path: nil)
+      @count = count
+      @min = min
+      @max = max
+      @path = path
+      super(message || build_message)
+    end
+
+    private
+
+    def build_message
+      msg = count ? "No free range of #{count} IDs" : "No free ID range"
+      msg += " between #{min} and #{max}" if min && max
+      msg += " in #{path}" if path
+      msg
+    end
+  end
 end
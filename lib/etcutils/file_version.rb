@@ -0,0 +1,43 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # FileVersion identifies one particular version of a database file
+  #
+  # Writes replace the database by renaming a temp file over it, so every
+  # write produces a new inode. Editors that modify the file in place still
+  # change its size or timestamps. Comparing (dev, ino, size, mtime, ctime)
+  # is therefore enough to tell whether anything derived from the file (an
+  # index, a cache) is stale, without reading its contents.
+  #
+  # @example
+  #   version = EtcUtils::FileVersion.of("/etc/passwd")
+  #   # ... later
+  #   version == EtcUtils::FileVersion.of("/etc/passwd")  # => false if replaced
+  #
+  FileVersion = Struct.new(:dev, :ino, :size, :mtime_ns, :ctime_ns) do
+    # Capture the version of a path or open File
+    #
+    # @param file [String, File] path or open file
+    # @return [FileVersion, nil] version, or nil if the path does not exist
+    def self.of(file)
+      stat = file.is_a?(File) ? file.stat : File.stat(file)
+      from_stat(stat)
+    rescue Errno::ENOENT
+      nil
+    end
+
+    # Build a version from a File::Stat
+    #
+    # @param stat [File::Stat] stat result
+    # @return [FileVersion]
+    def self.from_stat(stat)
+      new(
+        stat.dev,
+        stat.ino,
+        stat.size,
+        stat.mtime.tv_sec * 1_000_000_000 + stat.mtime.tv_nsec,
+        stat.ctime.tv_sec * 1_000_000_000 + stat.ctime.tv_nsec
+      )
+    end
+  end
+end
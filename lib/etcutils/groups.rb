@@ -37,6 +37,33 @@ module EtcUtils
       end
     end
 
+    # Iterate groups paired with their gshadow entries
+    #
+    # Reads the group and gshadow databases together in a single pass instead of
+    # looking up each group's gshadow entry separately. Orphans are reported on
+    # either side: a group without a gshadow entry is yielded with nil as the
+    # second element, and a gshadow entry without a group with nil as the first.
+    #
+    # @yield [Group, nil, GShadow, nil] each group and its gshadow entry
+    # @return [Enumerator] if no block given
+    # @raise [UnsupportedError] if gshadow is not supported on the platform
+    # @raise [PermissionError] if insufficient permissions
+    #
+    # @example
+    #   EtcUtils.groups.each_with_gshadow do |group, gshadow|
+    #     puts "orphan: #{(group || gshadow).name}" if group.nil? || gshadow.nil?
+    #   end
+    def each_with_gshadow
+      return to_enum(:each_with_gshadow) unless block_given?
+
+      backend.each_group_with_gshadow do |group_attrs, gshadow_attrs|
+        yield(
+          group_attrs && Group.new(**group_attrs),
+          gshadow_attrs && GShadow.new(**gshadow_attrs)
+        )
+      end
+    end
+
     # Find a group by name, GID, or block
     #
     # When called with an identifier, searches for a group by name (String)
@@ -107,7 +134,51 @@ module EtcUtils
     # @param identifier [String, Integer] group name or GID
     # @return [Boolean] true if group exists
     def exists?(identifier)
-      !get(identifier).nil?
+      backend.group_exists?(identifier)
+    end
+
+    # Resolve many GIDs to names at once
+    #
+    # Meant for file-listing workloads that map the owner of every stat
+    # result to a name. The backend builds an ID-to-name table once and
+    # each ID is then a single Array lookup; IDs with no entry map to nil.
+    # On Linux the table is kept until the database file changes.
+    #
+    # @param ids [Array<Integer>, String] GIDs, or a String of native-endian
+    #   32-bit unsigned IDs as produced by Array#pack("L*")
+    # @return [Array<String, nil>] names in the same order as ids
+    #
+    # @example
+    #   EtcUtils.groups.names_for(files.map { |f| File.stat(f).gid })
+    def names_for(ids)
+      backend.group_id_table.names_for(ids)
+    end
+
+    # Return a page of groups
+    #
+    # Backends with a line-offset index (Linux) seek straight to the page,
+    # so the cost is proportional to limit rather than to the database size.
+    #
+    # @param offset [Integer] index of the first group
+    # @param limit [Integer] maximum number of groups
+    # @return [Array<Group>] up to limit groups
+    #
+    # @example
+    #   EtcUtils.groups.slice(100, 50)  # => groups 100..149
+    def slice(offset, limit)
+      backend.group_slice(offset, limit).map { |attrs| Group.new(**attrs) }
+    end
+
+    # Iterate groups from last to first
+    #
+    # @yield [Group] each group entry
+    # @return [Enumerator] if no block given
+    def reverse_each
+      return to_enum(:reverse_each) unless block_given?
+
+      backend.reverse_each_group do |attrs|
+        yield Group.new(**attrs)
+      end
     end
 
     # Return all groups as an array
@@ -119,11 +190,15 @@ module EtcUtils
 
     # Return the count of groups
     #
-    # Note: This iterates all groups, which may be slow on systems with many groups.
+    # Without arguments this asks the backend, which can count entries
+    # without building a Group object per line. With an argument or block it
+    # falls back to Enumerable#count.
     #
     # @return [Integer] number of groups
-    def count
-      each.count
+    def count(*args, &block)
+      return super if block || !args.empty?
+
+      backend.count_groups
     end
 
     private
@@ -0,0 +1,90 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # IdNameTable maps numeric user or group IDs to names
+  #
+  # Built once from a full pass over a database, the table answers each
+  # lookup with an Array index instead of a file scan. IDs below
+  # DENSE_LIMIT are stored in a dense Array; the few large IDs found on
+  # real systems (nobody at 65534, nfsnobody at 4294967294) go in a Hash.
+  # Because the table covers every entry, a miss is final: unknown IDs
+  # resolve to nil without touching the database again until the table is
+  # rebuilt for a new FileVersion.
+  #
+  # Names are frozen and shared between lookups.
+  #
+  # @example
+  #   table = EtcUtils::IdNameTable.build([[0, "root"], [1000, "alice"]])
+  #   table.names_for([1000, 0, 42])           # => ["alice", "root", nil]
+  #   table.names_for([0, 1000].pack("L*"))    # => ["root", "alice"]
+  #
+  class IdNameTable
+    # IDs below this limit are stored in the dense Array
+    DENSE_LIMIT = 1 << 20
+
+    # @return [FileVersion, nil] version of the file the table was built from
+    attr_reader :version
+
+    # Build a table from ID/name pairs
+    #
+    # When an ID appears more than once the first name wins, matching
+    # getpwuid(3) and getgrgid(3).
+    #
+    # @param pairs [Enumerable<Array(Integer, String)>] ID and name pairs
+    # @param version [FileVersion, nil] version the pairs were read from
+    # @return [IdNameTable]
+    def self.build(pairs, version: nil)
+      dense = []
+      sparse = {}
+      pairs.each do |id, name|
+        next if id.nil? || id.negative?
+
+        if id < DENSE_LIMIT
+          dense[id] ||= -name
+        else
+          sparse[id] ||= -name
+        end
+      end
+      new(dense.freeze, sparse.freeze, version)
+    end
+
+    # @param dense [Array<String, nil>] names indexed by ID
+    # @param sparse [Hash{Integer => String}] names of IDs >= DENSE_LIMIT
+    # @param version [FileVersion, nil] version the table was built from
+    def initialize(dense, sparse, version = nil)
+      @dense = dense
+      @sparse = sparse
+      @version = version
+    end
+
+    # Name for a single ID
+    #
+    # @param id [Integer] user or group ID
+    # @return [String, nil] name, or nil if no entry has that ID
+    def [](id)
+      return nil if id.negative?
+
+      id < @dense.size ? @dense[id] : @sparse[id]
+    end
+
+    # Resolve a batch of IDs in order
+    #
+    # @param ids [Array<Integer>, String] IDs, or a String of native-endian
+    #   32-bit unsigned IDs as produced by Array#pack("L*")
+    # @return [Array<String, nil>] one name (or nil) per ID
+    def names_for(ids)
+      ids = ids.unpack("L*") if ids.is_a?(String)
+      ids.map { |id| self[id] }
+    end
+
+    # @return [Integer] number of distinct IDs in the table
+    def size
+      @dense.count { |name| name } + @sparse.size
+    end
+
+    # @return [String]
+    def inspect
+      "#<#{self.class} size=#{size}>"
+    end
+  end
+end
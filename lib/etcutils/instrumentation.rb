@@ -0,0 +1,205 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # Instrumentation publishes timing and counter events from inside EtcUtils
+  #
+  # Subscribers receive an Event for every instrumented operation:
+  #
+  #   :parse       full pass over a database; payload :path, :entries
+  #   :lock_wait   time spent acquiring the writer lock; payload :path, :acquired
+  #   :lock_hold   time the writer lock was held; payload :path
+  #   :write       atomic file replacement; payload :path, :bytes, :fsync
+  #                (seconds spent in fsync)
+  #   :cache_hit   a cached result was used; payload :cache, :path
+  #   :cache_miss  a cache had to be (re)built; payload :cache, :path
+  #   :dscl_spawn  a dscl(1) process was started (Darwin); payload :args
+  #
+  # Counter events (cache hits and misses) have a nil duration. Durations
+  # of :parse events include the time spent in the caller's block when an
+  # enumeration is consumed incrementally.
+  #
+  # With no subscribers attached, instrumented code checks a single flag and
+  # takes its uninstrumented path, so the cost is one method call per
+  # operation and nothing per entry.
+  #
+  # @example Log slow lock waits
+  #   EtcUtils::Instrumentation.subscribe(:lock_wait) do |event|
+  #     warn "waited #{event.duration}s for #{event.payload[:path]}" if event.duration > 1
+  #   end
+  #
+  # @example Aggregate counters
+  #   counters = EtcUtils::Instrumentation::Counters.new
+  #   EtcUtils::Instrumentation.subscribe(counters)
+  #   EtcUtils.users.to_a
+  #   counters[:parse]  # => { count: 1, duration: 0.004, entries: 42, ... }
+  #
+  module Instrumentation
+    # A published event
+    Event = Struct.new(:name, :duration, :payload)
+
+    # A subscriber attached with #subscribe
+    Subscriber = Struct.new(:name, :callable) do
+      # @return [Boolean] true if this subscriber wants events called name
+      def match?(event_name)
+        name.nil? || name == event_name
+      end
+    end
+
+    # Counters aggregates events into per-name totals
+    #
+    # Attach an instance with Instrumentation.subscribe. Totals include the
+    # number of events, their summed and maximum durations, and the summed
+    # :entries and :bytes payload values.
+    class Counters
+      def initialize
+        @mutex = Mutex.new
+        @totals = {}
+      end
+
+      # Record an event
+      #
+      # @param event [Event]
+      def call(event)
+        @mutex.synchronize do
+          totals = @totals[event.name] ||= { count: 0, duration: 0.0, max_duration: 0.0, entries: 0, bytes: 0 }
+          totals[:count] += 1
+          if event.duration
+            totals[:duration] += event.duration
+            totals[:max_duration] = event.duration if event.duration > totals[:max_duration]
+          end
+          totals[:entries] += event.payload[:entries] || 0
+          totals[:bytes] += event.payload[:bytes] || 0
+        end
+      end
+
+      # Totals for one event name
+      #
+      # @param name [Symbol] event name
+      # @return [Hash, nil] totals, or nil if no such event was seen
+      def [](name)
+        @mutex.synchronize { @totals[name]&.dup }
+      end
+
+      # Number of events seen with a name
+      #
+      # @param name [Symbol] event name
+      # @return [Integer]
+      def count(name)
+        @mutex.synchronize { @totals[name] ? @totals[name][:count] : 0 }
+      end
+
+      # Entries processed per second across all events with a name
+      #
+      # @param name [Symbol] event name (normally :parse)
+      # @return [Float, nil] rate, or nil if no time was recorded
+      def entries_per_second(name = :parse)
+        totals = self[name]
+        return nil if totals.nil? || totals[:duration].zero?
+
+        totals[:entries] / totals[:duration]
+      end
+
+      # @return [Hash{Symbol => Hash}] all totals
+      def to_h
+        @mutex.synchronize { @totals.transform_values(&:dup) }
+      end
+
+      # Forget all totals
+      def reset
+        @mutex.synchronize { @totals.clear }
+      end
+    end
+
+    @subscribers = [].freeze
+    @mutex = Mutex.new
+
+    class << self
+      # Attach a subscriber
+      #
+      # @param name [Symbol, nil] only receive events with this name; nil for all
+      # @param callable [#call, nil] subscriber; the block is used if omitted
+      # @yield [Event] each matching event
+      # @return [Subscriber] handle for #unsubscribe
+      def subscribe(name = nil, callable = nil, &block)
+        if callable.nil? && !name.nil? && !name.is_a?(Symbol)
+          callable = name
+          name = nil
+        end
+        callable ||= block
+        raise ArgumentError, "subscribe requires a callable or a block" unless callable.respond_to?(:call)
+
+        subscriber = Subscriber.new(name, callable)
+        @mutex.synchronize { @subscribers = (@subscribers + [subscriber]).freeze }
+        subscriber
+      end
+
+      # Detach a subscriber
+      #
+      # @param subscriber [Subscriber] handle returned by #subscribe
+      # @return [void]
+      def unsubscribe(subscriber)
+        @mutex.synchronize { @subscribers = (@subscribers - [subscriber]).freeze }
+        nil
+      end
+
+      # Detach every subscriber
+      #
+      # @return [void]
+      def unsubscribe_all
+        @mutex.synchronize { @subscribers = [].freeze }
+        nil
+      end
+
+      # @return [Boolean] true if at least one subscriber is attached
+      def enabled?
+        !@subscribers.empty?
+      end
+
+      # Time a block and publish it as an event
+      #
+      # The block receives the payload Hash and may add to it. The event is
+      # published even if the block raises or exits early.
+      #
+      # @param name [Symbol] event name
+      # @param payload [Hash] event payload
+      # @yield [Hash] the payload
+      # @return the block's result
+      def instrument(name, payload = {})
+        return yield(payload) unless enabled?
+
+        start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        begin
+          yield payload
+        ensure
+          publish(name, Process.clock_gettime(Process::CLOCK_MONOTONIC) - start, payload)
+        end
+      end
+
+      # Publish an event
+      #
+      # Exceptions raised by subscribers are reported with Kernel#warn and
+      # never propagate into EtcUtils, which may be holding a lock.
+      #
+      # @param name [Symbol] event name
+      # @param duration [Float, nil] seconds, or nil for counter events
+      # @param payload [Hash] event payload
+      # @return [void]
+      def publish(name, duration = nil, payload = {})
+        subscribers = @subscribers
+        return if subscribers.empty?
+
+        event = Event.new(name, duration, payload)
+        subscribers.each do |subscriber|
+          next unless subscriber.match?(name)
+
+          begin
+            subscriber.callable.call(event)
+          rescue StandardError => e
+            warn "EtcUtils::Instrumentation subscriber failed on #{name}: #{e.class}: #{e.message}"
+          end
+        end
+        nil
+      end
+    end
+  end
+end
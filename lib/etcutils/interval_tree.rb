@@ -0,0 +1,250 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # IntervalTree indexes the assigned parts of an ID space
+  #
+  # Used to allocate subordinate UID/GID ranges, and by Provisioner to
+  # hand out UIDs and GIDs in bulk. Ranges are kept as a treap of disjoint
+  # half-open intervals ordered by start; overlapping or adjacent ranges
+  # are coalesced as they are inserted, so the tree holds the union of
+  # every assignment. Each node also records the lowest start,
+  # highest end and widest free gap of its subtree, which lets first_fit
+  # skip every subtree that cannot hold the request and find the first
+  # free range in O(log n) expected time.
+  #
+  # @example
+  #   tree = EtcUtils::IntervalTree.build([[100_000, 65_536], [231_072, 65_536]])
+  #   tree.first_fit(65_536, min: 100_000)   # => 165_536
+  #   tree.covered?(100_001)                 # => true
+  #
+  class IntervalTree
+    include Enumerable
+
+    # Treap node; min_start, max_stop and max_gap summarize the subtree
+    class Node
+      attr_accessor :start, :stop, :priority, :left, :right, :min_start, :max_stop, :max_gap
+
+      def initialize(start, stop, priority)
+        @start = @min_start = start
+        @stop = @max_stop = stop
+        @priority = priority
+        @max_gap = 0
+      end
+    end
+
+    # Build a tree from existing ranges
+    #
+    # @param ranges [Enumerable<Array(Integer, Integer)>] start and count pairs
+    # @return [IntervalTree]
+    def self.build(ranges)
+      tree = new
+      ranges.each { |start, count| tree.insert(start, count) }
+      tree
+    end
+
+    # @param random [Random] source of node priorities
+    def initialize(random: Random.new)
+      @root = nil
+      @random = random
+    end
+
+    # Mark count IDs starting at start as assigned
+    #
+    # @param start [Integer] first ID of the range
+    # @param count [Integer] number of IDs; empty ranges are ignored
+    # @return [self]
+    def insert(start, count)
+      return self unless count.positive?
+
+      stop = start + count
+      return self if grow(@root, start, stop, nil)
+
+      left, right = split(@root, start)
+
+      # The last range before start absorbs the new one if they touch
+      if left && left.max_stop >= start
+        left, last = remove_max(left)
+        start = last.start
+        stop = last.stop if last.stop > stop
+      end
+
+      # Ranges starting inside (or right at the end of) the new one merge too
+      middle, right = split(right, stop + 1)
+      stop = middle.max_stop if middle && middle.max_stop > stop
+
+      @root = merge(merge(left, Node.new(start, stop, @random.rand)), right)
+      self
+    end
+
+    # Start of the first run of count unassigned IDs within [min, max)
+    #
+    # @param count [Integer] number of IDs needed
+    # @param min [Integer] lowest ID that may be returned
+    # @param max [Integer, nil] IDs must stay below this bound; nil for none
+    # @return [Integer, nil] first ID of the run, or nil if none fits
+    def first_fit(count, min: 0, max: nil)
+      raise ArgumentError, "count must be positive" unless count.positive?
+
+      start = search(@root, count, min, nil)
+      if start.nil?
+        # Nothing fits between ranges; try the space after the last one
+        tail = @root ? @root.max_stop : min
+        start = tail > min ? tail : min
+      end
+      max.nil? || start + count <= max ? start : nil
+    end
+
+    # Whether an ID falls inside an assigned range
+    #
+    # @param id [Integer]
+    # @return [Boolean]
+    def covered?(id)
+      node = @root
+      while node
+        if id < node.start
+          node = node.left
+        elsif id >= node.stop
+          node = node.right
+        else
+          return true
+        end
+      end
+      false
+    end
+
+    # Iterate the coalesced ranges in order
+    #
+    # @yield [Integer, Integer] start and count of each range
+    # @return [Enumerator] if no block given
+    def each(&block)
+      return enum_for(:each) unless block
+
+      walk(@root, &block)
+      self
+    end
+
+    # @return [Integer] number of coalesced ranges
+    def size
+      count
+    end
+
+    # @return [Boolean] true if no IDs are assigned
+    def empty?
+      @root.nil?
+    end
+
+    # @return [String]
+    def inspect
+      "#<#{self.class} size=#{size}>"
+    end
+
+    private
+
+    # First fit among the gaps of a subtree, including the gap between
+    # prev_stop (the end of the range before it, nil if none) and its first
+    # range. Subtrees whose gaps all end below min, or that start past min
+    # and have no gap wide enough, are skipped without descending.
+    def search(node, count, min, prev_stop)
+      return nil if node.nil? || node.max_stop <= min
+      if prev_stop && prev_stop >= min && node.min_start - prev_stop < count && node.max_gap < count
+        return nil
+      end
+
+      found = search(node.left, count, min, prev_stop)
+      return found if found
+
+      from = node.left ? node.left.max_stop : prev_stop
+      from = min if from.nil? || from < min
+      return from if from + count <= node.start
+
+      search(node.right, count, min, node.stop)
+    end
+
+    # Extend the range that start falls in (or directly follows) without
+    # restructuring the tree, as long as the result stays clear of the next
+    # range. This is the common case when IDs are handed out in order.
+    # next_start is the start of the first range after the subtree.
+    def grow(node, start, stop, next_start)
+      return false if node.nil?
+
+      if start < node.start
+        return false unless grow(node.left, start, stop, node.start)
+      elsif start > node.stop
+        return false unless grow(node.right, start, stop, next_start)
+      else
+        following = node.right ? node.right.min_start : next_start
+        return false if following && stop >= following
+
+        node.stop = stop if stop > node.stop
+      end
+      update(node)
+    end
+
+    # Split into ranges starting before key and ranges starting at or after it
+    def split(node, key)
+      return [nil, nil] if node.nil?
+
+      if node.start < key
+        node.right, right = split(node.right, key)
+        [update(node), right]
+      else
+        left, node.left = split(node.left, key)
+        [left, update(node)]
+      end
+    end
+
+    # Join two treaps where every range in a precedes every range in b
+    def merge(a, b)
+      return a || b if a.nil? || b.nil?
+
+      if a.priority > b.priority
+        a.right = merge(a.right, b)
+        update(a)
+      else
+        b.left = merge(a, b.left)
+        update(b)
+      end
+    end
+
+    # Detach the last range of a subtree
+    def remove_max(node)
+      return [node.left, node] unless node.right
+
+      node.right, last = remove_max(node.right)
+      [update(node), last]
+    end
+
+    def update(node)
+      left = node.left
+      right = node.right
+      gap = 0
+
+      if left
+        node.min_start = left.min_start
+        gap = left.max_gap
+        gap = node.start - left.max_stop if node.start - left.max_stop > gap
+      else
+        node.min_start = node.start
+      end
+
+      if right
+        node.max_stop = right.max_stop
+        gap = right.max_gap if right.max_gap > gap
+        gap = right.min_start - node.stop if right.min_start - node.stop > gap
+      else
+        node.max_stop = node.stop
+      end
+
+      node.max_gap = gap
+      node
+    end
+
+    def walk(node, &block)
+      return unless node
+
+      walk(node.left, &block)
+      yield node.start, node.stop - node.start
+      walk(node.right, &block)
+    end
+  end
+end
@@ -0,0 +1,93 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # LazyContent is a file body that is generated on demand in chunks
+  #
+  # Writers describe their output as a producer of String chunks rather
+  # than one large String. The chunks are produced again on every pass, so
+  # streaming the content to a file or previewing its first few lines never
+  # holds more than a single chunk. Only #to_s builds the whole content.
+  #
+  # @example
+  #   content = LazyContent.new do |out|
+  #     entries.each_slice(1024) { |slice| out.call(format(slice)) }
+  #   end
+  #   content.each_line.first(10)   # produces only the first chunk
+  #   content.write_to(io)          # streams every chunk
+  #
+  class LazyContent
+    # Create a lazily generated content handle
+    #
+    # @yield [out] producer called on every pass over the content
+    # @yieldparam out [Proc] callable that receives each String chunk
+    def initialize(&producer)
+      raise ArgumentError, "LazyContent requires a producer block" unless producer
+
+      @producer = producer
+    end
+
+    # Iterate over the content chunks in order
+    #
+    # @yield [String] each chunk
+    # @return [Enumerator] if no block given
+    def each_chunk(&block)
+      return enum_for(:each_chunk) unless block
+
+      @producer.call(block)
+      self
+    end
+
+    # Iterate over the content line by line, newline included
+    #
+    # @yield [String] each line
+    # @return [Enumerator] if no block given
+    def each_line
+      return enum_for(:each_line) unless block_given?
+
+      pending = +""
+      each_chunk do |chunk|
+        pending << chunk
+        start = 0
+        while (nl = pending.index("\n", start))
+          yield pending[start..nl]
+          start = nl + 1
+        end
+        pending = pending[start..]
+      end
+      yield pending unless pending.empty?
+      self
+    end
+
+    # Stream every chunk to an IO
+    #
+    # @param io [#write] destination
+    # @return [Integer] number of bytes written
+    def write_to(io)
+      written = 0
+      each_chunk { |chunk| written += io.write(chunk) }
+      written
+    end
+
+    # @return [Integer] total size of the content in bytes
+    def bytesize
+      size = 0
+      each_chunk { |chunk| size += chunk.bytesize }
+      size
+    end
+
+    # Materialize the whole content
+    #
+    # @return [String]
+    def to_s
+      content = +""
+      each_chunk { |chunk| content << chunk }
+      content
+    end
+    alias to_str to_s
+
+    # @return [String]
+    def inspect
+      "#<#{self.class}>"
+    end
+  end
+end
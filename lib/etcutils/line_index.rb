@@ -0,0 +1,113 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # LineIndex maps entry numbers to byte offsets in a database file
+  #
+  # Building the index reads the file once. Afterwards a window of entries
+  # can be read by seeking straight to its first line, so paging through a
+  # large database costs O(limit) parsing per page instead of O(n). The index
+  # records the FileVersion it was built from; callers rebuild it when the
+  # file is replaced.
+  #
+  # Only entry lines are indexed. Blank lines and '#' comments are skipped,
+  # matching the backend's enumeration order.
+  #
+  # @example
+  #   index = EtcUtils::LineIndex.build("/etc/passwd")
+  #   index.size               # => number of entries
+  #   index.lines(100, 50)     # => raw lines of entries 100...150
+  #
+  class LineIndex
+    # Entries read per block when iterating in reverse
+    REVERSE_BLOCK = 256
+
+    # @return [String] the indexed file
+    attr_reader :path
+
+    # @return [FileVersion] version of the file the index was built from
+    attr_reader :version
+
+    # Build an index for a file
+    #
+    # @param path [String] database file path
+    # @return [LineIndex]
+    def self.build(path)
+      File.open(path, "rb") do |io|
+        version = FileVersion.of(io)
+        offsets = []
+        pos = 0
+        io.each_line do |line|
+          offsets << pos unless line.strip.empty? || line.start_with?("#")
+          pos += line.bytesize
+        end
+        new(path, version, offsets, pos)
+      end
+    end
+
+    # @param path [String] indexed file
+    # @param version [FileVersion] version the offsets belong to
+    # @param offsets [Array<Integer>] byte offset of each entry line
+    # @param length [Integer] file length in bytes
+    def initialize(path, version, offsets, length)
+      @path = path
+      @version = version
+      @offsets = offsets.freeze
+      @length = length
+    end
+
+    # Number of indexed entries
+    #
+    # @return [Integer]
+    def size
+      @offsets.length
+    end
+
+    # Check whether the index still describes the file on disk
+    #
+    # @param current [FileVersion, nil] version to compare against
+    # @return [Boolean]
+    def current?(current = FileVersion.of(path))
+      version == current
+    end
+
+    # Read the raw lines of a window of entries
+    #
+    # @param offset [Integer] first entry number (negative counts from the end)
+    # @param limit [Integer] maximum number of entries
+    # @return [Array<String>] entry lines without trailing newlines
+    # @raise [ConcurrentModificationError] if the file changed since indexing
+    def lines(offset, limit)
+      offset += size if offset.negative?
+      return [] if offset.negative? || offset >= size || limit <= 0
+
+      last = [offset + limit, size].min
+      from = @offsets[offset]
+      to = last < size ? @offsets[last] : @length
+
+      chunk = File.open(path, "rb") do |io|
+        raise ConcurrentModificationError.new(path: path) unless current?(FileVersion.of(io))
+
+        io.pread(to - from, from)
+      end
+      chunk.each_line(chomp: true).reject do |line|
+        line.strip.empty? || line.start_with?("#")
+      end
+    end
+
+    # Iterate entry lines from last to first, reading in blocks
+    #
+    # @yield [String] each entry line without trailing newline
+    # @return [Enumerator] if no block given
+    # @raise [ConcurrentModificationError] if the file changed since indexing
+    def reverse_each_line
+      return to_enum(:reverse_each_line) unless block_given?
+
+      stop = size
+      while stop.positive?
+        start = [stop - REVERSE_BLOCK, 0].max
+        lines(start, stop - start).reverse_each { |line| yield line }
+        stop = start
+      end
+    end
+  end
+end
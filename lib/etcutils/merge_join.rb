@@ -0,0 +1,118 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # MergeJoin pairs entries from two databases that share a name key
+  #
+  # Used to walk /etc/passwd alongside /etc/shadow (or /etc/group alongside
+  # /etc/gshadow) in a single pass. Both files are normally kept in the same
+  # order by the shadow-utils tools, so the join advances both sides in
+  # lockstep and only holds the current pair. Entries that arrive out of
+  # order are parked in a Hash until their partner shows up.
+  #
+  # Both sides advance together, so while both have entries left, each has
+  # parked at most as many entries as the shorter file holds. Once one side
+  # is exhausted, the other side's parked entries can no longer be matched
+  # and are reported as orphans straight away, and every remaining entry on
+  # the longer side is either matched against the parked ones or reported
+  # immediately. At most twice the smaller file is ever buffered, and only
+  # the shorter side's unmatched entries after it ends.
+  #
+  # @example
+  #   left  = [{ name: "root" }, { name: "bin" }].each
+  #   right = [{ name: "bin" }, { name: "root" }].each
+  #   MergeJoin.each(MergeJoin.source(left), MergeJoin.source(right)) do |l, r|
+  #     # yields both pairs; orphans are yielded with nil on the missing side
+  #   end
+  #
+  module MergeJoin
+    class << self
+      # Join two entry sources by name
+      #
+      # Sources are callables returning the next attribute hash, or nil once
+      # exhausted. Matched pairs are yielded as they are found. Orphans are
+      # yielded with nil in place of the missing side.
+      #
+      # @param left [#call] source of left-hand entries (e.g. passwd)
+      # @param right [#call] source of right-hand entries (e.g. shadow)
+      # @param key [Symbol] attribute used to pair entries
+      # @yield [Hash, nil, Hash, nil] left and right entries
+      # @return [Enumerator] if no block given
+      def each(left, right, key: :name)
+        return enum_for(:each, left, right, key: key) unless block_given?
+
+        left_pending = {}
+        right_pending = {}
+        l = left.call
+        r = right.call
+
+        while l || r
+          # A side that ran out can no longer match the other side's parked entries
+          flush(left_pending) { |orphan| yield orphan, nil } if r.nil?
+          flush(right_pending) { |orphan| yield nil, orphan } if l.nil?
+
+          if l && r && l[key] == r[key]
+            yield l, r
+            l = left.call
+            r = right.call
+            next
+          end
+
+          if l
+            if (match = right_pending.delete(l[key]))
+              yield l, match
+            elsif r.nil?
+              # Right side is exhausted and nothing is parked for this name
+              yield l, nil
+            else
+              park(left_pending, l, key) { |orphan| yield orphan, nil }
+            end
+            l = left.call
+          end
+
+          if r
+            if (match = left_pending.delete(r[key]))
+              yield match, r
+            elsif l.nil?
+              yield nil, r
+            else
+              park(right_pending, r, key) { |orphan| yield nil, orphan }
+            end
+            r = right.call
+          end
+        end
+
+        left_pending.each_value { |entry| yield entry, nil }
+        right_pending.each_value { |entry| yield nil, entry }
+      end
+
+      # Wrap an external Enumerator as a MergeJoin source
+      #
+      # @param enum [Enumerator] enumerator of attribute hashes
+      # @return [Proc] callable returning the next entry or nil
+      def source(enum)
+        lambda do
+          enum.next
+        rescue StopIteration
+          nil
+        end
+      end
+
+      private
+
+      def flush(pending, &block)
+        return if pending.empty?
+
+        pending.each_value(&block)
+        pending.clear
+      end
+
+      # Park an out-of-order entry; a duplicate name displaces the older
+      # entry, which can no longer be matched and is reported as an orphan
+      def park(pending, entry, key)
+        previous = pending[entry[key]]
+        yield previous if previous
+        pending[entry[key]] = entry
+      end
+    end
+  end
+end
@@ -0,0 +1,267 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # Provisioner plans the creation of many accounts at once
+  #
+  # Given the current contents of the four databases and a list of account
+  # specs, it returns the new contents of every file: a passwd and shadow
+  # entry per user, a user private group (with its gshadow entry) unless a
+  # primary group is named, and the supplementary memberships. No files
+  # are touched; Backend::Linux#provision writes the plan out under a
+  # single lock with one rewrite per file.
+  #
+  # IDs are allocated the way useradd(8) does. Regular IDs follow the
+  # highest ID already used in UID_MIN..UID_MAX (GID_MIN..GID_MAX), falling
+  # back to the lowest free ID once the top of the range is reached. System
+  # IDs go the other way: below the lowest ID used in SYS_UID_MIN..SYS_UID_MAX,
+  # falling back to the highest free ID. A private group reuses the user's
+  # UID as its GID when that GID is free. Used IDs are kept in an
+  # IntervalTree, so each regular allocation is O(log n) and a whole plan is
+  # linear in the size of the databases plus the number of specs; the
+  # system fallback scans the (small) system range.
+  #
+  # Spec keys:
+  #   - :name (required)
+  #   - :uid, :gid - explicit IDs; allocated when omitted
+  #   - :group - existing primary group name, instead of a private group
+  #   - :groups - supplementary group names (existing or created in the plan)
+  #   - :gecos, :home, :shell
+  #   - :password - crypt(3) hash for shadow; "!" (locked) by default
+  #   - :system - allocate from the system ID range
+  #
+  # @example
+  #   plan = EtcUtils::Provisioner.plan([{ name: "alice", groups: ["docker"] }],
+  #                                     passwd: users, group: groups)
+  #   plan.users   # => [{ name: "alice", uid: 1001, gid: 1001, ... }]
+  #
+  module Provisioner
+    # login.defs defaults
+    UID_MIN = 1000
+    UID_MAX = 60_000
+    SYS_UID_MIN = 101
+    SYS_UID_MAX = 999
+    GID_MIN = 1000
+    GID_MAX = 60_000
+    SYS_GID_MIN = 101
+    SYS_GID_MAX = 999
+    HOME = "/home"
+    SHELL = "/bin/sh"
+    PASS_MAX_DAYS = 99_999
+    PASS_WARN_AGE = 7
+
+    # New database contents; shadow and gshadow are nil when not managed
+    Plan = Struct.new(:passwd, :group, :shadow, :gshadow, :users, :errors) do
+      # @return [Boolean] true if the plan can be written
+      def valid?
+        errors.empty?
+      end
+    end
+
+    class << self
+      # Plan the creation of accounts
+      #
+      # @param specs [Array<Hash>] one spec per account
+      # @param passwd [Array<Hash>] current passwd entries
+      # @param group [Array<Hash>] current group entries
+      # @param shadow [Array<Hash>, nil] current shadow entries; nil skips shadow
+      # @param gshadow [Array<Hash>, nil] current gshadow entries; nil skips gshadow
+      # @param today [Integer] days since the epoch, for the last change field
+      # @return [Plan]
+      def plan(specs, passwd:, group:, shadow: nil, gshadow: nil, today: Time.now.to_i / 86_400)
+        Planner.new(passwd, group, shadow, gshadow, today).run(specs)
+      end
+    end
+
+    # Working state of a single plan
+    class Planner
+      def initialize(passwd, group, shadow, gshadow, today)
+        @passwd = passwd.dup
+        @group = group.dup
+        @shadow = shadow&.dup
+        @gshadow = gshadow&.dup
+        @today = today
+        @errors = []
+        @users = []
+
+        @user_names = {}
+        @passwd.each { |entry| @user_names[entry[:name]] = true }
+        @groups = {}
+        @group.each_with_index { |entry, i| @groups[entry[:name]] ||= i }
+        @gshadows = {}
+        @gshadow&.each_with_index { |entry, i| @gshadows[entry[:name]] ||= i }
+        @members = {}
+
+        @uids = IntervalTree.build(@passwd.map { |entry| [entry[:uid], 1] })
+        @gids = IntervalTree.build(@group.map { |entry| [entry[:gid], 1] })
+        @cursors = {}
+      end
+
+      def run(specs)
+        specs.each_with_index { |spec, i| add(spec.to_h, i + 1) }
+        Plan.new(@passwd, @group, @shadow, @gshadow, @users, @errors)
+      end
+
+      private
+
+      def add(spec, index)
+        name = spec[:name].to_s
+        return error("Missing user name at spec #{index}") if name.empty?
+        return error("User #{name} already exists") if @user_names.key?(name)
+
+        system = spec[:system] ? true : false
+        private_group = spec[:group].nil? && spec[:gid].nil?
+        return error("Group #{name} already exists") if private_group && @groups.key?(name)
+
+        supplementary = Array(spec[:groups]).map(&:to_s)
+        missing = supplementary.reject { |g| @groups.key?(g) || (private_group && g == name) }
+        return error("#{name}: supplementary group #{missing.first} does not exist") if missing.any?
+
+        uid = spec[:uid] || allocate(@uids, :uid, system)
+        return unless uid
+        return error("UID #{uid} of #{name} is already in use") if spec[:uid] && @uids.covered?(uid)
+
+        gid = primary_gid(spec, name, uid, system, private_group)
+        return unless gid
+
+        @uids.insert(uid, 1)
+        @user_names[name] = true
+        add_user(spec, name, uid, gid)
+        add_group(name, gid) if private_group
+        supplementary.each { |g| add_member(g, name) }
+      end
+
+      def primary_gid(spec, name, uid, system, private_group)
+        if spec[:group]
+          index = @groups[spec[:group].to_s]
+          return error("#{name}: primary group #{spec[:group]} does not exist") unless index
+
+          @group[index][:gid]
+        elsif spec[:gid]
+          return error("#{name}: primary GID #{spec[:gid]} does not exist") unless @gids.covered?(spec[:gid])
+
+          spec[:gid]
+        elsif !@gids.covered?(uid)
+          uid
+        else
+          allocate(@gids, :gid, system)
+        end
+      end
+
+      # Next free UID or GID in the regular or system range, like useradd(8)
+      def allocate(tree, kind, system)
+        min, max = id_range(kind, system)
+        key = [kind, system]
+        id = system ? allocate_down(tree, key, min, max) : allocate_up(tree, key, min, max)
+        raise RangeExhaustedError.new(count: 1, min: min, max: max) unless id
+
+        id
+      end
+
+      def id_range(kind, system)
+        if kind == :uid
+          system ? [SYS_UID_MIN, SYS_UID_MAX] : [UID_MIN, UID_MAX]
+        else
+          system ? [SYS_GID_MIN, SYS_GID_MAX] : [GID_MIN, GID_MAX]
+        end
+      end
+
+      # Count up from the highest used ID, then take the lowest free one
+      def allocate_up(tree, key, min, max)
+        cursor = @cursors[key] ||= highest_in(tree, min, max) + 1
+
+        # In a bulk run the cursor is nearly always free already
+        id = cursor if cursor <= max && !tree.covered?(cursor)
+        id ||= tree.first_fit(1, min: cursor, max: max + 1) || tree.first_fit(1, min: min, max: max + 1)
+        @cursors[key] = id + 1 if id
+        id
+      end
+
+      # Count down from the lowest used ID, then take the highest free one
+      def allocate_down(tree, key, min, max)
+        cursor = @cursors[key] ||= lowest_in(tree, min, max) - 1
+
+        id = cursor if cursor >= min && !tree.covered?(cursor)
+        id ||= max.downto(min).find { |candidate| !tree.covered?(candidate) }
+        @cursors[key] = id - 1 if id
+        id
+      end
+
+      # Lowest ID used within [min, max], or max + 1 if none
+      def lowest_in(tree, min, max)
+        tree.each do |start, count|
+          break if start > max
+          return [start, min].max if start + count - 1 >= min
+        end
+        max + 1
+      end
+
+      # Highest ID used within [min, max], or min - 1 if none
+      def highest_in(tree, min, max)
+        highest = min - 1
+        tree.each do |start, count|
+          break if start > max
+
+          last = [start + count - 1, max].min
+          highest = last if last > highest
+        end
+        highest
+      end
+
+      def add_user(spec, name, uid, gid)
+        user = {
+          name: name,
+          passwd: @shadow ? "x" : (spec[:password] || "!"),
+          uid: uid,
+          gid: gid,
+          gecos: spec[:gecos].to_s,
+          dir: spec[:home] || "#{HOME}/#{name}",
+          shell: spec[:shell] || SHELL
+        }
+        @passwd << user
+        @users << user
+        return unless @shadow
+
+        @shadow << {
+          name: name, passwd: spec[:password] || "!", last_change: @today,
+          min_days: 0, max_days: PASS_MAX_DAYS, warn_days: PASS_WARN_AGE,
+          inactive_days: nil, expire_date: nil, reserved: nil
+        }
+      end
+
+      def add_group(name, gid)
+        @gids.insert(gid, 1)
+        @groups[name] = @group.size
+        @group << { name: name, passwd: @gshadow ? "x" : "!", gid: gid, members: [] }
+        return unless @gshadow
+
+        @gshadows[name] = @gshadow.size
+        @gshadow << { name: name, passwd: "!", admins: [], members: [] }
+      end
+
+      # Copy a group (and its gshadow entry) the first time it gains a
+      # member, and track members in a Hash so big groups stay linear
+      def add_member(group_name, user)
+        members = @members[group_name] ||= begin
+          index = @groups[group_name]
+          @group[index] = @group[index].to_h.merge(members: Array(@group[index][:members]).dup)
+          if @gshadow && (sindex = @gshadows[group_name])
+            @gshadow[sindex] = @gshadow[sindex].to_h.merge(members: Array(@gshadow[sindex][:members]).dup)
+          end
+          @group[index][:members].to_h { |member| [member, true] }
+        end
+        return if members.key?(user)
+
+        members[user] = true
+        @group[@groups[group_name]][:members] << user
+        sindex = @gshadows[group_name]
+        @gshadow[sindex][:members] << user if @gshadow && sindex
+      end
+
+      def error(message)
+        @errors << message
+        nil
+      end
+    end
+    private_constant :Planner
+  end
+end
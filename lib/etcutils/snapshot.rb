@@ -0,0 +1,130 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # Snapshot is a read-only copy of a database kept outside the Ruby heap
+  #
+  # Meant for preforking servers: load it in the master before forking and
+  # every worker shares the same physical pages. The entries live in a
+  # Native::Arena, a single read-only mapping owned by a small TypedData
+  # object, so neither garbage collection nor lookups in the workers write
+  # to it and copy-on-write never has to copy it. Only the Snapshot itself
+  # and the entries a caller asks for are Ruby objects.
+  #
+  # Entries are attribute Hashes, like the ones yielded by the backends,
+  # built afresh on each access. Lookups by name and by UID/GID are binary
+  # searches over indexes stored in the arena. A snapshot never changes;
+  # check stale? and load a new one to pick up later writes.
+  #
+  # Requires the C extension.
+  #
+  # @example In a Puma or Unicorn master
+  #   USERS = EtcUtils.snapshot(:passwd)
+  #   # ... after fork, in any worker
+  #   USERS["alice"]   # => { name: "alice", uid: 1000, ... }
+  #   USERS[1000]      # => same entry, by UID
+  #
+  class Snapshot
+    include Enumerable
+
+    # Databases that can be snapshotted, and the arena layout of each
+    LAYOUTS = {
+      passwd: :passwd, group: :group, shadow: :shadow, gshadow: :gshadow,
+      subuid: :subid, subgid: :subid
+    }.freeze
+
+    # @return [Symbol] database the snapshot was taken of
+    attr_reader :database
+    # @return [String] file the snapshot was loaded from
+    attr_reader :path
+    # @return [FileVersion] version of the file the entries came from
+    attr_reader :version
+    # @return [Native::Arena] mapping holding the entries
+    attr_reader :arena
+
+    # @return [Boolean] true if the C extension provides Native::Arena
+    def self.available?
+      defined?(Native::Arena) ? true : false
+    end
+
+    # Load a snapshot of a database file
+    #
+    # @param database [Symbol] :passwd, :group, :shadow, :gshadow, :subuid or :subgid
+    # @param path [String] database file
+    # @raise [UnsupportedError] without the C extension
+    # @raise [ConcurrentModificationError] if the file keeps changing while
+    #   it is loaded
+    def initialize(database, path)
+      raise UnsupportedError.new(operation: "snapshots without the C extension") unless self.class.available?
+
+      layout = LAYOUTS.fetch(database) { raise ArgumentError, "Unknown database: #{database.inspect}" }
+      @database = database
+      @path = path
+      @arena, @version = load_arena(path, layout)
+      freeze
+    end
+
+    # @return [Integer] number of entries
+    def size
+      @arena.size
+    end
+    alias length size
+
+    # @return [Integer] bytes held in the shared mapping
+    def bytesize
+      @arena.bytesize
+    end
+
+    # Iterate entries in file order
+    #
+    # @yield [Hash] entry attributes
+    # @return [Enumerator] if no block given
+    def each(&block)
+      return enum_for(:each) { size } unless block
+
+      @arena.each(&block)
+      self
+    end
+
+    # Look up an entry by name, or by UID/GID for passwd and group
+    #
+    # @param key [String, Integer] name or numeric ID
+    # @return [Hash, nil] the first matching entry in file order
+    def [](key)
+      key.is_a?(Integer) ? @arena.find_id(key) : @arena.find_name(key.to_s)
+    end
+
+    # Entry at a position in the file
+    #
+    # @param index [Integer] position; negative counts from the end
+    # @return [Hash, nil]
+    def at(index)
+      @arena.entry(index)
+    end
+
+    # Whether the file has been replaced or modified since the snapshot
+    #
+    # @return [Boolean]
+    def stale?
+      FileVersion.of(@path) != @version
+    end
+
+    # @return [String]
+    def inspect
+      "#<#{self.class} #{@database} #{@path} size=#{size} bytesize=#{bytesize}>"
+    end
+
+    private
+
+    # Build the arena (without the GVL), retrying once if the file changed
+    # while it was read
+    def load_arena(path, layout)
+      2.times do
+        version = FileVersion.of(path)
+        arena = Native::Arena.load(path, layout)
+        return [arena, version] if version && FileVersion.of(path) == version
+      end
+
+      raise ConcurrentModificationError.new(path: path)
+    end
+  end
+end
@@ -0,0 +1,267 @@
+# frozen_string_literal: true
+
+require "tempfile"
+
+module EtcUtils
+  # SnapshotDiff compares two copies of a database with bounded memory
+  #
+  # Meant for snapshots collected from many hosts, where either side may
+  # hold millions of entries and come from any file or IO. Both sides are
+  # read one line at a time:
+  #
+  # 1. While the two files agree on order (the usual case, since the
+  #    shadow-utils tools append and rewrite in place) they are walked in
+  #    lockstep like MergeJoin. Identical lines are skipped without being
+  #    parsed, and entries that arrive out of order are parked until their
+  #    partner shows up.
+  # 2. If more than max_pending entries are parked, the parked entries and
+  #    the rest of both inputs are hash-partitioned by key into temporary
+  #    files, and each pair of partitions is diffed on its own. Memory is
+  #    then bounded by the size of one old-side partition.
+  #
+  # Only lines that differ are split into fields. Changes are yielded as
+  # they are found, so their order follows the inputs, not the names.
+  # Blank lines and '#' comments are ignored, and each name is expected
+  # once per snapshot (pwck and grpck enforce this). An owner may hold
+  # several subordinate ID ranges, so subuid and subgid entries are matched
+  # on name and start instead.
+  #
+  # @example
+  #   File.open("old/passwd") do |old|
+  #     EtcUtils::SnapshotDiff.each(old, "new/passwd", type: :passwd) do |change|
+  #       change # => { type: :modified, name: "alice",
+  #              #      fields: { shell: ["/bin/sh", "/bin/bash"] } }
+  #     end
+  #   end
+  #
+  module SnapshotDiff
+    # Field names and kinds of each database, in file order
+    FIELDS = {
+      passwd: { name: :string, passwd: :string, uid: :int, gid: :int, gecos: :string, dir: :string,
+                shell: :string },
+      group: { name: :string, passwd: :string, gid: :int, members: :list },
+      shadow: { name: :string, passwd: :string, last_change: :int, min_days: :int, max_days: :int,
+                warn_days: :int, inactive_days: :int, expire_date: :int, reserved: :string },
+      gshadow: { name: :string, passwd: :string, admins: :list, members: :list },
+      subuid: { name: :string, start: :int, count: :int },
+      subgid: { name: :string, start: :int, count: :int }
+    }.freeze
+
+    # Leading fields that identify an entry, when not just the name
+    KEY_FIELDS = { subuid: 2, subgid: 2 }.freeze
+
+    # Parked entries allowed before the inputs are partitioned
+    MAX_PENDING = 100_000
+    # Number of partitions each side is split into once partitioned
+    PARTITIONS = 64
+
+    class << self
+      # Stream the differences between two snapshots of a database
+      #
+      # Added and removed entries carry their parsed fields; modified
+      # entries carry only the fields that changed, as [old, new] pairs.
+      #
+      # @param old_source [IO, String, Pathname] previous snapshot, or its path
+      # @param new_source [IO, String, Pathname] current snapshot, or its path
+      # @param type [Symbol] :passwd, :group, :shadow, :gshadow, :subuid or :subgid
+      # @param max_pending [Integer] parked entries before partitioning
+      # @param partitions [Integer] partitions per side once partitioned
+      # @yield [Hash] { type: :added | :removed, name:, entry: } or
+      #   { type: :modified, name:, fields: { field => [old, new] } }
+      # @return [Enumerator] if no block given
+      # @raise [ArgumentError] if type is unknown
+      def each(old_source, new_source, type:, max_pending: MAX_PENDING, partitions: PARTITIONS, &block)
+        unless block
+          return enum_for(:each, old_source, new_source, type: type, max_pending: max_pending,
+                                                         partitions: partitions)
+        end
+
+        fields = FIELDS.fetch(type) { raise ArgumentError, "Unknown database type: #{type.inspect}" }
+        open_source(old_source) do |old_io|
+          open_source(new_source) do |new_io|
+            Walker.new(old_io, new_io, fields, KEY_FIELDS.fetch(type, 1), max_pending, partitions, block).run
+          end
+        end
+        nil
+      end
+
+      private
+
+      def open_source(source, &block)
+        return yield source if source.respond_to?(:gets)
+
+        File.open(source, "r", &block)
+      end
+    end
+
+    # State of a single diff
+    class Walker
+      def initialize(old_io, new_io, fields, key_fields, max_pending, partitions, block)
+        @old_io = old_io
+        @new_io = new_io
+        @fields = fields
+        @key_fields = key_fields
+        @max_pending = max_pending
+        @partitions = partitions
+        @block = block
+      end
+
+      def run
+        old_pending = {}
+        new_pending = {}
+        o = next_line(@old_io)
+        n = next_line(@new_io)
+
+        while o || n
+          if o && n
+            if o == n
+              o = next_line(@old_io)
+              n = next_line(@new_io)
+              next
+            end
+
+            if key(o) == key(n)
+              compare(o, n)
+              o = next_line(@old_io)
+              n = next_line(@new_io)
+              next
+            end
+          end
+
+          if o
+            id = key(o)
+            if (match = new_pending.delete(id))
+              compare(o, match)
+            elsif n.nil?
+              # New side is exhausted and nothing is parked for this entry
+              report(:removed, o)
+            else
+              old_pending[id] = o
+            end
+            o = next_line(@old_io)
+          end
+
+          if n
+            id = key(n)
+            if (match = old_pending.delete(id))
+              compare(match, n)
+            elsif o.nil?
+              report(:added, n)
+            else
+              new_pending[id] = n
+            end
+            n = next_line(@new_io)
+          end
+
+          next unless old_pending.size + new_pending.size > @max_pending
+
+          return partitioned(old_pending.each_value, o, @old_io) do |old_parts|
+            partitioned(new_pending.each_value, n, @new_io) { |new_parts| diff_partitions(old_parts, new_parts) }
+          end
+        end
+
+        old_pending.each_value { |line| report(:removed, line) }
+        new_pending.each_value { |line| report(:added, line) }
+      end
+
+      private
+
+      def next_line(io)
+        while (line = io.gets)
+          line.chomp!
+          return line unless line.empty? || line.start_with?("#")
+        end
+        nil
+      end
+
+      # The leading key fields of a line: the name, or the name and start
+      # of a subordinate ID range
+      def key(line)
+        colon = -1
+        @key_fields.times do
+          colon = line.index(":", colon + 1)
+          return line unless colon
+        end
+        line[0, colon]
+      end
+
+      # Spill the parked lines, the current line and the rest of an input
+      # into temporary files by hash of key, and yield the rewound files.
+      # Plain Files from Tempfile.create are used, since every line goes
+      # through them and Tempfile delegates each call.
+      def partitioned(parked, current, io)
+        parts = []
+        @partitions.times { parts << Tempfile.create("etcutils-diff") }
+        write = ->(line) { parts[key(line).hash % @partitions].puts(line) }
+        parked.each(&write)
+        if current
+          write.call(current)
+          while (line = next_line(io))
+            write.call(line)
+          end
+        end
+        parts.each(&:rewind)
+        yield parts
+      ensure
+        parts&.each do |part|
+          part.close
+          File.unlink(part.path)
+        end
+      end
+
+      # Diff each pair of partitions; only the old side is held in memory
+      def diff_partitions(old_parts, new_parts)
+        old_parts.zip(new_parts) do |old_part, new_part|
+          current = {}
+          while (line = next_line(old_part))
+            current[key(line)] = line
+          end
+          while (line = next_line(new_part))
+            old_line = current.delete(key(line))
+            if old_line.nil?
+              report(:added, line)
+            elsif old_line != line
+              compare(old_line, line)
+            end
+          end
+          current.each_value { |old_line| report(:removed, old_line) }
+        end
+      end
+
+      def compare(old_line, new_line)
+        return if old_line == new_line
+
+        old_values = old_line.split(":", -1)
+        new_values = new_line.split(":", -1)
+        changed = {}
+        @fields.each_with_index do |(field, kind), i|
+          next if old_values[i] == new_values[i]
+
+          changed[field] = [value(kind, old_values[i]), value(kind, new_values[i])]
+        end
+        return if changed.empty?
+
+        @block.call({ type: :modified, name: old_values[0], fields: changed })
+      end
+
+      def report(type, line)
+        values = line.split(":", -1)
+        entry = {}
+        @fields.each_with_index { |(field, kind), i| entry[field] = value(kind, values[i]) }
+        @block.call({ type: type, name: values[0], entry: entry })
+      end
+
+      def value(kind, str)
+        case kind
+        when :int
+          str.nil? || str.empty? ? nil : Integer(str, exception: false)
+        when :list
+          str.nil? || str.empty? ? [] : str.split(",")
+        else
+          str
+        end
+      end
+    end
+    private_constant :Walker
+  end
+end
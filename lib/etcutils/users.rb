@@ -37,6 +37,33 @@ module EtcUtils
       end
     end
 
+    # Iterate users paired with their shadow entries
+    #
+    # Reads the passwd and shadow databases together in a single pass instead of
+    # looking up each user's shadow entry separately. Orphans are reported on
+    # either side: a user without a shadow entry is yielded with nil as the
+    # second element, and a shadow entry without a user with nil as the first.
+    #
+    # @yield [User, nil, Shadow, nil] each user and its shadow entry
+    # @return [Enumerator] if no block given
+    # @raise [UnsupportedError] if shadow is not supported on the platform
+    # @raise [PermissionError] if insufficient permissions
+    #
+    # @example
+    #   EtcUtils.users.each_with_shadow do |user, shadow|
+    #     puts "orphan: #{(user || shadow).name}" if user.nil? || shadow.nil?
+    #   end
+    def each_with_shadow
+      return to_enum(:each_with_shadow) unless block_given?
+
+      backend.each_user_with_shadow do |user_attrs, shadow_attrs|
+        yield(
+          user_attrs && User.new(**user_attrs),
+          shadow_attrs && Shadow.new(**shadow_attrs)
+        )
+      end
+    end
+
     # Find a user by name, UID, or block
     #
     # When called with an identifier, searches for a user by name (String)
@@ -107,7 +134,51 @@ module EtcUtils
     # @param identifier [String, Integer] username or UID
     # @return [Boolean] true if user exists
     def exists?(identifier)
-      !get(identifier).nil?
+      backend.user_exists?(identifier)
+    end
+
+    # Resolve many UIDs to names at once
+    #
+    # Meant for file-listing workloads that map the owner of every stat
+    # result to a name. The backend builds an ID-to-name table once and
+    # each ID is then a single Array lookup; IDs with no entry map to nil.
+    # On Linux the table is kept until the database file changes.
+    #
+    # @param ids [Array<Integer>, String] UIDs, or a String of native-endian
+    #   32-bit unsigned IDs as produced by Array#pack("L*")
+    # @return [Array<String, nil>] names in the same order as ids
+    #
+    # @example
+    #   EtcUtils.users.names_for(files.map { |f| File.stat(f).uid })
+    def names_for(ids)
+      backend.user_id_table.names_for(ids)
+    end
+
+    # Return a page of users
+    #
+    # Backends with a line-offset index (Linux) seek straight to the page,
+    # so the cost is proportional to limit rather than to the database size.
+    #
+    # @param offset [Integer] index of the first user
+    # @param limit [Integer] maximum number of users
+    # @return [Array<User>] up to limit users
+    #
+    # @example
+    #   EtcUtils.users.slice(100, 50)  # => users 100..149
+    def slice(offset, limit)
+      backend.user_slice(offset, limit).map { |attrs| User.new(**attrs) }
+    end
+
+    # Iterate users from last to first
+    #
+    # @yield [User] each user entry
+    # @return [Enumerator] if no block given
+    def reverse_each
+      return to_enum(:reverse_each) unless block_given?
+
+      backend.reverse_each_user do |attrs|
+        yield User.new(**attrs)
+      end
     end
 
     # Return all users as an array
@@ -119,11 +190,15 @@ module EtcUtils
 
     # Return the count of users
     #
-    # Note: This iterates all users, which may be slow on systems with many users.
+    # Without arguments this asks the backend, which can count entries
+    # without building a User object per line. With an argument or block it
+    # falls back to Enumerable#count.
     #
     # @return [Integer] number of users
-    def count
-      each.count
+    def count(*args, &block)
+      return super if block || !args.empty?
+
+      backend.count_users
     end
 
     private
@@ -0,0 +1,277 @@
+# frozen_string_literal: true
+
+module EtcUtils
+  # Validator runs pwck/grpck-style consistency checks over entry sets
+  #
+  # Every check is a single pass over the entries backed by Hash indexes, so
+  # validation is linear in the number of entries. Structural problems that
+  # would corrupt the file or make lookups ambiguous are reported as errors:
+  #   - duplicate names
+  #   - ':' or newline characters in fields (',' too in member lists)
+  #   - missing names and invalid numeric fields
+  #
+  # Cross-file inconsistencies are reported as warnings, since they are
+  # commonly present on live systems and do not damage the file itself:
+  #   - shadow/gshadow entries with no matching user/group
+  #   - group members and admins that reference missing users
+  #   - login shells that do not exist
+  #   - subordinate ID ranges shared by different owners
+  #   - UIDs and GIDs shared by several entries, which useradd -o and
+  #     groupadd -o create on purpose and pwck/grpck accept
+  #
+  # @example Validate passwd entries before writing
+  #   report = EtcUtils::Validator.passwd(entries)
+  #   report.valid?   # => false
+  #   report.errors   # => ["Duplicate user name alice"]
+  #   report.warnings # => ["Duplicate UID 1000 (alice, bob)"]
+  #
+  module Validator
+    # Outcome of a validation pass
+    Report = Struct.new(:errors, :warnings) do
+      # @return [Boolean] true if there are no errors
+      def valid?
+        errors.empty?
+      end
+    end
+
+    SHADOW_NUMERIC_FIELDS = %i[
+      last_change min_days max_days warn_days inactive_days expire_date
+    ].freeze
+
+    class << self
+      # Validate passwd entries
+      #
+      # @param entries [Array<User, Hash>] user entries
+      # @param root [String, nil] directory login shells are resolved under
+      # @return [Report] errors and warnings
+      def passwd(entries, root: nil)
+        report = Report.new([], [])
+        names = {}
+        uids = {}
+        shells = {}
+
+        each_entry(entries) do |entry, line|
+          name = check_name(report, entry, line, "passwd")
+          check_fields(report, entry, name, %i[passwd gecos dir shell])
+          check_duplicate(report, names, name, "user name") if name
+
+          uid = check_id(report, entry, :uid, name, "UID")
+          check_id(report, entry, :gid, name, "GID")
+          check_duplicate_id(report, uids, uid, name, "UID") if uid
+
+          shell = entry[:shell]
+          if shell.is_a?(String) && !shell.empty? && !shells.key?(shell)
+            shells[shell] = File.exist?(root ? File.join(root, shell) : shell)
+            report.warnings << "Shell does not exist: #{shell}" unless shells[shell]
+          end
+        end
+
+        report
+      end
+
+      # Validate group entries
+      #
+      # @param entries [Array<Group, Hash>] group entries
+      # @param users [#include?, nil] known user names; nil skips member checks
+      # @return [Report] errors and warnings
+      def group(entries, users: nil)
+        report = Report.new([], [])
+        names = {}
+        gids = {}
+
+        each_entry(entries) do |entry, line|
+          name = check_name(report, entry, line, "group")
+          check_fields(report, entry, name, %i[passwd])
+          check_list(report, entry, :members, name, users)
+          check_duplicate(report, names, name, "group name") if name
+
+          gid = check_id(report, entry, :gid, name, "GID")
+          check_duplicate_id(report, gids, gid, name, "GID") if gid
+        end
+
+        report
+      end
+
+      # Validate shadow entries
+      #
+      # @param entries [Array<Shadow, Hash>] shadow entries
+      # @param users [#include?, nil] known user names; nil skips orphan checks
+      # @return [Report] errors and warnings
+      def shadow(entries, users: nil)
+        report = Report.new([], [])
+        names = {}
+
+        each_entry(entries) do |entry, line|
+          name = check_name(report, entry, line, "shadow")
+          check_fields(report, entry, name, %i[passwd reserved])
+          check_duplicate(report, names, name, "shadow name") if name
+          if name && users && !users.include?(name)
+            report.warnings << "Shadow entry #{name} has no matching user"
+          end
+
+          SHADOW_NUMERIC_FIELDS.each do |field|
+            value = entry[field]
+            next if value.nil? || value == ""
+            next if day_count?(value)
+
+            report.errors << "Invalid #{field} for #{name || "line #{line}"}: #{value.inspect}"
+          end
+        end
+
+        report
+      end
+
+      # Validate gshadow entries
+      #
+      # @param entries [Array<GShadow, Hash>] gshadow entries
+      # @param users [#include?, nil] known user names; nil skips member checks
+      # @param groups [#include?, nil] known group names; nil skips orphan checks
+      # @return [Report] errors and warnings
+      def gshadow(entries, users: nil, groups: nil)
+        report = Report.new([], [])
+        names = {}
+
+        each_entry(entries) do |entry, line|
+          name = check_name(report, entry, line, "gshadow")
+          check_fields(report, entry, name, %i[passwd])
+          check_list(report, entry, :admins, name, users)
+          check_list(report, entry, :members, name, users)
+          check_duplicate(report, names, name, "gshadow name") if name
+          if name && groups && !groups.include?(name)
+            report.warnings << "GShadow entry #{name} has no matching group"
+          end
+        end
+
+        report
+      end
+
+      # Validate subuid or subgid entries
+      #
+      # @param entries [Array<Hash>] entries with :name, :start and :count
+      # @return [Report] errors and warnings
+      def subid(entries)
+        report = Report.new([], [])
+        ranges = []
+
+        each_entry(entries) do |entry, line|
+          name = check_name(report, entry, line, "subid")
+          start = check_id(report, entry, :start, name, "start")
+          count = check_id(report, entry, :count, name, "count")
+          if count&.zero?
+            report.errors << "Invalid count for #{name}: 0"
+          elsif start && count
+            ranges << [start, start + count, name]
+          end
+        end
+
+        check_overlaps(report, ranges)
+        report
+      end
+
+      private
+
+      def each_entry(entries)
+        entries.each_with_index do |entry, i|
+          entry = entry.to_h if entry.respond_to?(:to_h) && !entry.is_a?(Hash)
+          yield entry, i + 1
+        end
+      end
+
+      # Returns the entry name, or nil (with an error recorded) if unusable
+      def check_name(report, entry, line, kind)
+        name = entry[:name]
+        if name.nil? || name.to_s.empty?
+          report.errors << "Missing #{kind} name at entry #{line}"
+          return nil
+        end
+
+        name = name.to_s
+        if name.match?(/[:\n,]/)
+          report.errors << "Invalid #{kind} name: #{name.inspect}"
+        end
+        name
+      end
+
+      def check_fields(report, entry, name, fields)
+        fields.each do |field|
+          value = entry[field]
+          next unless value.is_a?(String) && value.match?(/[:\n]/)
+
+          report.errors << "Invalid #{field} for #{name}: contains ':' or newline"
+        end
+      end
+
+      def check_list(report, entry, field, name, users)
+        Array(entry[field]).each do |member|
+          member = member.to_s
+          if member.match?(/[:\n,]/)
+            report.errors << "Invalid #{field.to_s.chomp("s")} #{member.inspect} in #{name}"
+          elsif users && !users.include?(member)
+            report.warnings << "#{name}: #{field.to_s.chomp("s")} #{member} does not exist"
+          end
+        end
+      end
+
+      # Returns the ID as an Integer, or nil (with an error recorded) if invalid
+      def check_id(report, entry, field, name, label)
+        value = entry[field]
+        if numeric?(value)
+          value.is_a?(Integer) ? value : Integer(value, 10)
+        else
+          report.errors << "Invalid #{label} for #{name}: #{value.inspect}"
+          nil
+        end
+      end
+
+      def check_duplicate(report, seen, name, label)
+        if seen.key?(name)
+          report.errors << "Duplicate #{label} #{name}"
+        else
+          seen[name] = true
+        end
+      end
+
+      def check_duplicate_id(report, seen, id, name, label)
+        if (owner = seen[id])
+          report.warnings << "Duplicate #{label} #{id} (#{owner}, #{name})"
+        else
+          seen[id] = name
+        end
+      end
+
+      # Sort ranges by start and compare each with the furthest-reaching
+      # range before it
+      def check_overlaps(report, ranges)
+        reach = nil
+        owner = nil
+        ranges.sort_by!(&:first).each do |start, stop, name|
+          if reach && start < reach && name != owner
+            report.warnings << "Range #{start}-#{stop - 1} of #{name} overlaps a range of #{owner}"
+          end
+          if reach.nil? || stop > reach
+            reach = stop
+            owner = name
+          end
+        end
+      end
+
+      def numeric?(value)
+        case value
+        when Integer then value >= 0
+        when String then value.match?(/\A\d+\z/)
+        else false
+        end
+      end
+
+      # Shadow day fields may also hold -1, which some tools write for
+      # "not set" and the parser reads back as an Integer
+      def day_count?(value)
+        case value
+        when Integer then true
+        when String then value.match?(/\A-?\d+\z/)
+        else false
+        end
+      end
+    end
+  end
+end
@@ -0,0 +1,125 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+# Allocation budgets for the hot enumeration, lookup and serialization paths
+#
+# Each test counts Ruby objects allocated per entry, and net malloc growth
+# per entry (malloc_increase_bytes, which counts frees against allocations
+# and is reset by GC), with GC disabled, and fails when a path exceeds its
+# budget. Budgets are the measured cost plus a little headroom: object
+# counts are exact and tight, malloc budgets are looser because they vary
+# with the Ruby version.
+# Budgets are tuned on Ruby 3.2+; a few paths allocate more on older
+# versions and get a second, measured budget there.
+class TestAllocationBudget < Test::Unit::TestCase
+  USERS = 1000
+  GROUPS = 100
+  MEMBERS = 10
+  BEFORE_RUBY_3_2 = Gem::Version.new(RUBY_VERSION) < Gem::Version.new("3.2")
+
+  def setup
+    super
+    skip_unless_linux
+    omit("GC.stat lacks allocation counters") unless GC.stat.key?(:total_allocated_objects) &&
+                                                     GC.stat.key?(:malloc_increase_bytes)
+  end
+
+  def with_database
+    passwd = Array.new(USERS) { |i| "user#{i}:x:#{1000 + i}:100:User #{i}:/home/user#{i}:/bin/sh\n" }.join
+    group = Array.new(GROUPS) do |g|
+      "group#{g}:x:#{1000 + g}:#{Array.new(MEMBERS) { |j| "user#{(g * MEMBERS) + j}" }.join(",")}\n"
+    end.join
+    with_temp_root(passwd: passwd, group: group) do |root|
+      yield EtcUtils::Backend::Linux.new(root: root), root
+    end
+  end
+
+  # Objects allocated and net malloc growth per entry for a block, measured
+  # on the second run so one-time setup (caches, lazy requires) is excluded
+  def allocations_per_entry(entries)
+    yield
+    GC.start
+    GC.disable
+    objects = GC.stat(:total_allocated_objects)
+    bytes = GC.stat(:malloc_increase_bytes)
+    yield
+    [(GC.stat(:total_allocated_objects) - objects).fdiv(entries),
+     (GC.stat(:malloc_increase_bytes) - bytes).fdiv(entries)]
+  ensure
+    GC.enable
+  end
+
+  def assert_budget(objects, bytes, entries, &block)
+    actual_objects, actual_bytes = allocations_per_entry(entries, &block)
+    assert_operator actual_objects, :<=, objects,
+                    "#{actual_objects.round(2)} objects per entry exceeds budget of #{objects}"
+    assert_operator actual_bytes, :<=, bytes,
+                    "#{actual_bytes.round(1)} malloc bytes per entry exceeds budget of #{bytes}"
+  end
+
+  def native_serializer?
+    defined?(EtcUtils::Native) && EtcUtils::Native.respond_to?(:serialize)
+  end
+
+  def test_linux_each_user
+    with_database do |backend|
+      # line, split Array and fields, attribute Hash
+      assert_budget(17, 256, USERS) { backend.each_user { |_attrs| nil } }
+    end
+  end
+
+  def test_linux_find_user
+    with_database do |backend|
+      assert_budget(17, 256, USERS) { backend.find_user("user#{USERS - 1}") }
+      assert_budget(17, 256, USERS) { backend.find_user(1000 + USERS - 1) }
+    end
+  end
+
+  def test_user_collection_each
+    skip_if_v1_extension
+    with_database do |backend|
+      users = EtcUtils::UserCollection.new(backend)
+      assert_budget(19, 256, USERS) { users.each { |_user| nil } }
+    end
+  end
+
+  def test_group_collection_each
+    skip_if_v1_extension
+    with_database do |backend|
+      groups = EtcUtils::GroupCollection.new(backend)
+      assert_budget(29, 512, GROUPS) { groups.each { |_group| nil } }
+    end
+  end
+
+  def test_serializers
+    with_database do |backend|
+      users = backend.each_user.to_a
+      groups = backend.each_group.to_a
+      # The native serializer builds each chunk in one buffer; the Ruby
+      # fallback allocates a few Strings per line, and one more before 3.2
+      objects = if native_serializer?
+                  0.5
+                else
+                  BEFORE_RUBY_3_2 ? 6 : 5
+                end
+      assert_budget(objects, 192, USERS) { backend.send(:content_for, :passwd, users).each_chunk { |_c| nil } }
+      assert_budget(objects, 320, GROUPS) { backend.send(:content_for, :group, groups).each_chunk { |_c| nil } }
+    end
+  end
+
+  def test_setup_passwd_and_setup_group
+    omit("C extension not loaded") unless V1_EXTENSION_LOADED
+    with_database do |_backend, root|
+      # fgetpwent/fgetgrent return objects built by setup_passwd/setup_group.
+      # Before 3.2 a Passwd's instance variables outgrow the embedded slots,
+      # so its ivar table adds about 45 bytes of malloc growth per entry.
+      assert_budget(8, BEFORE_RUBY_3_2 ? 64 : 16, USERS) do
+        File.open(File.join(root, "etc/passwd")) { |io| nil while EtcUtils.fgetpwent(io) }
+      end
+      assert_budget(16, 256, GROUPS) do
+        File.open(File.join(root, "etc/group")) { |io| nil while EtcUtils.fgetgrent(io) }
+      end
+    end
+  end
+end
@@ -0,0 +1,80 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TestBatch < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+  end
+
+  def with_roots(count, &block)
+    roots = []
+    nest = lambda do |remaining|
+      if remaining.zero?
+        block.call(roots)
+      else
+        with_temp_root do |root|
+          roots << root
+          nest.call(remaining - 1)
+        end
+      end
+    end
+    nest.call(count)
+  end
+
+  def test_applies_change_to_every_root
+    user = { name: "svc", passwd: "x", uid: 900, gid: 900, gecos: "", dir: "/", shell: "/sbin/nologin" }
+
+    with_roots(6) do |roots|
+      results = EtcUtils.batch(roots, concurrency: 3) do |backend|
+        users, version = backend.read_versioned(:passwd)
+        backend.write_passwd(users + [user], expected_version: version)
+        backend.count_users
+      end
+
+      assert_equal roots, results.map(&:root)
+      assert results.all?(&:success?)
+      assert_equal [3] * 6, results.map(&:value)
+      roots.each do |root|
+        assert_match(/^svc:x:900:900:/, File.read(File.join(root, "etc/passwd")))
+      end
+    end
+  end
+
+  def test_failures_are_captured_per_root
+    with_roots(2) do |roots|
+      results = EtcUtils.batch(roots + ["/nonexistent/etcutils-root"]) { |backend| backend.count_users }
+
+      assert_equal [true, true, false], results.map(&:success?)
+      assert_kind_of SystemCallError, results.last.error
+    end
+  end
+
+  def test_holds_each_roots_lock
+    with_roots(2) do |roots|
+      results = EtcUtils::Batch.run(roots) { |backend, root| [backend.locked?, root] }
+      assert_equal roots.map { |r| [true, r] }, results.map(&:value)
+
+      results = EtcUtils::Batch.run(roots, lock: false) { |backend| backend.locked? }
+      assert_equal [false, false], results.map(&:value)
+    end
+  end
+
+  def test_lock_timeout_is_per_root
+    with_roots(2) do |roots|
+      EtcUtils::Backend::Linux.new(root: roots.first).with_lock do
+        results = EtcUtils.batch(roots, timeout: 0.2) { |backend| backend.count_users }
+
+        assert_kind_of EtcUtils::LockError, results.first.error
+        assert_equal 2, results.last.value
+      end
+    end
+  end
+
+  def test_rejects_bad_arguments
+    assert_raise(ArgumentError) { EtcUtils::Batch.run([]) }
+    assert_raise(ArgumentError) { EtcUtils::Batch.run([], concurrency: 0) { nil } }
+    assert_equal [], EtcUtils::Batch.run([]) { nil }
+  end
+end
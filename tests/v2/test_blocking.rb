@@ -0,0 +1,85 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TestBlocking < Test::Unit::TestCase
+  # Minimal non-blocking scheduler that records offloaded work
+  class RecordingScheduler
+    attr_reader :offloaded
+
+    def initialize
+      @offloaded = 0
+    end
+
+    def block(*); end
+
+    def unblock(*); end
+
+    def kernel_sleep(*); end
+
+    def io_wait(*); end
+
+    def close; end
+
+    def fiber(&block)
+      fiber = Fiber.new(blocking: false, &block)
+      fiber.resume
+      fiber
+    end
+
+    def blocking_operation_wait(work)
+      @offloaded += 1
+      work.call
+    end
+  end
+
+  def in_scheduler(scheduler)
+    omit("Fiber scheduler requires Ruby 3.0+") unless Fiber.respond_to?(:set_scheduler)
+
+    result = nil
+    Thread.new do
+      Fiber.set_scheduler(scheduler)
+      Fiber.schedule { result = yield }
+    end.join
+    result
+  end
+
+  def test_runs_inline_without_scheduler
+    assert_equal 42, EtcUtils::Blocking.call { 42 }
+  end
+
+  def test_offloads_to_scheduler
+    scheduler = RecordingScheduler.new
+
+    assert_equal 42, in_scheduler(scheduler) { EtcUtils::Blocking.call { 42 } }
+    assert_equal 1, scheduler.offloaded
+  end
+
+  def test_reraises_errors_from_offloaded_work
+    scheduler = RecordingScheduler.new
+
+    error = in_scheduler(scheduler) do
+      EtcUtils::Blocking.call { raise Errno::ENOENT, "gone" }
+    rescue Errno::ENOENT => e
+      e
+    end
+    assert_kind_of Errno::ENOENT, error
+  end
+
+  def test_ignores_schedulers_without_blocking_operation_wait
+    scheduler = RecordingScheduler.new
+    scheduler.singleton_class.send(:undef_method, :blocking_operation_wait)
+
+    assert_equal :inline, in_scheduler(scheduler) { EtcUtils::Blocking.call { :inline } }
+  end
+
+  def test_backend_reads_are_offloaded
+    skip_unless_linux
+    scheduler = RecordingScheduler.new
+    backend = EtcUtils::Backend::Linux.new
+
+    count = in_scheduler(scheduler) { backend.count_users }
+    assert_equal backend.each_user.count, count
+    assert_equal 1, scheduler.offloaded
+  end
+end
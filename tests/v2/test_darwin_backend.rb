@@ -2,6 +2,7 @@
 
 require_relative "test_helper"
 require_relative "../../lib/etcutils/backend/darwin"
+require "tempfile"
 
 class TestDarwinBackend < Test::Unit::TestCase
   def setup
@@ -163,3 +164,95 @@ class TestDarwinBackend < Test::Unit::TestCase
     refute backend.locked?
   end
 end
+
+# Parses recorded `dscl . -readall` output through a stub dscl, so these
+# run on every platform
+class TestDarwinBackendReadall < Test::Unit::TestCase
+  STUB_DSCL = File.expand_path("fixtures/dscl/dscl", __dir__)
+
+  def setup
+    super
+    omit("dscl stub needs a POSIX shell") if WINDOWS
+    @log = Tempfile.new("dscl-log")
+    @log.close
+    ENV["DSCL_STUB_LOG"] = @log.path
+    @backend = EtcUtils::Backend::Darwin.new(dscl_path: STUB_DSCL)
+  end
+
+  def teardown
+    ENV.delete("DSCL_STUB_LOG")
+    @log.unlink
+  end
+
+  def dscl_calls
+    File.readlines(@log.path, chomp: true)
+  end
+
+  def test_each_user_parses_every_record_with_one_call
+    users = @backend.each_user.to_a
+
+    assert_equal %w[root daemon alice], users.map { |u| u[:name] }
+    assert_equal [". -readall /Users"], dscl_calls
+  end
+
+  def test_user_attributes
+    root = @backend.find_user("root")
+    alice = @backend.find_user(501)
+
+    assert_equal [0, 0, "System Administrator", "/var/root", "/bin/sh"],
+                 root.values_at(:uid, :gid, :gecos, :dir, :shell)
+    assert_equal ["alice", 20, "Alice Example", "/Users/alice", "/bin/zsh"],
+                 alice.values_at(:name, :gid, :gecos, :dir, :shell)
+    assert_equal "Unprivileged User", @backend.find_user(1)[:gecos]
+  end
+
+  def test_lookups_share_the_cached_read
+    assert_not_nil @backend.find_user("alice")
+    assert_not_nil @backend.find_user(0)
+    assert_nil @backend.find_user("nobody")
+    assert_equal 89, @backend.find_user("_spotlight")[:uid]
+    assert_equal "_spotlight", @backend.find_user(89)[:name]
+    @backend.each_user.to_a
+
+    assert_equal 1, dscl_calls.length
+  end
+
+  def test_groups
+    groups = @backend.each_group.to_a
+
+    assert_equal %w[wheel admin staff], groups.map { |g| g[:name] }
+    assert_equal %w[root alice], @backend.find_group(80)[:members]
+    assert_equal [], @backend.find_group("staff")[:members]
+    assert_equal 20, @backend.find_group("staff")[:gid]
+    assert_equal 89, @backend.find_group("_spotlight")[:gid]
+    assert_equal [". -readall /Groups"], dscl_calls
+  end
+
+  def test_id_tables_share_the_cached_read
+    assert_equal ["alice", "root", "_spotlight", nil], @backend.user_id_table.names_for([501, 0, 89, 90])
+    assert_equal %w[staff admin], @backend.group_id_table.names_for([20, 80])
+    @backend.find_user(0)
+
+    assert_equal [". -readall /Users", ". -readall /Groups"], dscl_calls
+  end
+
+  def test_clear_cache_and_ttl_trigger_reread
+    @backend.each_user.to_a
+    @backend.clear_cache
+    @backend.each_user.to_a
+    assert_equal 2, dscl_calls.length
+
+    expiring = EtcUtils::Backend::Darwin.new(dscl_path: STUB_DSCL, cache_ttl: 0)
+    expiring.find_user("root")
+    sleep 0.01
+    expiring.find_user("root")
+    assert_equal 4, dscl_calls.length
+  end
+
+  def test_missing_dscl_yields_nothing
+    backend = EtcUtils::Backend::Darwin.new(dscl_path: "/nonexistent/dscl")
+
+    assert_equal [], backend.each_user.to_a
+    assert_nil backend.find_group(0)
+  end
+end
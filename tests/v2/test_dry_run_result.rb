@@ -172,6 +172,21 @@ class TestDryRunResult < Test::Unit::TestCase
     refute_match(/3: line3/, preview)
   end
 
+  def test_preview_with_lazy_content_reads_only_needed_chunks
+    produced = 0
+    content = EtcUtils::LazyContent.new do |out|
+      %W[line1\nline2\n line3\n line4\n].each do |chunk|
+        produced += 1
+        out.call(chunk)
+      end
+    end
+    result = EtcUtils::DryRunResult.new(content: content, path: "/etc/passwd")
+
+    assert_equal "1: line1\n2: line2\n", result.preview(limit: 2)
+    assert_equal 1, produced
+    assert_equal "line1\nline2\nline3\nline4\n", result.content
+  end
+
   def test_to_h
     result = EtcUtils::DryRunResult.new(
       content: "content",
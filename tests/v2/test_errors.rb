@@ -134,6 +134,16 @@ class TestErrors < Test::Unit::TestCase
     assert_equal "/etc/passwd", error.path
   end
 
+  def test_concurrent_modification_error_versions
+    expected = EtcUtils::FileVersion.new(1, 2, 3, 4, 5)
+    actual = EtcUtils::FileVersion.new(1, 9, 3, 4, 5)
+    error = EtcUtils::ConcurrentModificationError.new(path: "/etc/group", expected: expected, actual: actual)
+
+    assert_equal expected, error.expected
+    assert_equal actual, error.actual
+    assert_match(%r{/etc/group}, error.message)
+  end
+
   def test_error_inheritance
     assert EtcUtils::NotFoundError < EtcUtils::Error
     assert EtcUtils::PermissionError < EtcUtils::Error
@@ -141,5 +151,13 @@ class TestErrors < Test::Unit::TestCase
     assert EtcUtils::LockError < EtcUtils::Error
     assert EtcUtils::ValidationError < EtcUtils::Error
     assert EtcUtils::ConcurrentModificationError < EtcUtils::Error
+    assert EtcUtils::RangeExhaustedError < EtcUtils::Error
+  end
+
+  def test_range_exhausted_error
+    error = EtcUtils::RangeExhaustedError.new(count: 65_536, min: 100_000, max: 200_000, path: "/etc/subuid")
+
+    assert_equal 65_536, error.count
+    assert_equal "No free range of 65536 IDs between 100000 and 200000 in /etc/subuid", error.message
   end
 end
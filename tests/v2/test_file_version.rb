@@ -0,0 +1,47 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "tempfile"
+
+class TestFileVersion < Test::Unit::TestCase
+  def setup
+    super
+    @file = Tempfile.new("etcutils-version")
+    @file.write("root:x:0:0::/root:/bin/sh\n")
+    @file.close
+  end
+
+  def teardown
+    @file.unlink
+  end
+
+  def test_same_file_has_equal_versions
+    assert_equal EtcUtils::FileVersion.of(@file.path), EtcUtils::FileVersion.of(@file.path)
+  end
+
+  def test_open_file_matches_path
+    File.open(@file.path) do |io|
+      assert_equal EtcUtils::FileVersion.of(@file.path), EtcUtils::FileVersion.of(io)
+    end
+  end
+
+  def test_rename_over_changes_version
+    before = EtcUtils::FileVersion.of(@file.path)
+    replacement = "#{@file.path}.new"
+    File.write(replacement, "root:x:0:0::/root:/bin/sh\n")
+    File.rename(replacement, @file.path)
+
+    refute_equal before, EtcUtils::FileVersion.of(@file.path)
+  end
+
+  def test_in_place_append_changes_version
+    before = EtcUtils::FileVersion.of(@file.path)
+    File.open(@file.path, "a") { |f| f.write("bin:x:1:1::/:/bin/sh\n") }
+
+    refute_equal before, EtcUtils::FileVersion.of(@file.path)
+  end
+
+  def test_missing_file_is_nil
+    assert_nil EtcUtils::FileVersion.of("/nonexistent/etcutils/file")
+  end
+end
@@ -13,6 +13,11 @@ WINDOWS = RUBY_PLATFORM =~ /mswin|mingw|cygwin/
 # Check if C extension is loaded (v1 classes vs v2 Struct-based classes)
 V2_STRUCTS_AVAILABLE = !defined?(V1_EXTENSION_LOADED) || !V1_EXTENSION_LOADED
 
+TEMP_ROOT_PASSWD = "root:x:0:0:root:/root:/bin/sh\nbin:x:1:1:bin:/bin:/sbin/nologin\n"
+TEMP_ROOT_GROUP = "root:x:0:\nbin:x:1:root\n"
+TEMP_ROOT_SHADOW = "root:!:19000:0:99999:7:::\nbin:*:19000:0:99999:7:::\n"
+TEMP_ROOT_GSHADOW = "root:::\nbin:::root\n"
+
 class Test::Unit::TestCase
   def setup
     EtcUtils.reset!
@@ -41,4 +46,18 @@ class Test::Unit::TestCase
   def skip_if_v1_extension(reason = "Test requires v2 Struct-based classes")
     omit(reason) unless V2_STRUCTS_AVAILABLE
   end
+
+  # Create a throwaway root directory holding etc/passwd, etc/group,
+  # etc/shadow and etc/gshadow for tests that write databases
+  def with_temp_root(passwd: TEMP_ROOT_PASSWD, group: TEMP_ROOT_GROUP,
+                     shadow: TEMP_ROOT_SHADOW, gshadow: TEMP_ROOT_GSHADOW)
+    require "tmpdir"
+    Dir.mktmpdir("etcutils-root") do |root|
+      Dir.mkdir(File.join(root, "etc"))
+      { "passwd" => passwd, "group" => group, "shadow" => shadow, "gshadow" => gshadow }.each do |name, content|
+        File.write(File.join(root, "etc", name), content) if content
+      end
+      yield root
+    end
+  end
 end
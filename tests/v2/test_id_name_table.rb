@@ -0,0 +1,50 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TestIdNameTable < Test::Unit::TestCase
+  def table
+    EtcUtils::IdNameTable.build([[0, "root"], [1000, "alice"], [1000, "dup"], [65_534, "nobody"],
+                                 [4_294_967_294, "nfsnobody"]])
+  end
+
+  def test_lookup
+    assert_equal "root", table[0]
+    assert_equal "nfsnobody", table[4_294_967_294]
+    assert_nil table[1]
+    assert_nil table[-1]
+    assert_nil table[10_000_000]
+  end
+
+  def test_first_entry_wins
+    assert_equal "alice", table[1000]
+    assert_equal 4, table.size
+  end
+
+  def test_names_for_array_keeps_order
+    assert_equal ["alice", nil, "root", "alice"], table.names_for([1000, 5, 0, 1000])
+  end
+
+  def test_names_for_packed_string
+    assert_equal %w[nobody root nfsnobody], table.names_for([65_534, 0, 4_294_967_294].pack("L*"))
+    assert_equal [], table.names_for("")
+  end
+
+  def test_names_are_frozen_and_shared
+    t = table
+    a, b = t.names_for([0, 0])
+
+    assert a.frozen?
+    assert_same a, b
+  end
+
+  def test_names_for_on_collections
+    skip_unless_linux
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+
+      assert_equal ["bin", nil, "root"], EtcUtils::UserCollection.new(backend).names_for([1, 2, 0])
+      assert_equal %w[root bin], EtcUtils::GroupCollection.new(backend).names_for([0, 1].pack("L*"))
+    end
+  end
+end
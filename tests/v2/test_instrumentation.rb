@@ -0,0 +1,133 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require_relative "../../lib/etcutils/backend/darwin"
+
+class TestInstrumentation < Test::Unit::TestCase
+  Instrumentation = EtcUtils::Instrumentation
+
+  def setup
+    super
+    @events = []
+  end
+
+  def teardown
+    Instrumentation.unsubscribe_all
+  end
+
+  def record(name = nil)
+    Instrumentation.subscribe(name) { |event| @events << event }
+  end
+
+  def names
+    @events.map(&:name)
+  end
+
+  def test_disabled_without_subscribers
+    refute Instrumentation.enabled?
+    assert_equal 42, Instrumentation.instrument(:parse) { 42 }
+
+    subscriber = record
+    assert Instrumentation.enabled?
+    Instrumentation.unsubscribe(subscriber)
+    refute Instrumentation.enabled?
+  end
+
+  def test_instrument_times_block_and_passes_payload
+    record
+    result = Instrumentation.instrument(:parse, path: "/x") do |payload|
+      payload[:entries] = 3
+      :done
+    end
+
+    assert_equal :done, result
+    event = @events.first
+    assert_equal :parse, event.name
+    assert_equal({ path: "/x", entries: 3 }, event.payload)
+    assert_kind_of Float, event.duration
+  end
+
+  def test_events_are_published_when_block_raises
+    record
+    assert_raise(RuntimeError) { Instrumentation.instrument(:write) { raise "boom" } }
+    assert_equal [:write], names
+  end
+
+  def test_name_filter_and_callable_subscribers
+    record(:cache_hit)
+    counters = Instrumentation::Counters.new
+    Instrumentation.subscribe(counters)
+
+    Instrumentation.publish(:cache_hit, nil, cache: :line_index)
+    Instrumentation.publish(:cache_miss, nil, cache: :line_index)
+
+    assert_equal [:cache_hit], names
+    assert_equal 1, counters.count(:cache_miss)
+  end
+
+  def test_counters_aggregate
+    counters = Instrumentation::Counters.new
+    counters.call(Instrumentation::Event.new(:parse, 0.5, { entries: 100 }))
+    counters.call(Instrumentation::Event.new(:parse, 1.5, { entries: 300 }))
+    counters.call(Instrumentation::Event.new(:write, 0.1, { bytes: 64 }))
+
+    assert_equal 2, counters[:parse][:count]
+    assert_equal 1.5, counters[:parse][:max_duration]
+    assert_equal 200.0, counters.entries_per_second
+    assert_equal 64, counters.to_h[:write][:bytes]
+    assert_nil counters[:lock_wait]
+
+    counters.reset
+    assert_equal({}, counters.to_h)
+  end
+
+  def test_failing_subscriber_does_not_propagate
+    Instrumentation.subscribe { |_event| raise "subscriber bug" }
+    record
+
+    _out, err = capture_output { Instrumentation.publish(:lock_hold, 0.1, {}) }
+    assert_match(/subscriber failed on lock_hold/, err)
+    assert_equal [:lock_hold], names
+  end
+
+  def test_linux_backend_events
+    skip_unless_linux
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      counters = Instrumentation::Counters.new
+      Instrumentation.subscribe(counters)
+      record
+
+      assert_equal 2, backend.each_user.count
+      parse = @events.find { |e| e.name == :parse }
+      assert_equal({ path: backend.passwd_path, entries: 2 }, parse.payload)
+
+      backend.user_slice(0, 1)
+      backend.user_slice(1, 1)
+      assert_equal [:cache_miss, :cache_hit], names.grep(/cache/)
+
+      users, version = backend.read_versioned(:passwd)
+      backend.with_lock do
+        backend.with_lock { backend.write_passwd(users, backup: false, expected_version: version) }
+      end
+
+      assert_equal 1, counters.count(:lock_wait)
+      assert_equal 1, counters.count(:lock_hold)
+      write = @events.find { |e| e.name == :write }
+      assert_equal File.size(backend.passwd_path), write.payload[:bytes]
+      assert_kind_of Float, write.payload[:fsync]
+      assert @events.find { |e| e.name == :lock_wait }.payload[:acquired]
+    end
+  end
+
+  def test_darwin_dscl_spawns
+    omit("dscl stub needs a POSIX shell") if WINDOWS
+    record
+    backend = EtcUtils::Backend::Darwin.new(dscl_path: File.expand_path("fixtures/dscl/dscl", __dir__))
+    backend.find_user("root")
+    backend.find_user(501)
+
+    assert_equal [:cache_miss, :dscl_spawn, :cache_hit], names
+    assert_equal ["-readall", "/Users"], @events[1].payload[:args]
+  end
+end
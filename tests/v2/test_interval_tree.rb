@@ -0,0 +1,86 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TestIntervalTree < Test::Unit::TestCase
+  def test_insert_coalesces_overlapping_and_adjacent_ranges
+    tree = EtcUtils::IntervalTree.build([[100, 10], [120, 5], [110, 3], [104, 2], [300, 1], [95, 6]])
+
+    assert_equal [[95, 18], [120, 5], [300, 1]], tree.to_a
+    assert_equal 3, tree.size
+  end
+
+  def test_insert_ignores_empty_ranges
+    tree = EtcUtils::IntervalTree.new.insert(10, 0)
+
+    assert tree.empty?
+  end
+
+  def test_first_fit_in_gaps_and_after_last_range
+    tree = EtcUtils::IntervalTree.build([[100, 10], [115, 10], [140, 10]])
+
+    assert_equal 0, tree.first_fit(5)
+    assert_equal 110, tree.first_fit(5, min: 100)
+    assert_equal 125, tree.first_fit(6, min: 100)
+    assert_equal 150, tree.first_fit(16, min: 100)
+    assert_equal 127, tree.first_fit(5, min: 127)
+    assert_equal 200, tree.first_fit(5, min: 200)
+  end
+
+  def test_first_fit_respects_max
+    tree = EtcUtils::IntervalTree.build([[100, 10]])
+
+    assert_equal 110, tree.first_fit(10, min: 100, max: 120)
+    assert_nil tree.first_fit(11, min: 100, max: 120)
+    assert_raise(ArgumentError) { tree.first_fit(0) }
+  end
+
+  def test_covered
+    tree = EtcUtils::IntervalTree.build([[100, 10], [200, 1]])
+
+    assert tree.covered?(100)
+    assert tree.covered?(109)
+    assert tree.covered?(200)
+    assert_false tree.covered?(110)
+    assert_false tree.covered?(99)
+  end
+
+  def test_matches_linear_scan
+    rng = Random.new(47)
+    300.times do
+      tree = EtcUtils::IntervalTree.new(random: Random.new(rng.rand(1 << 30)))
+      used = Array.new(256, false)
+      rng.rand(0..20).times do
+        start = rng.rand(0..230)
+        count = rng.rand(0..25)
+        tree.insert(start, count)
+        (start...start + count).each { |id| used[id] = true }
+      end
+
+      20.times do
+        count = rng.rand(1..30)
+        min = rng.rand(0..260)
+        max = rng.rand(2).zero? ? nil : rng.rand(0..300)
+        expected = (min..).find { |id| (id...id + count).none? { |i| used[i] } }
+        expected = nil if max && expected + count > max
+
+        assert_equal expected, tree.first_fit(count, min: min, max: max)
+      end
+    end
+  end
+
+  def test_many_ranges
+    tree = EtcUtils::IntervalTree.new
+    # Leave a single one-ID hole between every pair of ranges, then one
+    # wide hole near the end
+    ranges = (0...50_000).map { |i| [i * 11, 10] }
+    ranges.reject! { |start, _| start == 495_000 }
+    ranges.shuffle(random: Random.new(1)).each { |start, count| tree.insert(start, count) }
+
+    assert_equal 49_999, tree.size
+    assert_equal 10, tree.first_fit(1)
+    assert_equal 494_999, tree.first_fit(2)
+    assert_equal 494_999, tree.first_fit(12)
+    assert_equal 549_999, tree.first_fit(13)
+  end
+end
@@ -0,0 +1,44 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "stringio"
+
+class TestLazyContent < Test::Unit::TestCase
+  def chunked(chunks, produced = [])
+    EtcUtils::LazyContent.new do |out|
+      chunks.each do |chunk|
+        produced << chunk
+        out.call(chunk)
+      end
+    end
+  end
+
+  def test_to_s_joins_chunks
+    assert_equal "a\nb\nc\n", chunked(["a\nb", "\nc\n"]).to_s
+  end
+
+  def test_each_line_reassembles_lines_across_chunks
+    assert_equal ["a\n", "bc\n", "d"], chunked(["a\nb", "c\n", "d"]).each_line.to_a
+  end
+
+  def test_each_line_stops_producing_early
+    produced = []
+    content = chunked(["1\n2\n", "3\n4\n", "5\n"], produced)
+
+    assert_equal ["1\n", "2\n"], content.each_line.first(2)
+    assert_equal 1, produced.length
+  end
+
+  def test_write_to_and_bytesize
+    io = StringIO.new
+    content = chunked(["ab\n", "cd\n"])
+
+    assert_equal 6, content.write_to(io)
+    assert_equal "ab\ncd\n", io.string
+    assert_equal 6, content.bytesize
+  end
+
+  def test_requires_producer
+    assert_raise(ArgumentError) { EtcUtils::LazyContent.new }
+  end
+end
@@ -0,0 +1,80 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "tempfile"
+
+class TestLineIndex < Test::Unit::TestCase
+  def setup
+    super
+    @file = Tempfile.new("etcutils-index")
+    @file.write("# comment\n")
+    10.times { |i| @file.write("u#{i}:x:#{1000 + i}:100::/home/u#{i}:/bin/sh\n") }
+    @file.write("\n")
+    @file.close
+  end
+
+  def teardown
+    @file.unlink
+  end
+
+  def names(lines)
+    lines.map { |l| l.split(":").first }
+  end
+
+  def test_size_counts_entries_only
+    assert_equal 10, EtcUtils::LineIndex.build(@file.path).size
+  end
+
+  def test_lines_window
+    index = EtcUtils::LineIndex.build(@file.path)
+
+    assert_equal %w[u3 u4 u5], names(index.lines(3, 3))
+    assert_equal %w[u8 u9], names(index.lines(8, 50))
+    assert_equal [], index.lines(10, 5)
+    assert_equal [], index.lines(2, 0)
+  end
+
+  def test_negative_offset_counts_from_end
+    index = EtcUtils::LineIndex.build(@file.path)
+
+    assert_equal %w[u8 u9], names(index.lines(-2, 5))
+  end
+
+  def test_reverse_each_line
+    index = EtcUtils::LineIndex.build(@file.path)
+
+    assert_equal (0..9).map { |i| "u#{i}" }.reverse, names(index.reverse_each_line.to_a)
+  end
+
+  def test_stale_index_raises
+    index = EtcUtils::LineIndex.build(@file.path)
+    File.open(@file.path, "a") { |f| f.write("late:x:1:1::/:/bin/sh\n") }
+
+    refute index.current?
+    assert_raise(EtcUtils::ConcurrentModificationError) { index.lines(0, 1) }
+  end
+
+  def test_base_backend_slice_and_reverse
+    backend = ArrayBackend.new((0..4).map { |i| { name: "u#{i}" } })
+
+    assert_equal %w[u1 u2], backend.user_slice(1, 2).map { |u| u[:name] }
+    assert_equal %w[u4], backend.user_slice(-1, 3).map { |u| u[:name] }
+    assert_equal %w[u4 u3 u2 u1 u0], backend.reverse_each_user.map { |u| u[:name] }
+  end
+
+  class ArrayBackend < EtcUtils::Backend::Base
+    def initialize(users)
+      @users = users
+    end
+
+    def each_user(&block)
+      return to_enum(:each_user) unless block_given?
+
+      @users.each(&block)
+    end
+
+    def platform_name
+      :mock
+    end
+  end
+end
@@ -125,6 +125,131 @@ class TestLinuxBackend < Test::Unit::TestCase
     assert_nil group
   end
 
+  def test_count_users_matches_enumeration
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    assert_equal backend.each_user.count, backend.count_users
+    assert_equal backend.each_group.count, backend.count_groups
+  end
+
+  def test_user_exists_by_name_and_uid
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    assert backend.user_exists?("root")
+    assert backend.user_exists?(0)
+    refute backend.user_exists?("nonexistent_user_xyz")
+    refute backend.user_exists?("roo")
+    refute backend.user_exists?(-1)
+  end
+
+  def test_group_exists_by_name_and_gid
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    assert backend.group_exists?("root")
+    assert backend.group_exists?(0)
+    refute backend.group_exists?("nonexistent_group_xyz")
+  end
+
+  def test_user_slice_matches_enumeration
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    all = backend.each_user.to_a
+
+    assert_equal all[1, 3], backend.user_slice(1, 3)
+    assert_equal all[-2, 5], backend.user_slice(-2, 5)
+    assert_equal [], backend.user_slice(all.length, 5)
+  end
+
+  def test_reverse_each_user_and_group
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    assert_equal backend.each_user.to_a.reverse, backend.reverse_each_user.to_a
+    assert_equal backend.each_group.to_a.reverse, backend.reverse_each_group.to_a
+  end
+
+  def test_serialize_matches_line_formatters
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    users = backend.each_user.to_a
+    groups = backend.each_group.to_a
+
+    expected = users.map { |u| backend.send(:entry_to_passwd_line, u) }.join("\n") + "\n"
+    assert_equal expected, backend.send(:serialize, :passwd, users)
+    expected = groups.map { |g| backend.send(:entry_to_group_line, g) }.join("\n") + "\n"
+    assert_equal expected, backend.send(:serialize, :group, groups)
+  end
+
+  def test_content_for_streams_in_chunks
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    rows = (0...2500).map do |i|
+      { name: "u#{i}", passwd: "x", uid: 1000 + i, gid: 100, gecos: "", dir: "/home/u#{i}", shell: "/bin/sh" }
+    end
+    content = backend.send(:content_for, :passwd, rows)
+
+    assert_equal 3, content.each_chunk.count
+    assert_equal backend.send(:serialize, :passwd, rows), content.to_s
+    assert_equal "\n", backend.send(:content_for, :passwd, []).to_s
+  end
+
+  def test_atomic_write_streams_lazy_content
+    require "tmpdir"
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    content = EtcUtils::LazyContent.new { |out| 3.times { |i| out.call("line#{i}\n") } }
+
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, "passwd")
+      backend.send(:atomic_write, path, content, mode: 0o640)
+
+      assert_equal "line0\nline1\nline2\n", File.read(path)
+      assert_equal 0o640, File.stat(path).mode & 0o777
+      assert_equal ["passwd"], Dir.children(dir)
+    end
+  end
+
+  def test_create_backup_links_old_inode
+    require "tmpdir"
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, "passwd")
+      File.write(path, "old\n")
+      File.write("#{path}-", "older\n")
+      old_ino = File.stat(path).ino
+
+      backend.send(:create_backup, path)
+      assert_equal old_ino, File.stat("#{path}-").ino
+
+      backend.send(:atomic_write, path, "new\n")
+      assert_equal "old\n", File.read("#{path}-")
+      assert_equal "new\n", File.read(path)
+
+      backend.send(:create_backup, path)
+      backend.send(:create_backup, path)
+      assert_equal %w[passwd passwd-], Dir.children(dir).sort
+    end
+  end
+
+  def test_create_backup_copy_strategy
+    require "tmpdir"
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    Dir.mktmpdir do |dir|
+      path = File.join(dir, "group")
+      File.write(path, "root:x:0:\n")
+
+      backend.send(:create_backup, path, :copy)
+      refute_equal File.stat(path).ino, File.stat("#{path}-").ino
+      assert_equal "root:x:0:\n", File.read("#{path}-")
+    end
+  end
+
+  def test_read_versioned
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    entries, version = backend.read_versioned(:passwd)
+
+    assert_equal backend.each_user.to_a, entries
+    assert_equal backend.file_version(:passwd), version
+    assert_raise(ArgumentError) { backend.read_versioned(:hosts) }
+  end
+
   # Shadow tests require root or shadow group membership
   def test_each_shadow_requires_permission
     backend = EtcUtils::Backend::Registry.backend_for(:linux)
@@ -138,6 +263,28 @@ class TestLinuxBackend < Test::Unit::TestCase
     end
   end
 
+  def test_each_user_with_shadow_pairs_every_user
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    begin
+      pairs = backend.each_user_with_shadow.to_a
+    rescue EtcUtils::PermissionError => e
+      assert_match(/shadow/, e.message)
+      return
+    end
+
+    assert_equal backend.each_user.count, pairs.count { |user, _| user }
+    pairs.each do |user, shadow|
+      assert_equal user[:name], shadow[:name] if user && shadow
+    end
+  end
+
+  def test_each_group_with_gshadow_returns_enumerator
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    assert_kind_of Enumerator, backend.each_group_with_gshadow
+  end
+
   def test_locked_returns_false_initially
     backend = EtcUtils::Backend::Registry.backend_for(:linux)
     refute backend.locked?
@@ -167,6 +314,111 @@ class TestLinuxBackendWriteOperations < Test::Unit::TestCase
     assert_equal users.length, result.entry_count
   end
 
+  def test_write_passwd_dry_run_reports_validation_errors
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    users = backend.each_user.map { |u| EtcUtils::User.new(**u) }
+    users << users.first.dup
+
+    result = backend.write_passwd(users, dry_run: true)
+
+    refute result.valid?
+    assert_includes result.errors, "Duplicate user name #{users.first.name}"
+  end
+
+  def test_write_passwd_refuses_invalid_entries
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    bad = EtcUtils::User.new(name: "bad:name", passwd: "x", uid: 0, gid: 0, gecos: "", dir: "/", shell: "")
+
+    assert_raise(EtcUtils::ValidationError) do
+      backend.write_passwd([bad], backup: false, validate: true)
+    end
+  end
+
+  def test_write_passwd_with_stale_version_fails_fast
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    users, = EtcUtils.read_versioned(:passwd)
+    stale = EtcUtils::FileVersion.new(0, 0, 0, 0, 0)
+    before = File.read("/etc/passwd")
+
+    error = assert_raise(EtcUtils::ConcurrentModificationError) do
+      backend.write_passwd(users, backup: false, expected_version: stale)
+    end
+    assert_equal stale, error.expected
+    assert_equal backend.file_version(:passwd), error.actual
+    assert_equal before, File.read("/etc/passwd")
+    refute backend.locked?
+  end
+
+  def test_write_passwd_dry_run_reports_version_conflict
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    users, version = EtcUtils.read_versioned(:passwd)
+
+    assert backend.write_passwd(users, dry_run: true, expected_version: version).valid?
+
+    result = backend.write_passwd(users, dry_run: true, expected_version: EtcUtils::FileVersion.new(0, 0, 0, 0, 0))
+    refute result.valid?
+    assert_includes result.errors, "/etc/passwd has changed since it was read"
+  end
+
+  def test_nested_with_lock_keeps_outer_lock
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+
+    backend.with_lock do
+      backend.with_lock { assert backend.locked? }
+      assert backend.locked?
+      File.open("/etc/.pwd.lock") do |f|
+        refute f.flock(File::LOCK_EX | File::LOCK_NB), "file lock released by inner block"
+      end
+    end
+    refute backend.locked?
+  end
+
+  def test_with_lock_is_owned_per_thread
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    held = Queue.new
+    done = Queue.new
+
+    holder = Thread.new do
+      backend.with_lock do
+        held << true
+        done.pop
+      end
+    end
+    held.pop
+
+    refute backend.locked?
+    backend.send(:release_lock)
+    assert_raise(EtcUtils::LockError) { backend.with_lock(timeout: 0.2) { flunk "lock acquired twice" } }
+
+    done << true
+    holder.join
+    assert_equal :ok, backend.with_lock(timeout: 1) { :ok }
+  end
+
+  def test_writers_serialize_across_threads
+    backend = EtcUtils::Backend::Registry.backend_for(:linux)
+    inside = 0
+    overlap = false
+    mutex = Mutex.new
+
+    threads = 4.times.map do
+      Thread.new do
+        3.times do
+          backend.with_lock do
+            mutex.synchronize { inside += 1 }
+            overlap ||= inside > 1
+            sleep 0.01
+            mutex.synchronize { inside -= 1 }
+          end
+        end
+      end
+    end
+    threads.each(&:join)
+
+    refute overlap
+    refute backend.locked?
+  end
+
   def test_with_lock
     backend = EtcUtils::Backend::Registry.backend_for(:linux)
 
@@ -179,3 +431,582 @@ class TestLinuxBackendWriteOperations < Test::Unit::TestCase
     refute backend.locked?
   end
 end
+
+# Tests against a temporary root directory; these write real files
+class TestLinuxBackendRoot < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+  end
+
+  def alice
+    { name: "alice", passwd: "x", uid: 1000, gid: 1000, gecos: "", dir: "/home/alice", shell: "/bin/sh" }
+  end
+
+  def test_paths_are_resolved_under_root
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+
+      assert_equal File.join(root, "etc/passwd"), backend.passwd_path
+      assert_equal File.join(root, "etc/gshadow"), backend.gshadow_path
+      assert_equal File.join(root, "etc/.pwd.lock"), backend.lock_path
+    end
+    assert_equal "/etc/shadow", EtcUtils::Backend::Linux.new(root: "/").shadow_path
+    assert_nil EtcUtils::Backend::Linux.new.root
+  end
+
+  def test_reads_from_root
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+
+      assert_equal %w[root bin], backend.each_user.map { |u| u[:name] }
+      assert_equal 2, backend.count_groups
+      assert backend.user_exists?(1)
+      refute backend.user_exists?("alice")
+      shadow = backend.find_shadow("bin")
+      assert_equal ["*", 19_000, nil], shadow.values_at(:passwd, :last_change, :expire_date)
+    end
+  end
+
+  def test_write_passwd_under_root
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      users, version = backend.read_versioned(:passwd)
+
+      backend.write_passwd(users + [alice], expected_version: version)
+
+      assert_equal %w[root bin alice], backend.each_user.map { |u| u[:name] }
+      assert_equal TEMP_ROOT_PASSWD, File.read("#{backend.passwd_path}-")
+      assert File.exist?(backend.lock_path)
+      assert_raise(EtcUtils::ConcurrentModificationError) do
+        backend.write_passwd(users, expected_version: version)
+      end
+    end
+  end
+
+  def test_write_passwd_accepts_shared_uids
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      users, = backend.read_versioned(:passwd)
+      toor = users.first.merge(name: "toor")
+
+      assert_include backend.write_passwd(users + [toor], dry_run: true).warnings, "Duplicate UID 0 (root, toor)"
+      backend.write_passwd(users + [toor], backup: false)
+      assert_equal [0, 1, 0], backend.each_user.map { |u| u[:uid] }
+    end
+  end
+
+  def test_validator_resolves_shells_under_root
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      FileUtils.mkdir_p(File.join(root, "bin"))
+      File.write(File.join(root, "bin/sh"), "")
+
+      result = backend.write_passwd([alice.merge(shell: "/bin/sh"), alice.merge(name: "bob", uid: 1001, shell: "/bin/zsh")],
+                                    dry_run: true)
+      assert_equal ["Shell does not exist: /bin/zsh"], result.warnings
+    end
+  end
+
+  def test_find_line_fallback_matches_native
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      fallback = EtcUtils::Backend::Linux.new(root: root)
+      fallback.define_singleton_method(:native?) { |_method| false }
+      keys = [[0, "root"], [0, "root:x"], [0, "ro"], [2, 1], [2, -1], [3, "1"], [0, "bin:x:1"]]
+
+      keys.each do |field, key|
+        expected = backend.send(:scan_line, backend.passwd_path, field, key)
+        assert_equal expected, fallback.send(:scan_line, fallback.passwd_path, field, key), [field, key].inspect
+      end
+      refute fallback.user_exists?("root:x")
+      assert fallback.user_exists?("root")
+    end
+  end
+
+  def test_shadow_round_trips_minus_one_days
+    with_temp_root(shadow: "root:!:19000:0:99999:7:-1:-1:\nbin:*:19000:0:99999:7:::\n") do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      before = File.read(backend.shadow_path)
+      shadows, version = backend.read_versioned(:shadow)
+
+      assert backend.write_shadow(shadows, dry_run: true).valid?
+      backend.write_shadow(shadows, validate: true, expected_version: version)
+      assert_equal before, File.read(backend.shadow_path)
+    end
+  end
+
+  def test_validation_errors_only_refuse_writes_when_asked
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      users = backend.each_user.to_a
+      users << users.first.merge(uid: 5)
+
+      assert_raise(EtcUtils::ValidationError) { backend.write_passwd(users, validate: true) }
+      assert_equal 2, backend.count_users
+
+      backend.write_passwd(users)
+      assert_equal [0, 1, 5], backend.each_user.map { |u| u[:uid] }
+    end
+  end
+
+  def test_roots_have_independent_locks
+    with_temp_root do |a|
+      with_temp_root do |b|
+        first = EtcUtils::Backend::Linux.new(root: a)
+        second = EtcUtils::Backend::Linux.new(root: b)
+
+        first.with_lock do
+          assert_equal :ok, Thread.new { second.with_lock(timeout: 0.5) { :ok } }.value
+        end
+      end
+    end
+  end
+
+  def test_waiting_thread_is_woken_on_release
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      held = Queue.new
+      waiter = nil
+      released_at = nil
+
+      backend.with_lock do
+        waiter = Thread.new do
+          held << true
+          backend.with_lock(timeout: 5) { Process.clock_gettime(Process::CLOCK_MONOTONIC) }
+        end
+        held.pop
+        sleep 0.01 until waiter.status == "sleep"
+        released_at = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+
+      # Handed over on release rather than at the next poll
+      assert_operator waiter.value - released_at, :<, EtcUtils::Backend::Linux::LOCK_POLL_INTERVAL / 2
+    end
+  end
+end
+
+class TestLinuxBackendInterning < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+  end
+
+  def teardown
+    EtcUtils.intern_strings = false
+  end
+
+  def test_default_fields_are_mutable
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      users = backend.each_user.to_a
+
+      refute EtcUtils.intern_strings?
+      refute users.first[:shell].frozen?
+      refute users.first[:passwd].frozen?
+    end
+  end
+
+  def test_low_cardinality_fields_are_shared
+    with_temp_root(passwd: TEMP_ROOT_PASSWD + "alice:x:1000:1000::/home/alice:/bin/sh\n") do |root|
+      EtcUtils.intern_strings = true
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      root_user, _bin, alice = backend.each_user.to_a
+
+      assert root_user[:shell].frozen?
+      assert_same root_user[:shell], alice[:shell]
+      assert_same root_user[:passwd], alice[:passwd]
+      refute root_user[:dir].frozen?
+    end
+  end
+
+  def test_members_and_placeholders_are_shared
+    with_temp_root(gshadow: "root:!::\nbin:!:root:root\n") do |root|
+      EtcUtils.intern_strings = true
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      root_group, bin_group = backend.each_gshadow.to_a
+
+      assert_same root_group[:passwd], bin_group[:passwd]
+      assert_same bin_group[:admins].first, bin_group[:members].first
+      assert_same backend.find_group("bin")[:members].first, bin_group[:members].first
+    end
+  end
+
+  def test_password_hashes_are_not_interned
+    hash = "$6$salt$#{"a" * 86}"
+    with_temp_root(shadow: "root:#{hash}:19000:0:99999:7:::\n") do |root|
+      EtcUtils.intern_strings = true
+      shadow = EtcUtils::Backend::Linux.new(root: root).find_shadow("root")
+
+      assert_equal hash, shadow[:passwd]
+      refute shadow[:passwd].frozen?
+    end
+  end
+end
+
+class TestLinuxBackendIdTable < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+  end
+
+  def test_table_is_reused_until_file_changes
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      table = backend.user_id_table
+
+      assert_same table, backend.user_id_table
+      assert_equal ["root", nil], table.names_for([0, 1000])
+
+      File.write(backend.passwd_path, TEMP_ROOT_PASSWD + "alice:x:1000:1000::/home/alice:/bin/sh\n")
+      assert_not_same table, backend.user_id_table
+      assert_equal %w[root alice], backend.user_id_table.names_for([0, 1000])
+    end
+  end
+
+  def test_group_table_skips_comments
+    with_temp_root(group: "# comment\n\nroot:x:0:\nbin:x:1:root\n") do |root|
+      table = EtcUtils::Backend::Linux.new(root: root).group_id_table
+
+      assert_equal %w[root bin], table.names_for([0, 1])
+      assert_equal 2, table.size
+    end
+  end
+end
+
+class TestLinuxBackendMissCache < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+  end
+
+  # Count scans of a database made through find_line or each_user
+  def count_scans(backend, path)
+    scans = 0
+    backend.define_singleton_method(:find_line) do |p, *args|
+      scans += 1 if p == path
+      super(p, *args)
+    end
+    backend.define_singleton_method(:each_user) do |&block|
+      scans += 1 if block
+      super(&block)
+    end
+    yield
+    scans
+  end
+
+  def test_missing_names_are_answered_without_rescanning
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      scans = count_scans(backend, backend.passwd_path) do
+        3.times do
+          refute backend.user_exists?("svc-foo")
+          assert_nil backend.find_user("svc-foo")
+          assert_nil backend.find_user(12_345)
+        end
+      end
+
+      assert_equal 2, scans
+    end
+  end
+
+  def test_hits_are_not_cached
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      scans = count_scans(backend, backend.passwd_path) do
+        2.times { assert backend.user_exists?("bin") }
+      end
+
+      assert_equal 2, scans
+    end
+  end
+
+  def test_misses_are_forgotten_when_the_file_changes
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      refute backend.group_exists?("svc")
+      assert_nil backend.find_shadow("svc")
+
+      File.write(backend.group_path, TEMP_ROOT_GROUP + "svc:x:900:\n")
+      File.write(backend.shadow_path, TEMP_ROOT_SHADOW + "svc:!:19000::::::\n")
+
+      assert backend.group_exists?("svc")
+      assert_equal 900, backend.find_group("svc")[:gid]
+      assert_equal "!", backend.find_shadow("svc")[:passwd]
+    end
+  end
+
+  def test_names_and_ids_are_distinct_keys
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+
+      assert_nil backend.find_user("0")
+      assert_equal "root", backend.find_user(0)[:name]
+    end
+  end
+end
+
+class TestLinuxBackendSubid < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+  end
+
+  def with_subuid(content)
+    with_temp_root do |root|
+      File.write(File.join(root, "etc", "subuid"), content) if content
+      yield EtcUtils::Backend::Linux.new(root: root)
+    end
+  end
+
+  def test_missing_file_has_no_ranges
+    with_subuid(nil) do |backend|
+      assert_equal [], backend.each_subuid.to_a
+      assert_equal 100_000, backend.next_subuid
+    end
+  end
+
+  def test_reads_ranges
+    with_subuid("alice:100000:65536\n# comment\nalice:300000:10\n1001:165536:65536\n") do |backend|
+      assert_equal [
+        { name: "alice", start: 100_000, count: 65_536 },
+        { name: "alice", start: 300_000, count: 10 },
+        { name: "1001", start: 165_536, count: 65_536 }
+      ], backend.each_subuid.to_a
+
+      entries, version = backend.read_versioned(:subuid)
+      assert_equal 3, entries.size
+      assert_equal backend.file_version(:subuid), version
+    end
+  end
+
+  def test_next_subuid_uses_first_gap
+    with_subuid("alice:100000:65536\nbob:231072:65536\n") do |backend|
+      assert_equal 165_536, backend.next_subuid
+      assert_equal 296_608, backend.next_subuid(count: 65_537)
+      assert_equal 500_000, backend.next_subuid(min: 500_000)
+      assert_raise(EtcUtils::RangeExhaustedError) { backend.next_subuid(max: 200_000) }
+    end
+  end
+
+  def test_tree_is_reused_until_file_changes
+    with_subuid("alice:100000:65536\n") do |backend|
+      events = []
+      EtcUtils::Instrumentation.subscribe(:cache_hit) { |event| events << event.payload[:cache] }
+      begin
+        backend.next_subuid
+        backend.next_subuid
+        assert_equal [:subid_tree], events
+
+        File.write(backend.subuid_path, "alice:100000:65536\nbob:165536:65536\n")
+        assert_equal 231_072, backend.next_subuid
+      ensure
+        EtcUtils::Instrumentation.unsubscribe_all
+      end
+    end
+  end
+
+  def test_allocate_writes_one_range_per_owner
+    with_subuid("alice:100000:65536\nbob:231072:65536\n") do |backend|
+      added = backend.allocate_subuids(%w[carol dave], backup: false)
+
+      assert_equal [
+        { name: "carol", start: 165_536, count: 65_536 },
+        { name: "dave", start: 296_608, count: 65_536 }
+      ], added
+      assert_equal "alice:100000:65536\nbob:231072:65536\ncarol:165536:65536\ndave:296608:65536\n",
+                   File.read(backend.subuid_path)
+      assert_false backend.locked?
+    end
+  end
+
+  def test_allocate_creates_subgid_file
+    with_subuid(nil) do |backend|
+      backend.allocate_subgids("alice", count: 1000, min: 200_000)
+
+      assert_equal "alice:200000:1000\n", File.read(backend.subgid_path)
+      assert_false File.exist?(backend.subuid_path)
+    end
+  end
+
+  def test_allocate_fails_without_writing_when_exhausted
+    with_subuid("alice:100000:65536\n") do |backend|
+      assert_raise(EtcUtils::RangeExhaustedError) do
+        backend.allocate_subuids(%w[bob carol], max: 231_071)
+      end
+      assert_equal "alice:100000:65536\n", File.read(backend.subuid_path)
+    end
+  end
+
+  def test_write_subuid_dry_run_reports_changes_by_range
+    with_subuid("alice:100000:65536\nalice:300000:10\n") do |backend|
+      entries = [{ name: "alice", start: 100_000, count: 65_536 }, { name: "bob", start: 165_536, count: 65_536 }]
+      result = backend.write_subuid(entries, dry_run: true)
+
+      assert_equal "alice:100000:65536\nbob:165536:65536\n", result.content
+      assert_equal [
+        { type: :added, name: "bob", start: 165_536, count: 65_536 },
+        { type: :removed, name: "alice", start: 300_000, count: 10 }
+      ], result.changes
+    end
+  end
+
+  def test_write_subuid_dry_run_content_ignores_later_changes
+    with_subuid("alice:100000:65536\n") do |backend|
+      entries = [{ name: "alice", start: 100_000, count: 65_536 }]
+      result = backend.write_subuid(entries, dry_run: true)
+      entries << { name: "bob", start: 165_536, count: 65_536 }
+      entries.shift
+
+      assert_equal "alice:100000:65536\n", result.content
+    end
+  end
+
+  def test_write_subuid_refuses_invalid_ranges
+    with_subuid("alice:100000:65536\n") do |backend|
+      assert_raise(EtcUtils::ValidationError) do
+        backend.write_subuid([{ name: "alice", start: 100_000, count: 0 }])
+      end
+    end
+  end
+end
+
+class TestLinuxBackendProvision < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+  end
+
+  def test_provision_writes_every_file_once
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      writes = []
+      EtcUtils::Instrumentation.subscribe(:write) { |event| writes << File.basename(event.payload[:path]) }
+      begin
+        users = backend.provision([{ name: "alice", groups: ["bin"] }, { name: "bob", shell: "/bin/bash" }])
+
+        assert_equal [[1000, 1000], [1001, 1001]], users.map { |u| [u[:uid], u[:gid]] }
+        assert_equal %w[passwd group shadow gshadow], writes
+      ensure
+        EtcUtils::Instrumentation.unsubscribe_all
+      end
+
+      assert_equal ["alice:x:1000:1000::/home/alice:/bin/sh\n", "bob:x:1001:1001::/home/bob:/bin/bash\n"],
+                   File.readlines(backend.passwd_path).last(2)
+      assert_equal "bin:x:1:root,alice\nalice:x:1000:\nbob:x:1001:\n", File.read(backend.group_path).lines[1..].join
+      assert_match(/\Aalice:!:\d+:0:99999:7:::\n/, File.readlines(backend.shadow_path)[2])
+      assert_equal "bin:::root,alice\nalice:!::\nbob:!::\n", File.read(backend.gshadow_path).lines[1..].join
+      assert File.exist?("#{backend.passwd_path}-")
+      assert_false backend.locked?
+    end
+  end
+
+  def test_files_are_written_before_the_lock_is_taken
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      locked = []
+      EtcUtils::Instrumentation.subscribe(:write) { locked << backend.locked? }
+      begin
+        backend.provision([{ name: "alice" }])
+        users, version = backend.read_versioned(:passwd)
+        backend.write_passwd(users, expected_version: version)
+      ensure
+        EtcUtils::Instrumentation.unsubscribe_all
+      end
+
+      assert_equal [false] * 5, locked
+    end
+  end
+
+  def test_provision_plans_again_after_a_concurrent_write
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      plans = 0
+      backend.define_singleton_method(:plan_provision) do |specs|
+        result = super(specs)
+        # Another writer takes UID 1000 between planning and the lock
+        File.write(passwd_path, "eve:x:1000:1000::/home/eve:/bin/sh\n", mode: "a") if (plans += 1) == 1
+        result
+      end
+
+      users = backend.provision([{ name: "alice" }])
+
+      assert_equal 2, plans
+      assert_equal 1001, users.first[:uid]
+      assert_equal %w[root bin eve alice], backend.each_user.map { |u| u[:name] }
+      assert_equal %w[.pwd.lock group group- gshadow gshadow- passwd passwd- shadow shadow-],
+                   Dir.children(File.join(root, "etc")).sort
+    end
+  end
+
+  def test_provision_dry_run
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      before = File.read(backend.passwd_path)
+      result = backend.provision([{ name: "alice", groups: ["bin"] }], dry_run: true)
+
+      assert_kind_of EtcUtils::DryRunResult, result
+      assert result.valid?
+      assert_equal before + "alice:x:1000:1000::/home/alice:/bin/sh\n", result.content
+      assert_equal %i[passwd group group shadow gshadow gshadow], result.changes.map { |c| c[:database] }
+      assert_equal %w[alice], result.metadata[:users].map { |u| u[:name] }
+      assert_equal "alice:x:1000:\n", result.metadata[:files][:group].each_line.to_a.last
+      assert_equal before, File.read(backend.passwd_path)
+    end
+  end
+
+  def test_malformed_lines_are_skipped_by_every_reader
+    with_temp_root(passwd: "#{TEMP_ROOT_PASSWD}broken:x:1\n", group: "#{TEMP_ROOT_GROUP}broken\n") do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+
+      assert_equal %w[root bin], backend.read_versioned(:passwd).first.map { |u| u[:name] }
+      assert_equal backend.each_user.count, backend.count_users
+      assert_equal backend.each_group.count, backend.count_groups
+
+      result = backend.provision([{ name: "alice" }], dry_run: true)
+      assert_equal [], result.errors
+      assert_equal "#{TEMP_ROOT_PASSWD}alice:x:1000:1000::/home/alice:/bin/sh\n", result.content
+    end
+  end
+
+  def test_provision_is_all_or_nothing
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      before = Dir[File.join(root, "etc", "*")].sort.map { |f| File.read(f) }
+
+      error = assert_raise(EtcUtils::ValidationError) do
+        backend.provision([{ name: "alice" }, { name: "bin" }, { name: "bob", gecos: "a:b" }])
+      end
+      assert_equal ["User bin already exists", "Invalid gecos for bob: contains ':' or newline"], error.errors
+      assert_equal before, Dir[File.join(root, "etc", "*")].sort.map { |f| File.read(f) }
+
+      result = backend.provision([{ name: "bin" }], dry_run: true)
+      assert_equal ["User bin already exists"], result.errors
+    end
+  end
+
+  def test_provision_without_shadow_files
+    with_temp_root(shadow: nil, gshadow: nil) do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      backend.provision([{ name: "alice" }])
+
+      assert_equal "alice:!:1000:1000::/home/alice:/bin/sh\n", File.readlines(backend.passwd_path).last
+      assert_false File.exist?(backend.shadow_path)
+    end
+  end
+
+  def test_provision_ten_thousand_users
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      specs = Array.new(10_000) { |i| { name: "user#{i}", groups: ["bin"] } }
+      started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      backend.provision(specs, backup: false)
+      elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+
+      assert_equal 10_002, backend.count_users
+      assert_equal 10_002, backend.count_groups
+      assert_equal 10_001, backend.find_group("bin")[:members].size
+      assert_operator elapsed, :<, 5.0
+    end
+  end
+end
@@ -0,0 +1,118 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TestMergeJoin < Test::Unit::TestCase
+  def join(left, right)
+    pairs = []
+    EtcUtils::MergeJoin.each(source(left), source(right)) do |l, r|
+      pairs << [l && l[:name], r && r[:name]]
+    end
+    pairs
+  end
+
+  def source(names)
+    EtcUtils::MergeJoin.source(names.map { |n| { name: n } }.each)
+  end
+
+  def test_same_order_pairs_in_lockstep
+    pairs = join(%w[root bin daemon], %w[root bin daemon])
+
+    assert_equal [%w[root root], %w[bin bin], %w[daemon daemon]], pairs
+  end
+
+  def test_out_of_order_entries_are_matched
+    pairs = join(%w[root bin daemon], %w[daemon root bin])
+
+    assert_equal 3, pairs.length
+    pairs.each { |l, r| assert_equal l, r }
+  end
+
+  def test_left_orphans_yield_nil_right
+    pairs = join(%w[root alice bin], %w[root bin])
+
+    assert_includes pairs, ["alice", nil]
+    assert_includes pairs, %w[root root]
+    assert_includes pairs, %w[bin bin]
+    assert_equal 3, pairs.length
+  end
+
+  def test_right_orphans_yield_nil_left
+    pairs = join(%w[root], %w[root ghost other])
+
+    assert_equal [%w[root root], [nil, "ghost"], [nil, "other"]], pairs
+  end
+
+  def test_parked_entries_are_released_when_other_side_ends
+    pairs = join(%w[a b c d e], %w[x y e])
+
+    # a, b and c can no longer be matched once the right side ends, so they
+    # are reported then instead of being held until the end
+    assert_equal [["a", nil], ["b", nil], ["c", nil], ["d", nil], %w[e e], [nil, "x"], [nil, "y"]], pairs
+  end
+
+  def test_empty_sides
+    assert_equal [], join([], [])
+    assert_equal [["root", nil]], join(%w[root], [])
+    assert_equal [[nil, "root"]], join([], %w[root])
+  end
+
+  def test_duplicate_names_are_not_lost
+    pairs = join(%w[dup x dup], %w[y dup])
+
+    assert_equal 4, pairs.length
+    assert_equal 3, pairs.count { |l, _| l }
+  end
+
+  def test_returns_enumerator_without_block
+    enum = EtcUtils::MergeJoin.each(source(%w[a]), source(%w[a]))
+
+    assert_kind_of Enumerator, enum
+  end
+
+  def test_collection_each_with_shadow_builds_structs
+    skip_if_v1_extension
+    users = EtcUtils::UserCollection.new(JoinBackend.new)
+    pairs = users.each_with_shadow.to_a
+
+    assert_equal 2, pairs.length
+    user, shadow = pairs.first
+    assert_kind_of EtcUtils::User, user
+    assert_kind_of EtcUtils::Shadow, shadow
+    assert_equal "root", shadow.name
+    assert_nil pairs.last.last
+  end
+
+  def test_collection_each_with_gshadow_builds_structs
+    skip_if_v1_extension
+    groups = EtcUtils::GroupCollection.new(JoinBackend.new)
+    group, gshadow = groups.each_with_gshadow.first
+
+    assert_kind_of EtcUtils::Group, group
+    assert_kind_of EtcUtils::GShadow, gshadow
+    assert_equal %w[alice], gshadow.members
+  end
+
+  def test_base_backend_raises_unsupported
+    backend = EtcUtils::Backend::Base.new
+    def backend.platform_name; :mock; end
+
+    assert_raise(EtcUtils::UnsupportedError) { backend.each_user_with_shadow }
+    assert_raise(EtcUtils::UnsupportedError) { backend.each_group_with_gshadow }
+  end
+
+  class JoinBackend < EtcUtils::Backend::Base
+    def each_user_with_shadow
+      yield({ name: "root", uid: 0, gid: 0 }, { name: "root", passwd: "*" })
+      yield({ name: "alice", uid: 1000, gid: 1000 }, nil)
+    end
+
+    def each_group_with_gshadow
+      yield({ name: "wheel", gid: 10, members: [] }, { name: "wheel", admins: [], members: %w[alice] })
+    end
+
+    def platform_name
+      :mock
+    end
+  end
+end
@@ -0,0 +1,176 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "tempfile"
+
+class TestNative < Test::Unit::TestCase
+  def setup
+    super
+    omit("Native helpers require the C extension") unless defined?(EtcUtils::Native)
+  end
+
+  def with_db(content)
+    file = Tempfile.new("etcutils-native")
+    file.write(content)
+    file.close
+    yield file.path
+  ensure
+    file&.unlink
+  end
+
+  def test_count_entries_skips_blank_and_comment_lines
+    with_db("# header\nroot:x:0:0::/root:/bin/sh\n\n   \nbin:x:1:1::/bin:/sbin/nologin\n#tail\n") do |path|
+      assert_equal 2, EtcUtils::Native.count_entries(path)
+    end
+  end
+
+  def test_count_entries_skips_short_lines
+    with_db("root:x:0:0::/root:/bin/sh\nbroken:x:1\nbin:x:1:1::/bin:/sbin/nologin") do |path|
+      assert_equal 3, EtcUtils::Native.count_entries(path)
+      assert_equal 2, EtcUtils::Native.count_entries(path, 7)
+      assert_equal 0, EtcUtils::Native.count_entries(path, 8)
+    end
+  end
+
+  def test_count_entries_without_trailing_newline
+    with_db("root:x:0:0::/root:/bin/sh\nbin:x:1:1::/bin:/sbin/nologin") do |path|
+      assert_equal 2, EtcUtils::Native.count_entries(path)
+    end
+  end
+
+  def test_count_entries_across_buffer_boundaries
+    line = "u:x:1:1:#{"g" * 100_000}:/:/bin/sh\n"
+    with_db(line * 3) do |path|
+      assert_equal 3, EtcUtils::Native.count_entries(path)
+    end
+  end
+
+  def test_count_entries_missing_file_raises
+    assert_raise(Errno::ENOENT) do
+      EtcUtils::Native.count_entries("/nonexistent/etcutils/passwd")
+    end
+  end
+
+  def test_find_line_by_name_requires_full_field
+    with_db("rootkit:x:5:5::/:/bin/sh\nroot:x:0:0::/root:/bin/sh\n") do |path|
+      assert_equal "root:x:0:0::/root:/bin/sh", EtcUtils::Native.find_line(path, 0, "root")
+      assert_nil EtcUtils::Native.find_line(path, 0, "roo")
+    end
+  end
+
+  def test_find_line_by_id_compares_numerically
+    with_db("# 0\nbin:x:010:1::/:/bin/sh\nroot:x:0:0::/root:/bin/sh\n") do |path|
+      assert_equal "root:x:0:0::/root:/bin/sh", EtcUtils::Native.find_line(path, 2, 0)
+      assert_match(/\Abin:/, EtcUtils::Native.find_line(path, 2, 10))
+      assert_nil EtcUtils::Native.find_line(path, 2, 99)
+      assert_nil EtcUtils::Native.find_line(path, 2, -1)
+    end
+  end
+
+  def test_find_line_out_of_range_ids_match_nothing
+    # 2**64 would wrap around to 0 without the overflow check
+    with_db("big:x:18446744073709551616:1::/:/bin/sh\nroot:x:0:0::/root:/bin/sh\n") do |path|
+      assert_match(/\Aroot:/, EtcUtils::Native.find_line(path, 2, 0))
+      assert_nil EtcUtils::Native.find_line(path, 2, 2**64)
+      assert_nil EtcUtils::Native.find_line(path, 2, 2**70)
+    end
+  end
+
+  def test_find_line_ignores_short_lines
+    with_db("broken\nroot:x:0:0::/root:/bin/sh\n") do |path|
+      assert_nil EtcUtils::Native.find_line(path, 2, 5)
+      assert_not_nil EtcUtils::Native.find_line(path, 2, 0)
+    end
+  end
+
+  PasswdRow = Struct.new(:name, :passwd, :uid, :gid, :gecos, :dir, :shell, keyword_init: true)
+
+  def test_serialize_passwd_hashes_and_structs
+    rows = [
+      { name: "root", passwd: "x", uid: 0, gid: 0, gecos: "root", dir: "/root", shell: "/bin/sh" },
+      PasswdRow.new(name: "bin", passwd: "x", uid: 1, gid: 1, gecos: nil, dir: "/bin", shell: "/sbin/nologin")
+    ]
+
+    assert_equal "root:x:0:0:root:/root:/bin/sh\nbin:x:1:1::/bin:/sbin/nologin\n",
+                 EtcUtils::Native.serialize(:passwd, rows)
+  end
+
+  def test_serialize_group_and_gshadow_lists
+    assert_equal "wheel:x:10:alice,bob\nnobody:x:65534:\n",
+                 EtcUtils::Native.serialize(:group, [
+                   { name: "wheel", passwd: "x", gid: 10, members: %w[alice bob] },
+                   { name: "nobody", passwd: "x", gid: 65_534, members: [] }
+                 ])
+    assert_equal "wheel:!:root:alice\n",
+                 EtcUtils::Native.serialize(:gshadow, [
+                   { name: "wheel", passwd: "!", admins: ["root"], members: ["alice"] }
+                 ])
+  end
+
+  def test_serialize_shadow_blank_numeric_fields
+    row = { name: "alice", passwd: "!", last_change: 19_000, min_days: 0, max_days: 99_999,
+            warn_days: 7, inactive_days: nil, expire_date: nil, reserved: nil }
+
+    assert_equal "alice:!:19000:0:99999:7:::\n", EtcUtils::Native.serialize(:shadow, [row])
+  end
+
+  def test_serialize_empty_and_unknown_type
+    assert_equal "\n", EtcUtils::Native.serialize(:passwd, [])
+    assert_raise(ArgumentError) { EtcUtils::Native.serialize(:hosts, []) }
+  end
+
+  def test_serialize_negative_and_large_integers
+    row = { name: "n", passwd: "x", uid: -1, gid: 2**70, gecos: "", dir: "/", shell: "" }
+
+    assert_equal "n:x:-1:#{2**70}::/:\n", EtcUtils::Native.serialize(:passwd, [row])
+  end
+
+  # Every kernel must agree with String#split, including the tails that
+  # don't fill a whole block and runs longer than one batch of offsets
+  def each_tokenizer_kernel
+    original = EtcUtils::Native.tokenizer_kernel
+    EtcUtils::Native.tokenizer_kernels.each do |kernel|
+      EtcUtils::Native.tokenizer_kernel = kernel
+      yield kernel
+    end
+  ensure
+    EtcUtils::Native.tokenizer_kernel = original
+  end
+
+  def test_split_matches_string_split_for_every_kernel
+    rng = Random.new(46)
+    inputs = ["", ":", "::", "a", "a:", ":a", "a::b::", "root:x:0:0:root:/root:/bin/sh"]
+    inputs += Array.new(200) { Array.new(rng.rand(0..130)) { ["a", "b", ":", ","].sample(random: rng) }.join }
+    inputs << "u:x:1000:1000:#{"G" * 4099}:/home/u:/bin/sh"
+    inputs << "big:x:100:#{Array.new(5000) { |i| "user#{i}" }.join(",")}"
+    inputs << ("," * 200) + "z"
+
+    each_tokenizer_kernel do |kernel|
+      inputs.each do |input|
+        [":", ","].each do |delim|
+          assert_equal input.split(delim), EtcUtils::Native.split(input, delim),
+                       "#{kernel} split #{input[0, 40].inspect} on #{delim.inspect}"
+        end
+      end
+    end
+  end
+
+  def test_tokenizer_kernels
+    kernels = EtcUtils::Native.tokenizer_kernels
+    assert_include kernels, :scalar
+    assert_include kernels, EtcUtils::Native.tokenizer_kernel
+    assert_raise(ArgumentError) { EtcUtils::Native.tokenizer_kernel = :nope }
+    assert_raise(ArgumentError) { EtcUtils::Native.split("a:b", "::") }
+  end
+
+  def test_count_entries_for_every_kernel
+    lines = Array.new(300) { |i| "u#{i}:x:#{i}:#{i}::/home/u#{i}:/bin/sh\n" }.join
+    with_db("# header\n\n#{lines}") do |path|
+      each_tokenizer_kernel do |kernel|
+        assert_equal 300, EtcUtils::Native.count_entries(path), kernel.to_s
+        assert_equal "u257:x:257:257::/home/u257:/bin/sh",
+                     EtcUtils::Native.find_line(path, 2, 257), kernel.to_s
+      end
+    end
+  end
+end
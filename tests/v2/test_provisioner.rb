@@ -0,0 +1,121 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TestProvisioner < Test::Unit::TestCase
+  PASSWD = [
+    { name: "root", passwd: "x", uid: 0, gid: 0, gecos: "", dir: "/root", shell: "/bin/sh" },
+    { name: "alice", passwd: "x", uid: 1000, gid: 1000, gecos: "", dir: "/home/alice", shell: "/bin/sh" }
+  ].freeze
+  GROUP = [
+    { name: "root", passwd: "x", gid: 0, members: [] },
+    { name: "alice", passwd: "x", gid: 1000, members: [] },
+    { name: "docker", passwd: "x", gid: 1001, members: ["alice"] }
+  ].freeze
+  GSHADOW = [{ name: "docker", passwd: "!", admins: [], members: ["alice"] }].freeze
+
+  def plan(specs, shadow: [], gshadow: GSHADOW)
+    EtcUtils::Provisioner.plan(specs, passwd: PASSWD, group: GROUP, shadow: shadow, gshadow: gshadow, today: 20_000)
+  end
+
+  def test_allocates_after_highest_id_with_private_groups
+    result = plan([{ name: "bob" }, { name: "carol" }])
+
+    assert result.valid?
+    # GID 1001 is taken by docker, so bob's private group gets the next free GID
+    assert_equal [[1001, 1002], [1002, 1003]], result.users.map { |u| [u[:uid], u[:gid]] }
+    assert_equal %w[bob carol], result.group.last(2).map { |g| g[:name] }
+    assert_equal [1002, 1003], result.group.last(2).map { |g| g[:gid] }
+    assert_equal({ name: "bob", passwd: "!", admins: [], members: [] }, result.gshadow[1])
+    assert_equal "/home/bob", result.users.first[:dir]
+  end
+
+  def test_shadow_entries
+    result = plan([{ name: "bob", password: "$6$salt$hash" }])
+
+    assert_equal "x", result.passwd.last[:passwd]
+    assert_equal({ name: "bob", passwd: "$6$salt$hash", last_change: 20_000, min_days: 0, max_days: 99_999,
+                   warn_days: 7, inactive_days: nil, expire_date: nil, reserved: nil }, result.shadow.last)
+  end
+
+  def test_without_shadow_files
+    result = plan([{ name: "bob" }], shadow: nil, gshadow: nil)
+
+    assert_nil result.shadow
+    assert_nil result.gshadow
+    assert_equal "!", result.passwd.last[:passwd]
+  end
+
+  def test_supplementary_groups_do_not_mutate_input
+    result = plan([{ name: "bob", groups: ["docker"] }, { name: "carol", groups: %w[docker bob] }])
+
+    assert_equal %w[alice bob carol], result.group[2][:members]
+    assert_equal %w[alice bob carol], result.gshadow[0][:members]
+    assert_equal ["carol"], result.group.find { |g| g[:name] == "bob" }[:members]
+    assert_equal ["alice"], GROUP[2][:members]
+    assert_equal ["alice"], GSHADOW[0][:members]
+  end
+
+  def test_primary_group_and_explicit_ids
+    result = plan([{ name: "bob", group: "docker" }, { name: "carol", uid: 5000, gid: 1001 },
+                   { name: "svc", system: true }])
+
+    assert result.valid?
+    assert_equal [[1001, 1001], [5000, 1001], [999, 999]], result.users.map { |u| [u[:uid], u[:gid]] }
+    assert_equal %w[root alice docker svc], result.group.map { |g| g[:name] }
+  end
+
+  def test_errors
+    result = plan([
+      { name: "alice" },
+      { name: "" },
+      { name: "bob", uid: 0 },
+      { name: "carol", groups: ["missing"] },
+      { name: "dave", group: "missing" },
+      { name: "docker" },
+      { name: "erin", gid: 4242 }
+    ])
+
+    assert_equal [
+      "User alice already exists",
+      "Missing user name at spec 2",
+      "UID 0 of bob is already in use",
+      "carol: supplementary group missing does not exist",
+      "dave: primary group missing does not exist",
+      "Group docker already exists",
+      "erin: primary GID 4242 does not exist"
+    ], result.errors
+    assert_equal [], result.users
+  end
+
+  def test_wraps_to_lowest_free_id_at_top_of_range
+    passwd = PASSWD + [{ name: "top", uid: EtcUtils::Provisioner::UID_MAX, gid: 0 }]
+    result = EtcUtils::Provisioner.plan([{ name: "bob" }], passwd: passwd, group: GROUP)
+
+    assert_equal 1001, result.users.first[:uid]
+  end
+
+  def test_system_ids_count_down_from_the_lowest_used
+    passwd = PASSWD + [{ name: "daemon", uid: 998, gid: 998 }]
+    group = GROUP + [{ name: "daemon", gid: 998, members: [] }]
+    result = EtcUtils::Provisioner.plan([{ name: "a", system: true }, { name: "b", system: true }],
+                                        passwd: passwd, group: group)
+
+    assert_equal [[997, 997], [996, 996]], result.users.map { |u| [u[:uid], u[:gid]] }
+  end
+
+  def test_system_ids_wrap_to_highest_free_id_at_bottom_of_range
+    passwd = PASSWD + [{ name: "low", uid: EtcUtils::Provisioner::SYS_UID_MIN, gid: 0 }]
+    result = EtcUtils::Provisioner.plan([{ name: "svc", system: true }], passwd: passwd, group: GROUP)
+
+    assert_equal 999, result.users.first[:uid]
+  end
+
+  def test_exhausted_range_raises
+    passwd = (101..999).map { |uid| { name: "s#{uid}", uid: uid, gid: 0 } }
+
+    assert_raise(EtcUtils::RangeExhaustedError) do
+      EtcUtils::Provisioner.plan([{ name: "svc", system: true }], passwd: passwd, group: GROUP)
+    end
+  end
+end
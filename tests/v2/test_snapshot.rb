@@ -0,0 +1,146 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "rbconfig"
+
+class TestSnapshot < Test::Unit::TestCase
+  def setup
+    super
+    skip_unless_linux
+    omit("Snapshots require the C extension") unless EtcUtils::Snapshot.available?
+  end
+
+  def test_entries_match_backend
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+
+      %i[passwd group shadow gshadow].each do |database|
+        snapshot = backend.snapshot(database)
+        expected = backend.read_versioned(database).first
+
+        assert_equal expected, snapshot.to_a, database
+        assert_equal expected.size, snapshot.size
+        assert snapshot.frozen?
+      end
+    end
+  end
+
+  def test_lookup_by_name_and_id
+    passwd = "root:x:0:0:root:/root:/bin/sh\nalice:x:1000:1000::/home/alice:/bin/sh\n" \
+             "alice:x:1001:1001::/home/alice2:/bin/sh\nbob:x:1000:1000::/home/bob:/bin/sh\n"
+    with_temp_root(passwd: passwd) do |root|
+      snapshot = EtcUtils::Backend::Linux.new(root: root).snapshot(:passwd)
+
+      # Duplicates resolve to the first entry in the file, like getpwnam(3)
+      assert_equal "/home/alice", snapshot["alice"][:dir]
+      assert_equal "alice", snapshot[1000][:name]
+      assert_equal "root", snapshot[0][:name]
+      assert_nil snapshot["carol"]
+      assert_nil snapshot["alic"]
+      assert_nil snapshot[-1]
+      assert_nil snapshot[2**32]
+      assert_nil snapshot[2**40]
+      assert_nil snapshot[2**70]
+      assert_equal "bob", snapshot.at(-1)[:name]
+      assert_nil snapshot.at(4)
+    end
+  end
+
+  def test_skips_comments_blank_and_short_lines
+    passwd = "# header\nroot:x:0:0:root:/root:/bin/sh\n\nbroken:x:1\nbin:x:1:1:bin:/bin:/sbin/nologin:extra"
+    with_temp_root(passwd: passwd) do |root|
+      snapshot = EtcUtils::Backend::Linux.new(root: root).snapshot(:passwd)
+
+      assert_equal %w[root bin], snapshot.map { |u| u[:name] }
+      assert_equal "/sbin/nologin", snapshot["bin"][:shell]
+      assert_nil snapshot["broken"]
+    end
+  end
+
+  def test_subid_and_empty_files
+    with_temp_root(gshadow: "") do |root|
+      File.write(File.join(root, "etc", "subuid"), "alice:100000:65536\n")
+      backend = EtcUtils::Backend::Linux.new(root: root)
+
+      assert_equal [{ name: "alice", start: 100_000, count: 65_536 }], backend.snapshot(:subuid).to_a
+      assert_equal 0, backend.snapshot(:gshadow).size
+      assert_raise(ArgumentError) { backend.snapshot(:gshadow)[0] }
+    end
+  end
+
+  def test_stale_after_write
+    with_temp_root do |root|
+      backend = EtcUtils::Backend::Linux.new(root: root)
+      snapshot = backend.snapshot(:group)
+      assert_false snapshot.stale?
+
+      backend.write_group(snapshot.to_a + [{ name: "staff", passwd: "x", gid: 50, members: [] }], backup: false)
+      assert snapshot.stale?
+      assert_nil snapshot["staff"]
+      assert_equal "staff", backend.snapshot(:group)[50][:name]
+    end
+  end
+
+  # The arena mapping must not be copied into a forked worker, even after
+  # it runs GC and looks entries up; the per-worker growth of the whole
+  # process is measured in a fresh interpreter so the test suite's own heap
+  # does not count
+  def test_stays_shared_across_fork
+    omit("Needs /proc/self/smaps_rollup") unless File.exist?("/proc/self/smaps_rollup")
+
+    script = <<~'RUBY'
+      require "etcutils"
+      require "tmpdir"
+
+      def private_dirty_kb(smaps = File.read("/proc/self/smaps_rollup"))
+        smaps.scan(/^Private_Dirty:\s+(\d+)/).flatten.sum(&:to_i)
+      end
+
+      # smaps block of the mapping containing address
+      def mapping(address)
+        File.read("/proc/self/smaps").split(/^(?=\h+-\h+ )/).find do |block|
+          from, to = block[/\A(\h+)-(\h+)/].split("-").map(&:hex)
+          address >= from && address < to
+        end
+      end
+
+      Dir.mktmpdir do |root|
+        Dir.mkdir(File.join(root, "etc"))
+        File.open(File.join(root, "etc", "passwd"), "w") do |f|
+          300_000.times { |i| f.puts "user#{i}:x:#{1000 + i}:100:User #{i}:/home/user#{i}:/bin/sh" }
+        end
+        snapshot = EtcUtils::Backend::Linux.new(root: root).snapshot(:passwd)
+        address = snapshot.arena.address
+        GC.start
+
+        reader, writer = IO.pipe
+        pid = fork do
+          reader.close
+          before = private_dirty_kb
+          3.times { GC.start }
+          5_000.times { |i| snapshot["user#{i * 60}"] && snapshot[1000 + i * 60] }
+          arena = mapping(address)
+          writer.write(Marshal.dump(
+            growth_kb: private_dirty_kb - before,
+            arena_private_kb: private_dirty_kb(arena),
+            arena_rss_kb: arena[/^Rss:\s+(\d+)/, 1].to_i
+          ))
+          writer.close
+          exit!(0)
+        end
+        writer.close
+        result = Marshal.load(reader.read)
+        Process.wait(pid)
+        print Marshal.dump(result.merge(arena_kb: snapshot.bytesize / 1024))
+      end
+    RUBY
+
+    lib = File.expand_path("../../lib", __dir__)
+    result = Marshal.load(IO.popen([RbConfig.ruby, "-I", lib, "-e", script], &:read))
+
+    assert_equal 0, result[:arena_private_kb]
+    assert_operator result[:arena_rss_kb], :>=, result[:arena_kb] - 4
+    # About 30 MB of entries; the worker only dirties its own heap pages
+    assert_operator result[:growth_kb], :<, result[:arena_kb] / 2
+  end
+end
@@ -0,0 +1,117 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "stringio"
+
+class TestSnapshotDiff < Test::Unit::TestCase
+  OLD_PASSWD = <<~PASSWD
+    root:x:0:0:root:/root:/bin/bash
+    # comment
+    bin:x:1:1:bin:/bin:/sbin/nologin
+    alice:x:1000:1000::/home/alice:/bin/sh
+
+    bob:x:1001:1001::/home/bob:/bin/sh
+  PASSWD
+
+  def diff(old, new, type: :passwd, **options)
+    EtcUtils::SnapshotDiff.each(StringIO.new(old), StringIO.new(new), type: type, **options).to_a
+  end
+
+  # Reference result: both sides loaded into Hashes
+  def naive_diff(old, new)
+    old_lines = old.lines.to_h { |l| [l.split(":").first, l.chomp] }
+    new_lines = new.lines.to_h { |l| [l.split(":").first, l.chomp] }
+    changes = new_lines.filter_map do |name, line|
+      if !old_lines.key?(name)
+        [:added, name]
+      elsif old_lines[name] != line
+        [:modified, name]
+      end
+    end
+    changes + (old_lines.keys - new_lines.keys).map { |name| [:removed, name] }
+  end
+
+  def test_identical_snapshots
+    assert_equal [], diff(OLD_PASSWD, OLD_PASSWD)
+  end
+
+  def test_field_level_changes
+    new = OLD_PASSWD.sub("/home/alice:/bin/sh", "/home/alice:/bin/bash")
+                    .sub("bob:x:1001:1001", "bob:x:1001:100")
+                    .sub(/^bin:.*\n/, "") + "carol:x:1002:1002:Carol:/home/carol:/bin/sh\n"
+
+    # bin is parked until the end, when it is known to be gone
+    assert_equal [
+      { type: :modified, name: "alice", fields: { shell: ["/bin/sh", "/bin/bash"] } },
+      { type: :modified, name: "bob", fields: { gid: [1001, 100] } },
+      { type: :added, name: "carol",
+        entry: { name: "carol", passwd: "x", uid: 1002, gid: 1002, gecos: "Carol", dir: "/home/carol",
+                 shell: "/bin/sh" } },
+      { type: :removed, name: "bin",
+        entry: { name: "bin", passwd: "x", uid: 1, gid: 1, gecos: "bin", dir: "/bin", shell: "/sbin/nologin" } }
+    ], diff(OLD_PASSWD, new)
+  end
+
+  def test_list_fields
+    old = "wheel:x:10:root,alice\nusers:x:100:\n"
+    new = "users:x:100:bob\nwheel:x:10:root\n"
+
+    assert_equal [
+      { type: :modified, name: "users", fields: { members: [[], ["bob"]] } },
+      { type: :modified, name: "wheel", fields: { members: [%w[root alice], ["root"]] } }
+    ], diff(old, new, type: :group)
+  end
+
+  def test_reordered_entries_are_matched
+    new = OLD_PASSWD.lines.reverse.join.sub("alice:x:1000", "alice:y:1000")
+
+    assert_equal [{ type: :modified, name: "alice", fields: { passwd: %w[x y] } }], diff(OLD_PASSWD, new)
+  end
+
+  def test_partitioned_diff_matches_lockstep
+    rng = Random.new(49)
+    old = Array.new(2_000) { |i| "user#{i}:x:#{i}:#{i}::/home/user#{i}:/bin/sh\n" }
+    new = old.each_with_index.filter_map do |line, i|
+      next if (i % 97).zero?
+
+      i % 13 == 0 ? line.sub("/bin/sh", "/bin/zsh") : line
+    end
+    new += Array.new(50) { |i| "new#{i}:x:#{5000 + i}:100::/home/new#{i}:/bin/sh\n" }
+    new.shuffle!(random: rng)
+
+    expected = naive_diff(old.join, new.join).sort
+    lockstep = diff(old.join, new.join)
+    partitioned = diff(old.join, new.join, max_pending: 10, partitions: 7)
+
+    assert_equal expected, lockstep.map { |c| [c[:type], c[:name]] }.sort
+    assert_equal lockstep.sort_by { |c| c[:name] }, partitioned.sort_by { |c| c[:name] }
+    assert_equal({ shell: ["/bin/sh", "/bin/zsh"] }, partitioned.find { |c| c[:name] == "user13" }[:fields])
+  end
+
+  def test_subid_ranges_are_matched_by_name_and_start
+    old = "alice:100000:65536\nbob:200000:65536\nalice:300000:65536\n"
+    new = "bob:200000:65536\nalice:300000:1000\n"
+    expected = [
+      { type: :removed, name: "alice", entry: { name: "alice", start: 100_000, count: 65_536 } },
+      { type: :modified, name: "alice", fields: { count: [65_536, 1000] } }
+    ]
+
+    assert_equal [expected.first], diff(old, new.sub(":1000", ":65536"), type: :subuid)
+    assert_equal expected.sort_by(&:to_s), diff(old, new, type: :subgid).sort_by(&:to_s)
+    assert_equal expected.sort_by(&:to_s), diff(old, new, type: :subgid, max_pending: 0).sort_by(&:to_s)
+  end
+
+  def test_paths_and_io
+    Dir.mktmpdir do |dir|
+      old_path = File.join(dir, "group")
+      File.write(old_path, "wheel:x:10:root\n")
+
+      changes = EtcUtils.diff(old_path, StringIO.new("wheel:x:11:root\n"), type: :group).to_a
+      assert_equal [{ type: :modified, name: "wheel", fields: { gid: [10, 11] } }], changes
+    end
+  end
+
+  def test_unknown_type
+    assert_raise(ArgumentError) { diff("", "", type: :hosts) }
+  end
+end
@@ -0,0 +1,145 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TestValidator < Test::Unit::TestCase
+  def user(name, uid, **extra)
+    { name: name, passwd: "x", uid: uid, gid: uid, gecos: "", dir: "/home/#{name}", shell: "/bin/sh" }.merge(extra)
+  end
+
+  def test_valid_passwd_entries
+    report = EtcUtils::Validator.passwd([user("root", 0), user("alice", 1000)])
+
+    assert report.valid?
+    assert_equal [], report.errors
+  end
+
+  def test_duplicate_user_name
+    report = EtcUtils::Validator.passwd([user("alice", 1000), user("alice", 1001)])
+
+    refute report.valid?
+    assert_includes report.errors, "Duplicate user name alice"
+  end
+
+  def test_duplicate_uid_names_both_owners
+    report = EtcUtils::Validator.passwd([user("alice", 1000), user("bob", 1000)])
+
+    # Shared UIDs (useradd -o) are allowed, as in pwck
+    assert report.valid?
+    assert_includes report.warnings, "Duplicate UID 1000 (alice, bob)"
+  end
+
+  def test_colon_and_newline_injection
+    report = EtcUtils::Validator.passwd([
+      user("alice", 1000, gecos: "Alice:0:0"),
+      user("bob", 1001, dir: "/home/bob\nroot::0:0::/:/bin/sh")
+    ])
+
+    assert_equal 2, report.errors.length
+    assert(report.errors.all? { |e| e.include?("contains ':' or newline") })
+  end
+
+  def test_invalid_numeric_fields
+    report = EtcUtils::Validator.passwd([user("alice", "abc"), user("bob", -1)])
+
+    assert_includes report.errors, 'Invalid UID for alice: "abc"'
+    assert_includes report.errors, "Invalid UID for bob: -1"
+  end
+
+  def test_numeric_strings_are_decimal
+    report = EtcUtils::Validator.passwd([user("alice", "010"), user("bob", 8)])
+
+    assert report.valid?
+  end
+
+  def test_missing_shell_is_a_warning
+    report = EtcUtils::Validator.passwd([user("alice", 1000, shell: "/nonexistent/shell")])
+
+    assert report.valid?
+    assert_includes report.warnings, "Shell does not exist: /nonexistent/shell"
+  end
+
+  def test_missing_name
+    report = EtcUtils::Validator.passwd([user(nil, 1000)])
+
+    assert_includes report.errors, "Missing passwd name at entry 1"
+  end
+
+  def test_group_members_reference_missing_users
+    groups = [{ name: "wheel", passwd: "x", gid: 10, members: %w[alice ghost] }]
+    report = EtcUtils::Validator.group(groups, users: { "alice" => true })
+
+    assert report.valid?
+    assert_equal ["wheel: member ghost does not exist"], report.warnings
+  end
+
+  def test_group_duplicate_gid_and_bad_member
+    groups = [
+      { name: "a", passwd: "x", gid: 10, members: [] },
+      { name: "b", passwd: "x", gid: 10, members: ["x,y"] }
+    ]
+    report = EtcUtils::Validator.group(groups)
+
+    assert_includes report.warnings, "Duplicate GID 10 (a, b)"
+    assert_includes report.errors, 'Invalid member "x,y" in b'
+  end
+
+  def test_shadow_without_user_and_bad_numbers
+    shadows = [
+      { name: "alice", passwd: "!", last_change: 19000, min_days: "x" },
+      { name: "ghost", passwd: "!", last_change: nil }
+    ]
+    report = EtcUtils::Validator.shadow(shadows, users: { "alice" => true })
+
+    assert_equal ['Invalid min_days for alice: "x"'], report.errors
+    assert_equal ["Shadow entry ghost has no matching user"], report.warnings
+  end
+
+  def test_shadow_day_fields_accept_minus_one
+    shadows = [{ name: "root", passwd: "!", last_change: 19000, inactive_days: -1, expire_date: "-1" }]
+
+    assert EtcUtils::Validator.shadow(shadows).valid?
+    assert_equal ['Invalid expire_date for root: "-x"'],
+                 EtcUtils::Validator.shadow([shadows.first.merge(expire_date: "-x")]).errors
+  end
+
+  def test_gshadow_checks_groups_and_admins
+    gshadows = [{ name: "ops", passwd: "!", admins: ["ghost"], members: [] }]
+    report = EtcUtils::Validator.gshadow(gshadows, users: {}, groups: {})
+
+    assert_includes report.warnings, "ops: admin ghost does not exist"
+    assert_includes report.warnings, "GShadow entry ops has no matching group"
+  end
+
+  def test_subid_overlaps_and_bad_ranges
+    report = EtcUtils::Validator.subid([
+      { name: "alice", start: 100_000, count: 65_536 },
+      { name: "alice", start: 120_000, count: 10 },
+      { name: "bob", start: 165_535, count: 65_536 },
+      { name: "carol", start: 300_000, count: 0 },
+      { name: "dave", start: nil, count: 1 }
+    ])
+
+    assert_equal ["Invalid count for carol: 0", "Invalid start for dave: nil"], report.errors
+    assert_equal ["Range 165535-231070 of bob overlaps a range of alice"], report.warnings
+  end
+
+  def test_accepts_structs
+    skip_if_v1_extension
+    report = EtcUtils::Validator.passwd([
+      EtcUtils::User.new(name: "alice", passwd: "x", uid: 1000, gid: 1000, gecos: "", dir: "/", shell: "")
+    ])
+
+    assert report.valid?
+  end
+
+  def test_linear_on_large_entry_sets
+    entries = Array.new(100_000) { |i| user("u#{i}", i + 1000, shell: "") }
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    report = EtcUtils::Validator.passwd(entries)
+    elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+
+    assert report.valid?
+    assert_operator elapsed, :<, 5.0
+  end
+end